@@ -8,10 +8,10 @@ QT       += core gui opengl
 
 TARGET = RayTracer
 TEMPLATE = app
-QMAKE_CXXFLAGS += -fopenmp
 LIBS += -lglut \
-        -lGLEW \
-        -lgomp
+        -lGLEW
+
+include(raytracercore.pri)
 
 SOURCES += main.cpp\
         mainwindow.cpp \
@@ -19,39 +19,17 @@ SOURCES += main.cpp\
     glEnv.cpp \
     glcanvaswindow.cpp \
     gl3dcanvas.cpp \
-    geometryutils.cpp \
     modelviewer.cpp \
     controlpanel.cpp \
-    shape.cpp \
-    camerainfo.cpp \
-    rgbaimage.cpp \
-    raytracer.cpp \
-    scene.cpp \
-    sceneparser.cpp \
-    lightsource.cpp \
     imageviewer.cpp
 
 HEADERS  += mainwindow.h \
-    utility.hpp \
-    util_common.h \
-    matrixutil.hpp \
-    mathutil.hpp \
     glTrackball.h \
     glEnv.h \
     glcanvaswindow.h \
     gl3dcanvas.h \
-    geometryutils.hpp \
     modelviewer.h \
     controlpanel.h \
-    shape.h \
-    camerainfo.h \
-    rgbaimage.h \
-    abstractimage.hpp \
-    raytracer.h \
-    scene.h \
-    sceneparser.h \
-    lightsource.h \
-    color.hpp \
     imageviewer.h
 
 FORMS    += mainwindow.ui
@@ -0,0 +1,301 @@
+#include "animation.h"
+#include "shape.h"
+#include "polygonmesh.h"
+#include "camerainfo.h"
+
+#include "matrixutil.hpp"
+using namespace MatrixUtils;
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+bool keyBefore(const Keyframe& a, const Keyframe& b)
+{
+    return a.frame < b.frame;
+}
+
+// inserts the key in frame order, a key at the frame of another replaces it
+void insertKey(vector<Keyframe>& keys, const Keyframe& k)
+{
+    vector<Keyframe>::iterator it = lower_bound(keys.begin(), keys.end(), k, keyBefore);
+    if( it != keys.end() && it->frame == k.frame )
+        *it = k;
+    else
+        keys.insert(it, k);
+}
+}
+
+Keyframe::Keyframe():
+    frame(0),
+    scale(1.0)
+{
+    for(int k=0;k<3;k++)
+    {
+        translation[k] = 0;
+        rotation[k] = 0;
+    }
+}
+
+Transform::Transform():
+    scale(1.0)
+{
+    for(int i=0;i<3;i++)
+    {
+        for(int j=0;j<3;j++)
+            r[i][j] = (i == j) ? 1.0 : 0.0;
+        t[i] = 0;
+    }
+}
+
+Transform::Transform(const Keyframe &k):
+    scale(k.scale)
+{
+    if( scale <= 0 )
+        throw "animation scale must be positive.";
+
+    // x first, so the matrix is Rz Ry Rx
+    DblMatrix4 m = makeRotationMatrix4_deg(k.rotation[0], k.rotation[1], k.rotation[2], ZYX);
+
+    for(int i=0;i<3;i++)
+    {
+        for(int j=0;j<3;j++)
+            r[i][j] = m(i, j);
+        t[i] = k.translation[i];
+    }
+}
+
+Animation::Animation():
+    _shapes(0),
+    _camera(0),
+    _firstFrame(0),
+    _lastFrame(0),
+    _hasFrameRange(false)
+{
+}
+
+void Animation::setFrameRange(int first, int last)
+{
+    if( first > last )
+        throw "invalid animation frame range.";
+
+    _firstFrame = first;
+    _lastFrame = last;
+    _hasFrameRange = true;
+}
+
+int Animation::firstFrame() const
+{
+    if( _hasFrameRange )
+        return _firstFrame;
+
+    double first = 0;
+    bool found = false;
+    for(size_t i=0;i<_tracks.size();i++)
+    {
+        if( !found || _tracks[i].keys.front().frame < first )
+            first = _tracks[i].keys.front().frame;
+        found = true;
+    }
+    if( !_cameraKeys.empty() && (!found || _cameraKeys.front().frame < first) )
+        first = _cameraKeys.front().frame;
+
+    return (int)floor(first);
+}
+
+int Animation::lastFrame() const
+{
+    if( _hasFrameRange )
+        return _lastFrame;
+
+    double last = 0;
+    bool found = false;
+    for(size_t i=0;i<_tracks.size();i++)
+    {
+        if( !found || _tracks[i].keys.back().frame > last )
+            last = _tracks[i].keys.back().frame;
+        found = true;
+    }
+    if( !_cameraKeys.empty() && (!found || _cameraKeys.back().frame > last) )
+        last = _cameraKeys.back().frame;
+
+    return (int)ceil(last);
+}
+
+Animation::Track& Animation::track(size_t shapeIdx)
+{
+    for(size_t i=0;i<_tracks.size();i++)
+    {
+        if( _tracks[i].shape == shapeIdx )
+            return _tracks[i];
+    }
+
+    Track tr;
+    tr.shape = shapeIdx;
+    tr.radius = 0;
+    _tracks.push_back(tr);
+    return _tracks.back();
+}
+
+void Animation::addShapeKey(size_t shapeIdx, const Keyframe &k)
+{
+    insertKey(track(shapeIdx).keys, k);
+}
+
+void Animation::addCameraKey(const Keyframe &k)
+{
+    insertKey(_cameraKeys, k);
+}
+
+void Animation::bind(Shape **shapes, size_t shapeNumber, CameraInfo *camera)
+{
+    _shapes = shapes;
+    _camera = camera;
+    _animatedShapes.clear();
+
+    for(size_t i=0;i<_tracks.size();i++)
+    {
+        Track& tr = _tracks[i];
+        if( tr.shape >= shapeNumber || !shapes[tr.shape] )
+            throw "animation key of a missing shape.";
+
+        Shape* s = shapes[tr.shape];
+        tr.points.clear();
+
+        switch( s->type() )
+        {
+        case Shape::SPHERE:
+        {
+            const Sphere* sp = dynamic_cast<const Sphere*>(s);
+            tr.points.push_back(sp->center());
+            tr.radius = sp->radius();
+            break;
+        }
+        case Shape::TRIANGLE:
+        {
+            const Triangle* tri = dynamic_cast<const Triangle*>(s);
+            for(int k=0;k<3;k++)
+                tr.points.push_back(tri->vertex(k));
+            tr.normal = tri->normal();
+            break;
+        }
+        case Shape::RECTANGLE:
+        {
+            const Rectangle* rt = dynamic_cast<const Rectangle*>(s);
+            for(int k=0;k<4;k++)
+                tr.points.push_back(rt->vertex(k));
+            tr.normal = rt->normal();
+            break;
+        }
+        case Shape::POLYGONMESH:
+            break;
+        default:
+            throw "shape type cannot be animated.";
+        }
+
+        _animatedShapes.push_back(tr.shape);
+    }
+
+    sort(_animatedShapes.begin(), _animatedShapes.end());
+
+    if( !_cameraKeys.empty() )
+    {
+        if( !camera )
+            throw "no camera info specified.";
+        _cameraPos = camera->_pos;
+        _cameraDir = camera->_dir;
+        _cameraUp = camera->worldUp();
+    }
+}
+
+Keyframe Animation::interpolate(const vector<Keyframe> &keys, double frame)
+{
+    if( keys.empty() )
+        return Keyframe();
+    if( frame <= keys.front().frame )
+        return keys.front();
+    if( frame >= keys.back().frame )
+        return keys.back();
+
+    Keyframe probe;
+    probe.frame = frame;
+    vector<Keyframe>::const_iterator next = upper_bound(keys.begin(), keys.end(), probe, keyBefore);
+    const Keyframe& b = *next;
+    const Keyframe& a = *(next - 1);
+
+    double w = (frame - a.frame) / (b.frame - a.frame);
+
+    Keyframe k;
+    k.frame = frame;
+    for(int i=0;i<3;i++)
+    {
+        k.translation[i] = a.translation[i] + (b.translation[i] - a.translation[i]) * w;
+        k.rotation[i] = a.rotation[i] + (b.rotation[i] - a.rotation[i]) * w;
+    }
+    k.scale = a.scale + (b.scale - a.scale) * w;
+
+    return k;
+}
+
+void Animation::applyTrack(Track &tr, const Transform &t)
+{
+    Shape* s = _shapes[tr.shape];
+
+    switch( s->type() )
+    {
+    case Shape::SPHERE:
+    {
+        Sphere* sp = dynamic_cast<Sphere*>(s);
+        sp->center() = t.apply(tr.points[0]);
+        sp->radius() = tr.radius * t.scale;
+        break;
+    }
+    case Shape::TRIANGLE:
+    {
+        Triangle* tri = dynamic_cast<Triangle*>(s);
+        for(int k=0;k<3;k++)
+            tri->vertex(k) = t.apply(tr.points[k]);
+        tri->normal() = t.rotate(tr.normal);
+        break;
+    }
+    case Shape::RECTANGLE:
+    {
+        Rectangle* rt = dynamic_cast<Rectangle*>(s);
+        for(int k=0;k<4;k++)
+            rt->vertex(k) = t.apply(tr.points[k]);
+        rt->normal() = t.rotate(tr.normal);
+        break;
+    }
+    case Shape::POLYGONMESH:
+        dynamic_cast<PolygonMesh*>(s)->setTransform(t);
+        break;
+    default:
+        break;
+    }
+}
+
+void Animation::apply(double frame)
+{
+    if( !_shapes && !_tracks.empty() )
+        throw "animation is not bound to a scene.";
+
+    for(size_t i=0;i<_tracks.size();i++)
+        applyTrack(_tracks[i], Transform(interpolate(_tracks[i].keys, frame)));
+
+    if( !_cameraKeys.empty() && _camera )
+    {
+        Transform t(interpolate(_cameraKeys, frame));
+        _camera->_pos = t.apply(_cameraPos);
+        _camera->_dir = t.rotate(_cameraDir);
+
+        // the up vector turns with the camera, rolling it with the key, and
+        // is made orthogonal to the direction again
+        DblVector3D dir = normalize(_camera->_dir);
+        DblVector3D up = t.rotate(_cameraUp);
+        up = up - dir * dotProduct(up, dir);
+        if( dotProduct(up, up) > 1e-12 )
+            _camera->setWorldUp(normalize(up));
+        _camera->setup();
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <vector>
+using namespace std;
+
+#include "geometryutils.hpp"
+using namespace GeometryUtils;
+
+#include "raytracer.h"
+
+class Shape;
+class CameraInfo;
+
+// pose at a key frame: a rotation about the x, then the y and then the z
+// axis, in degrees, and a uniform scale, both about the origin, followed by
+// a translation
+struct Keyframe
+{
+    Keyframe();
+
+    double frame;
+    double translation[3];
+    double rotation[3];
+    double scale;
+};
+
+// the map p -> scale r p + t of a pose, r is the rotation
+struct Transform
+{
+    Transform();
+    Transform(const Keyframe& k);
+
+    template <typename T>
+    Point3D<T> apply(const Point3D<T>& p) const
+    {
+        Point3D<T> q = rotate(p);
+        return Point3D<T>(q.x() * scale + t[0], q.y() * scale + t[1], q.z() * scale + t[2]);
+    }
+
+    // turns a direction, without scaling it
+    template <typename T>
+    Point3D<T> rotate(const Point3D<T>& v) const
+    {
+        return Point3D<T>(r[0][0] * v.x() + r[0][1] * v.y() + r[0][2] * v.z(),
+                          r[1][0] * v.x() + r[1][1] * v.y() + r[1][2] * v.z(),
+                          r[2][0] * v.x() + r[2][1] * v.y() + r[2][2] * v.z());
+    }
+
+    double r[3][3];
+    double t[3];
+    double scale;
+};
+
+/*
+ * Keyframed motion of the shapes and the camera of a scene. Between two
+ * keys the translation, the angles and the scale are interpolated
+ * linearly, before the first and after the last key the pose is held.
+ *
+ * The keys are applied to the shapes and the camera as they were loaded,
+ * kept when the animation is bound to them, so that every frame is placed
+ * from the same rest pose and no error builds up from frame to frame.
+ */
+class Animation
+{
+public:
+    Animation();
+
+    void setFrameRange(int first, int last);
+    // the frames to render, those of the keys unless set
+    int firstFrame() const;
+    int lastFrame() const;
+
+    void addShapeKey(size_t shapeIdx, const Keyframe& k);
+    void addCameraKey(const Keyframe& k);
+
+    // keeps the rest pose of the animated shapes and of the camera, throws
+    // when a key refers to a missing or unsupported shape
+    void bind(Shape** shapes, size_t shapeNumber, CameraInfo* camera);
+
+    // moves the animated shapes and the camera to the frame, fractional
+    // frames are interpolated as well
+    void apply(double frame);
+
+    // indices of the shapes with keys, in increasing order
+    const vector<size_t>& animatedShapes() const { return _animatedShapes; }
+
+    // pose of the keys, sorted by frame, at the frame
+    static Keyframe interpolate(const vector<Keyframe>& keys, double frame);
+
+private:
+    struct Track
+    {
+        size_t shape;
+        vector<Keyframe> keys;
+
+        // rest pose, the center of a sphere, the vertices of a triangle or
+        // a rectangle, with their normal; meshes keep their own
+        vector<RealPoint3D> points;
+        RealVector3D normal;
+        Real radius;
+    };
+
+    Track& track(size_t shapeIdx);
+    void applyTrack(Track& tr, const Transform& t);
+
+private:
+    Shape** _shapes;
+    CameraInfo* _camera;
+
+    int _firstFrame, _lastFrame;
+    bool _hasFrameRange;
+
+    vector<Track> _tracks;
+    vector<size_t> _animatedShapes;
+
+    vector<Keyframe> _cameraKeys;
+    DblPoint3D _cameraPos;
+    DblVector3D _cameraDir;
+    // in world space
+    DblVector3D _cameraUp;
+};
+
+#endif // ANIMATION_H
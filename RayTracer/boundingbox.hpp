@@ -0,0 +1,123 @@
+#ifndef BOUNDINGBOX_HPP
+#define BOUNDINGBOX_HPP
+
+#include "geometryutils.hpp"
+using namespace GeometryUtils;
+
+#include <cfloat>
+
+// axis aligned bounding box, used by the acceleration structures
+class BoundingBox
+{
+public:
+    BoundingBox()
+    {
+        reset();
+    }
+
+    template <typename T>
+    BoundingBox(const Point3D<T>& pmin, const Point3D<T>& pmax)
+    {
+        _min[0] = pmin.x(), _min[1] = pmin.y(), _min[2] = pmin.z();
+        _max[0] = pmax.x(), _max[1] = pmax.y(), _max[2] = pmax.z();
+    }
+
+    void reset()
+    {
+        for(int i=0;i<3;i++)
+        {
+            _min[i] = DBL_MAX;
+            _max[i] = -DBL_MAX;
+        }
+    }
+
+    bool isEmpty() const
+    {
+        return ( _min[0] > _max[0] || _min[1] > _max[1] || _min[2] > _max[2] );
+    }
+
+    template <typename T>
+    void expand(const Point3D<T>& p)
+    {
+        if( p.x() < _min[0] ) _min[0] = p.x();
+        if( p.y() < _min[1] ) _min[1] = p.y();
+        if( p.z() < _min[2] ) _min[2] = p.z();
+        if( p.x() > _max[0] ) _max[0] = p.x();
+        if( p.y() > _max[1] ) _max[1] = p.y();
+        if( p.z() > _max[2] ) _max[2] = p.z();
+    }
+
+    void expand(const BoundingBox& b)
+    {
+        for(int i=0;i<3;i++)
+        {
+            if( b._min[i] < _min[i] ) _min[i] = b._min[i];
+            if( b._max[i] > _max[i] ) _max[i] = b._max[i];
+        }
+    }
+
+    // enlarge the box a little so that flat shapes still have a volume
+    void pad(double eps)
+    {
+        for(int i=0;i<3;i++)
+        {
+            _min[i] -= eps;
+            _max[i] += eps;
+        }
+    }
+
+    double center(int axis) const
+    {
+        return 0.5 * (_min[axis] + _max[axis]);
+    }
+
+    double extent(int axis) const
+    {
+        return _max[axis] - _min[axis];
+    }
+
+    int longestAxis() const
+    {
+        int axis = 0;
+        if( extent(1) > extent(axis) ) axis = 1;
+        if( extent(2) > extent(axis) ) axis = 2;
+        return axis;
+    }
+
+    double surfaceArea() const
+    {
+        if( isEmpty() )
+            return 0;
+
+        double dx = extent(0), dy = extent(1), dz = extent(2);
+        return 2.0 * (dx * dy + dy * dz + dz * dx);
+    }
+
+    // slab test, origin and inverse direction are given as plain arrays
+    bool intersect(const double orig[3], const double invDir[3], double tmax, double& tnear) const
+    {
+        double t0 = 0, t1 = tmax;
+        for(int i=0;i<3;i++)
+        {
+            double tn = (_min[i] - orig[i]) * invDir[i];
+            double tf = (_max[i] - orig[i]) * invDir[i];
+            if( tn > tf )
+            {
+                double tmp = tn;
+                tn = tf;
+                tf = tmp;
+            }
+            if( tn > t0 ) t0 = tn;
+            if( tf < t1 ) t1 = tf;
+            if( t0 > t1 )
+                return false;
+        }
+
+        tnear = t0;
+        return true;
+    }
+
+    double _min[3], _max[3];
+};
+
+#endif // BOUNDINGBOX_HPP
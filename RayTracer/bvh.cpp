@@ -0,0 +1,592 @@
+#include "bvh.h"
+#include "shape.h"
+#include "shapetable.h"
+#include "raypacket.h"
+#include "simdutil.hpp"
+
+#include <algorithm>
+
+const size_t BVH::maxLeafSize = 4;
+const size_t BVH::binNumber = 16;
+const size_t BVH::maxDepth = 48;
+
+namespace
+{
+// box padding, keeps flat shapes such as the ground inside a non-degenerate box
+const double BOX_PADDING = 1e-6;
+
+// relative cost of traversing a node compared to testing a shape
+const double TRAVERSAL_COST = 0.5;
+
+struct BinPartition
+{
+    BinPartition(const vector<double>& centroids, int axis, double minC, double scale, size_t bins, size_t split):
+        _centroids(centroids), _axis(axis), _minC(minC), _scale(scale), _bins(bins), _split(split)
+    {}
+
+    bool operator()(unsigned int idx) const
+    {
+        size_t b = (size_t)((_centroids[idx * 3 + _axis] - _minC) * _scale);
+        if( b >= _bins ) b = _bins - 1;
+        return b < _split;
+    }
+
+    const vector<double>& _centroids;
+    int _axis;
+    double _minC, _scale;
+    size_t _bins, _split;
+};
+}
+
+BVH::BVH():
+    _shapes(0),
+    _shapeNumber(0),
+    _table(0),
+    _nodeArray(0),
+    _nodeNumber(0),
+    _indexArray(0),
+    _indexNumber(0),
+    _builtArea(0)
+{
+}
+
+BVH::~BVH()
+{
+}
+
+void BVH::clear()
+{
+    _shapes = 0;
+    _shapeNumber = 0;
+    _table = 0;
+    _indices.clear();
+    _nodes.clear();
+    _builtArea = 0;
+    bindArrays();
+}
+
+void BVH::attach(const BVHNode *nodes, size_t nodeNumber, const unsigned int *indices, size_t indexNumber,
+                 Shape **shapes, size_t shapeNumber, const ShapeTable *table)
+{
+    clear();
+
+    _shapes = shapes;
+    _shapeNumber = shapeNumber;
+    _table = table;
+
+    _nodeArray = nodes;
+    _nodeNumber = nodeNumber;
+    _indexArray = indices;
+    _indexNumber = indexNumber;
+}
+
+void BVH::bindArrays()
+{
+    _nodeNumber = _nodes.size();
+    _nodeArray = _nodes.empty() ? 0 : &_nodes[0];
+    _indexNumber = _indices.size();
+    _indexArray = _indices.empty() ? 0 : &_indices[0];
+}
+
+const BoundingBox& BVH::bounds() const
+{
+    static const BoundingBox emptyBox;
+    if( _nodeNumber == 0 )
+        return emptyBox;
+    else
+        return _nodeArray[0]._box;
+}
+
+void BVH::build(Shape **shapes, size_t shapeNumber, const ShapeTable *table)
+{
+    clear();
+
+    _shapes = shapes;
+    _shapeNumber = shapeNumber;
+    _table = table;
+
+    vector<BoundingBox> boxes(shapeNumber);
+
+    _indices.reserve(shapeNumber);
+    for(size_t i=0;i<shapeNumber;i++)
+    {
+        if( !_shapes[i] )
+            continue;
+
+        boxes[i] = _shapes[i]->boundingBox();
+        _indices.push_back(i);
+    }
+
+    buildNodes(boxes);
+}
+
+void BVH::build(const vector<BoundingBox> &boxes)
+{
+    clear();
+
+    _indices.resize(boxes.size());
+    for(size_t i=0;i<boxes.size();i++)
+        _indices[i] = i;
+
+    vector<BoundingBox> paddedBoxes(boxes);
+    buildNodes(paddedBoxes);
+}
+
+double BVH::refit()
+{
+    _refitBoxes.resize(_shapeNumber);
+    for(size_t i=0;i<_shapeNumber;i++)
+    {
+        if( _shapes[i] )
+            _refitBoxes[i] = _shapes[i]->boundingBox();
+    }
+
+    return refitNodes(_refitBoxes);
+}
+
+double BVH::refit(const vector<BoundingBox> &boxes)
+{
+    return refitNodes(boxes);
+}
+
+double BVH::refitNodes(const vector<BoundingBox> &boxes)
+{
+    if( _nodeNumber == 0 )
+        return 1.0;
+
+    if( _nodes.empty() )
+    {
+        _nodes.assign(_nodeArray, _nodeArray + _nodeNumber);
+        _indices.assign(_indexArray, _indexArray + _indexNumber);
+        bindArrays();
+    }
+
+    if( _builtArea <= 0 )
+        _builtArea = nodeArea();
+
+    // the children of a node are stored after it, so walking the nodes
+    // backwards reaches the children before their parent
+    for(size_t i=_nodes.size();i-->0;)
+    {
+        BVHNode& node = _nodes[i];
+        BoundingBox box;
+
+        if( node.isLeaf() )
+        {
+            for(size_t k=0;k<node._count;k++)
+            {
+                BoundingBox b = boxes[_indices[node._offset + k]];
+                b.pad(BOX_PADDING);
+                box.expand(b);
+            }
+        }
+        else
+        {
+            box = _nodes[i + 1]._box;
+            box.expand(_nodes[node._offset]._box);
+        }
+
+        node._box = box;
+    }
+
+    return _builtArea > 0 ? nodeArea() / _builtArea : 1.0;
+}
+
+double BVH::nodeArea() const
+{
+    double area = 0;
+    for(size_t i=0;i<_nodeNumber;i++)
+        area += _nodeArray[i]._box.surfaceArea();
+    return area;
+}
+
+void BVH::buildNodes(vector<BoundingBox> &boxes)
+{
+    if( _indices.empty() )
+    {
+        bindArrays();
+        return;
+    }
+
+    vector<double> centroids(boxes.size() * 3);
+    for(size_t i=0;i<_indices.size();i++)
+    {
+        unsigned int idx = _indices[i];
+        boxes[idx].pad(BOX_PADDING);
+        for(int k=0;k<3;k++)
+            centroids[idx * 3 + k] = boxes[idx].center(k);
+    }
+
+    // a binary tree never has more than 2n - 1 nodes
+    _nodes.reserve(2 * _indices.size() - 1);
+    buildRecursive(0, _indices.size(), boxes, centroids, 0);
+    bindArrays();
+}
+
+unsigned int BVH::buildRecursive(size_t begin, size_t end,
+                                 vector<BoundingBox> &boxes,
+                                 vector<double> &centroids,
+                                 size_t depth)
+{
+    unsigned int nodeIdx = _nodes.size();
+    _nodes.push_back(BVHNode());
+
+    BoundingBox box, centroidBox;
+    for(size_t i=begin;i<end;i++)
+    {
+        unsigned int idx = _indices[i];
+        box.expand(boxes[idx]);
+        centroidBox.expand(DblPoint3D(centroids[idx * 3 + 0],
+                                      centroids[idx * 3 + 1],
+                                      centroids[idx * 3 + 2]));
+    }
+
+    _nodes[nodeIdx]._box = box;
+    _nodes[nodeIdx]._axis = 0;
+
+    size_t count = end - begin;
+    if( count <= maxLeafSize || depth >= maxDepth )
+    {
+        _nodes[nodeIdx]._offset = begin;
+        _nodes[nodeIdx]._count = count;
+        return nodeIdx;
+    }
+
+    // binned surface area heuristic over all three axes
+    double bestCost = DBL_MAX;
+    int bestAxis = -1;
+    size_t bestSplit = 0;
+
+    vector<BoundingBox> binBoxes(binNumber);
+    vector<size_t> binCounts(binNumber);
+    vector<double> rightAreas(binNumber);
+
+    for(int axis=0;axis<3;axis++)
+    {
+        double extent = centroidBox.extent(axis);
+        if( extent <= 0 )
+            continue;
+
+        double scale = binNumber / extent;
+
+        for(size_t b=0;b<binNumber;b++)
+        {
+            binBoxes[b].reset();
+            binCounts[b] = 0;
+        }
+
+        for(size_t i=begin;i<end;i++)
+        {
+            unsigned int idx = _indices[i];
+            size_t b = (size_t)((centroids[idx * 3 + axis] - centroidBox._min[axis]) * scale);
+            if( b >= binNumber ) b = binNumber - 1;
+            binBoxes[b].expand(boxes[idx]);
+            binCounts[b]++;
+        }
+
+        // sweep from the right to get the areas of the right partitions
+        BoundingBox rightBox;
+        for(size_t b=binNumber-1;b>0;b--)
+        {
+            rightBox.expand(binBoxes[b]);
+            rightAreas[b] = rightBox.surfaceArea();
+        }
+
+        // sweep from the left and evaluate every split plane
+        BoundingBox leftBox;
+        size_t leftCount = 0;
+        for(size_t b=1;b<binNumber;b++)
+        {
+            leftBox.expand(binBoxes[b - 1]);
+            leftCount += binCounts[b - 1];
+            size_t rightCount = count - leftCount;
+            if( leftCount == 0 || rightCount == 0 )
+                continue;
+
+            double cost = leftBox.surfaceArea() * leftCount + rightAreas[b] * rightCount;
+            if( cost < bestCost )
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    size_t mid = begin;
+    if( bestAxis >= 0 )
+    {
+        double area = box.surfaceArea();
+        bestCost = TRAVERSAL_COST + (area > 0 ? bestCost / area : count);
+
+        // splitting is not worth it, keep the shapes in one leaf
+        if( bestCost >= count && count <= 4 * maxLeafSize )
+        {
+            _nodes[nodeIdx]._offset = begin;
+            _nodes[nodeIdx]._count = count;
+            return nodeIdx;
+        }
+
+        double scale = binNumber / centroidBox.extent(bestAxis);
+        vector<unsigned int>::iterator it =
+                std::partition(_indices.begin() + begin, _indices.begin() + end,
+                               BinPartition(centroids, bestAxis, centroidBox._min[bestAxis],
+                                            scale, binNumber, bestSplit));
+        mid = it - _indices.begin();
+        _nodes[nodeIdx]._axis = bestAxis;
+    }
+
+    // all centroids coincide, split in the middle of the list
+    if( mid == begin || mid == end )
+    {
+        mid = begin + count / 2;
+        _nodes[nodeIdx]._axis = box.longestAxis();
+    }
+
+    buildRecursive(begin, mid, boxes, centroids, depth + 1);
+    unsigned int rightIdx = buildRecursive(mid, end, boxes, centroids, depth + 1);
+
+    _nodes[nodeIdx]._offset = rightIdx;
+    _nodes[nodeIdx]._count = 0;
+
+    return nodeIdx;
+}
+
+bool BVH::intersect(const Ray &r, Hit &h, RayStatistics* stats) const
+{
+    if( _nodeNumber == 0 )
+        return false;
+
+    RealVector3D dir = normalize( r.dir() );
+    double orig[3] = { r.origin().x(), r.origin().y(), r.origin().z() };
+    Real dirArr[3] = { dir.x(), dir.y(), dir.z() };
+    double invDir[3] = { 1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z() };
+    bool dirNegative[3] = { dir.x() < 0, dir.y() < 0, dir.z() < 0 };
+
+    bool intersectFlag = false;
+    size_t visits = 0, tests = 0;
+
+    unsigned int stack[64];
+    size_t stackSize = 0;
+    unsigned int nodeIdx = 0;
+
+    while( true )
+    {
+        const BVHNode& node = _nodeArray[nodeIdx];
+        double tnear;
+        visits++;
+
+        if( node._box.intersect(orig, invDir, h.t(), tnear) )
+        {
+            if( node.isLeaf() )
+            {
+                tests += node._count;
+                for(size_t i=0;i<node._count;i++)
+                {
+                    unsigned int idx = _indexArray[node._offset + i];
+                    if( _table )
+                        intersectFlag |= _table->intersect(idx, r, dirArr, h);
+                    else
+                        intersectFlag |= _shapes[idx]->intersect(r, h);
+                }
+            }
+            else
+            {
+                // visit the nearer child first
+                if( dirNegative[node._axis] )
+                {
+                    stack[stackSize++] = nodeIdx + 1;
+                    nodeIdx = node._offset;
+                }
+                else
+                {
+                    stack[stackSize++] = node._offset;
+                    nodeIdx = nodeIdx + 1;
+                }
+                continue;
+            }
+        }
+
+        if( stackSize == 0 )
+            break;
+        nodeIdx = stack[--stackSize];
+    }
+
+    if( stats )
+    {
+        stats->nodeVisits += visits;
+        stats->intersectionTests += tests;
+    }
+
+    return intersectFlag;
+}
+
+namespace
+{
+// slab test of the valid rays of a packet against a box, true if any ray
+// hits; the padded lanes of a partial packet are masked out
+bool intersectPacketBox(const BoundingBox& box, const RayPacket& p)
+{
+    using namespace SIMDUtils;
+
+    const RealPack minX = broadcast<RealPack>(box._min[0]), maxX = broadcast<RealPack>(box._max[0]);
+    const RealPack minY = broadcast<RealPack>(box._min[1]), maxY = broadcast<RealPack>(box._max[1]);
+    const RealPack minZ = broadcast<RealPack>(box._min[2]), maxZ = broadcast<RealPack>(box._max[2]);
+    const RealPack zero = broadcast<RealPack>(0);
+
+    for(size_t i=0;i<p.size;i+=RealPack::width)
+    {
+        RealPack ox = load(p.ox + i), oy = load(p.oy + i), oz = load(p.oz + i);
+        RealPack ix = load(p.idx + i), iy = load(p.idy + i), iz = load(p.idz + i);
+
+        RealPack tx0 = (minX - ox) * ix, tx1 = (maxX - ox) * ix;
+        RealPack ty0 = (minY - oy) * iy, ty1 = (maxY - oy) * iy;
+        RealPack tz0 = (minZ - oz) * iz, tz1 = (maxZ - oz) * iz;
+
+        RealPack tnear = max( max( min(tx0, tx1), min(ty0, ty1) ), max( min(tz0, tz1), zero ) );
+        RealPack tfar = min( min( max(tx0, tx1), max(ty0, ty1) ), min( max(tz0, tz1), load(p.t + i) ) );
+
+        if( moveMask( lessEqual(tnear, tfar) ) & p.activeLanes(i, RealPack::width) )
+            return true;
+    }
+
+    return false;
+}
+}
+
+void BVH::intersectPacket(RayPacket &p, RayStatistics* stats) const
+{
+    if( _nodeNumber == 0 )
+        return;
+
+    // the rays of a packet are coherent, the first ray decides the order
+    bool dirNegative[3] = { p.dx[0] < 0, p.dy[0] < 0, p.dz[0] < 0 };
+
+    unsigned int stack[64];
+    size_t stackSize = 0;
+    unsigned int nodeIdx = 0;
+    size_t visits = 0, tests = 0;
+
+    while( true )
+    {
+        const BVHNode& node = _nodeArray[nodeIdx];
+        visits++;
+
+        if( intersectPacketBox(node._box, p) )
+        {
+            if( node.isLeaf() )
+            {
+                // every shape of the leaf is tested against the whole packet
+                tests += node._count * p.size;
+                for(size_t i=0;i<node._count;i++)
+                {
+                    unsigned int idx = _indexArray[node._offset + i];
+                    if( _table )
+                        _table->intersectPacket(idx, p);
+                    else
+                        _shapes[idx]->intersectPacket(p, idx);
+                }
+            }
+            else
+            {
+                if( dirNegative[node._axis] )
+                {
+                    stack[stackSize++] = nodeIdx + 1;
+                    nodeIdx = node._offset;
+                }
+                else
+                {
+                    stack[stackSize++] = node._offset;
+                    nodeIdx = nodeIdx + 1;
+                }
+                continue;
+            }
+        }
+
+        if( stackSize == 0 )
+            break;
+        nodeIdx = stack[--stackSize];
+    }
+
+    if( stats )
+    {
+        stats->nodeVisits += visits;
+        stats->intersectionTests += tests;
+    }
+}
+
+size_t BVH::collectBlockers(const Ray &r, Real t, size_t *indices, size_t maxCount, int& occluder,
+                            RayStatistics* stats) const
+{
+    occluder = -1;
+
+    if( _nodeNumber == 0 )
+        return 0;
+
+    RealVector3D dir = normalize( r.dir() );
+    double orig[3] = { r.origin().x(), r.origin().y(), r.origin().z() };
+    Real dirArr[3] = { dir.x(), dir.y(), dir.z() };
+    double invDir[3] = { 1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z() };
+
+    size_t blockerNumber = 0;
+    size_t visits = 0, tests = 0;
+
+    unsigned int stack[64];
+    size_t stackSize = 0;
+    unsigned int nodeIdx = 0;
+
+    while( true )
+    {
+        const BVHNode& node = _nodeArray[nodeIdx];
+        double tnear;
+        visits++;
+
+        if( node._box.intersect(orig, invDir, t, tnear) )
+        {
+            if( node.isLeaf() )
+            {
+                for(size_t i=0;i<node._count;i++)
+                {
+                    size_t idx = _indexArray[node._offset + i];
+                    tests++;
+                    bool blocked = _table ? _table->blockTest(idx, r, dirArr, t)
+                                          : _shapes[idx]->blockTest(r, t);
+                    if( blocked )
+                    {
+                        if( blockerNumber < maxCount )
+                            indices[blockerNumber] = idx;
+                        blockerNumber++;
+
+                        // nothing passes an opaque shape, the other
+                        // blockers do not matter any more
+                        Real rate = _table ? _table->refractionRate(idx) : _shapes[idx]->refractionRate();
+                        if( rate <= 0 )
+                        {
+                            occluder = idx;
+                            stackSize = 0;
+                            break;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node._offset;
+                nodeIdx = nodeIdx + 1;
+                continue;
+            }
+        }
+
+        if( stackSize == 0 )
+            break;
+        nodeIdx = stack[--stackSize];
+    }
+
+    if( stats )
+    {
+        stats->nodeVisits += visits;
+        stats->shadowTests += tests;
+    }
+
+    return blockerNumber;
+}
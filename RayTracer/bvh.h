@@ -0,0 +1,168 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+using namespace std;
+
+#include "boundingbox.hpp"
+#include "raytracer.h"
+
+class Shape;
+class ShapeTable;
+struct RayPacket;
+
+// node of the flattened hierarchy
+// interior node: left child is the next node, _offset is the right child
+// leaf node: _offset is the first primitive, _count is the number of primitives
+struct BVHNode
+{
+    BoundingBox _box;
+    unsigned int _offset;
+    unsigned int _count;
+    unsigned int _axis;
+
+    bool isLeaf() const { return _count > 0; }
+};
+
+// bounding volume hierarchy over the shapes of a scene, built with the
+// surface area heuristic and stored as a contiguous array of nodes
+class BVH
+{
+public:
+    BVH();
+    ~BVH();
+
+    // the leaves test the shapes through the table when one is given,
+    // otherwise through the shape objects
+    void build(Shape** shapes, size_t shapeNumber, const ShapeTable* table = 0);
+
+    // builds over arbitrary primitives given by their boxes, the primitives
+    // are referenced by their index and tested by the caller in traverse
+    void build(const vector<BoundingBox>& boxes);
+    void clear();
+
+    // recomputes the boxes of the nodes bottom up after the shapes moved,
+    // keeping the tree as it was built; attached nodes are copied first.
+    // Returns the summed surface area of the nodes relative to the last
+    // build, a tree refitted far from its build pose is worth rebuilding
+    double refit();
+    // the same for a hierarchy over primitives, given their new boxes
+    double refit(const vector<BoundingBox>& boxes);
+
+    // uses nodes and indices built before, e.g. by a scene cache, in place,
+    // the arrays are not copied and must outlive the hierarchy
+    void attach(const BVHNode* nodes, size_t nodeNumber, const unsigned int* indices, size_t indexNumber,
+                Shape** shapes = 0, size_t shapeNumber = 0, const ShapeTable* table = 0);
+
+    // walks the nodes hit by the ray, nearer child first, and calls
+    // visitor(idx) for the primitives of the leaves reached; the boxes are
+    // tested up to visitor.tmax(), the walk stops when visitor returns true
+    template <typename Visitor>
+    void traverse(const double orig[3], const double invDir[3], Visitor& visitor) const;
+
+    // the queries add their node visits and shape tests to stats when given
+    bool intersect(const Ray& r, Hit& h, RayStatistics* stats = 0) const;
+
+    // finds the nearest shape of every ray in the packet, a node is visited
+    // when any of the rays hits its box
+    void intersectPacket(RayPacket& p, RayStatistics* stats = 0) const;
+
+    // collects the indices of the shapes blocking the ray before t,
+    // returns the number of blocking shapes found, which may be larger than
+    // maxCount if the buffer is too small; the traversal stops at the first
+    // opaque blocker, its index is stored into occluder, -1 if there is none
+    size_t collectBlockers(const Ray& r, Real t, size_t* indices, size_t maxCount, int& occluder,
+                           RayStatistics* stats = 0) const;
+
+    size_t nodeNumber() const { return _nodeNumber; }
+    size_t indexNumber() const { return _indexNumber; }
+    const BVHNode* nodes() const { return _nodeArray; }
+    const unsigned int* indices() const { return _indexArray; }
+    const BoundingBox& bounds() const;
+
+    static const size_t maxLeafSize;
+    static const size_t binNumber;
+    static const size_t maxDepth;
+
+protected:
+    void buildNodes(vector<BoundingBox>& boxes);
+    void bindArrays();
+    double refitNodes(const vector<BoundingBox>& boxes);
+    double nodeArea() const;
+    unsigned int buildRecursive(size_t begin, size_t end,
+                                vector<BoundingBox>& boxes,
+                                vector<double>& centroids,
+                                size_t depth);
+
+private:
+    Shape** _shapes;
+    size_t _shapeNumber;
+    const ShapeTable* _table;
+
+    // shape indices, referenced by the leaves
+    vector<unsigned int> _indices;
+    vector<BVHNode> _nodes;
+
+    // arrays walked by the queries, the buffers above after a build, or
+    // attached memory
+    const BVHNode* _nodeArray;
+    size_t _nodeNumber;
+    const unsigned int* _indexArray;
+    size_t _indexNumber;
+
+    // summed node area of the built tree, 0 until the first refit, and the
+    // shape boxes of the last refit
+    double _builtArea;
+    vector<BoundingBox> _refitBoxes;
+};
+
+template <typename Visitor>
+void BVH::traverse(const double orig[3], const double invDir[3], Visitor& visitor) const
+{
+    if( _nodeNumber == 0 )
+        return;
+
+    bool dirNegative[3] = { invDir[0] < 0, invDir[1] < 0, invDir[2] < 0 };
+
+    unsigned int stack[64];
+    size_t stackSize = 0;
+    unsigned int nodeIdx = 0;
+
+    while( true )
+    {
+        const BVHNode& node = _nodeArray[nodeIdx];
+        double tnear;
+
+        if( node._box.intersect(orig, invDir, visitor.tmax(), tnear) )
+        {
+            if( node.isLeaf() )
+            {
+                for(size_t i=0;i<node._count;i++)
+                {
+                    if( visitor(_indexArray[node._offset + i]) )
+                        return;
+                }
+            }
+            else
+            {
+                if( dirNegative[node._axis] )
+                {
+                    stack[stackSize++] = nodeIdx + 1;
+                    nodeIdx = node._offset;
+                }
+                else
+                {
+                    stack[stackSize++] = node._offset;
+                    nodeIdx = nodeIdx + 1;
+                }
+                continue;
+            }
+        }
+
+        if( stackSize == 0 )
+            break;
+        nodeIdx = stack[--stackSize];
+    }
+}
+
+#endif // BVH_H
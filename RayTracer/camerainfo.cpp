@@ -3,40 +3,110 @@
 #include "matrixutil.hpp"
 using namespace MatrixUtils;
 
-CameraInfo::CameraInfo()
+namespace
+{
+// rotations about x, then about y, that take the camera space onto the view
+// direction
+void viewAngles(const DblVector3D& dir, double& phi, double& theta)
+{
+    phi = acos( dotProduct( normalize( dir ), DblVector3D(0, -1, 0) ) );
+    phi -= PI / 2.0;
+    theta = atan2(dir.x(), dir.z());
+    theta -= PI;
+}
+}
+
+CameraInfo::CameraInfo():
+    _isSetup(false)
 {
 }
 
-Ray CameraInfo::generateRay(GeometryUtils::DblPoint2D &point)
+DblVector3D CameraInfo::worldUp() const
 {
     double phi, theta;
-    phi = acos( dotProduct( normalize( _dir ), DblVector3D(0, -1, 0) ) );
-    phi -= PI / 2.0;
-    theta = atan2(_dir.x(), _dir.z());
-    theta -= PI;
+    viewAngles(_dir, phi, theta);
 
     DblVector4D transformedUp = DblVector4D(_up, 1);
-    transformedUp = makeXRotationMatrix(phi) * transformedUp;
-    transformedUp = makeYRotationMatrix(theta) * transformedUp;
+    transformedUp = makeXRotationMatrix4(phi) * transformedUp;
+    transformedUp = makeYRotationMatrix4(theta) * transformedUp;
+    return transformedUp.xyz();
+}
+
+void CameraInfo::setWorldUp(const DblVector3D &up)
+{
+    double phi, theta;
+    viewAngles(_dir, phi, theta);
 
-//    cout << "is orthogonal: " << dotProduct( _dir, transformedUp ) << endl;
-//    DblVector4D transformedDir = DblVector4D(0, 0, -1, 1);
-//    transformedDir = makeXRotationMatrix(phi) * transformedDir;
-//    transformedDir = makeYRotationMatrix(theta) * transformedDir;
-//    cout << "is equal: " << length( normalize( transformedDir.xyz() ) - normalize(_dir) ) << endl;
+    DblVector4D transformedUp = DblVector4D(up, 1);
+    transformedUp = makeYRotationMatrix4(-theta) * transformedUp;
+    transformedUp = makeXRotationMatrix4(-phi) * transformedUp;
+    _up = transformedUp.xyz();
+}
+
+void CameraInfo::setup()
+{
+    DblVector3D up = worldUp();
+    DblVector3D horizontal = normalize( crossProduct(_dir, up) );
+    DblPoint3D canvasCenter = _pos + normalize( _dir ) * _focalLength;
+
+    _canvasCenter[0] = canvasCenter.x();
+    _canvasCenter[1] = canvasCenter.y();
+    _canvasCenter[2] = canvasCenter.z();
 
-    DblVector3D _horizontal = normalize( crossProduct(_dir, transformedUp.xyz()) );
+    _horizontal[0] = horizontal.x() * _canvasSize[0];
+    _horizontal[1] = horizontal.y() * _canvasSize[0];
+    _horizontal[2] = horizontal.z() * _canvasSize[0];
 
-    DblPoint3D _canvasCenter = _pos + normalize( _dir ) *  _focalLength;
+    _vertical[0] = up.x() * _canvasSize[1];
+    _vertical[1] = up.y() * _canvasSize[1];
+    _vertical[2] = up.z() * _canvasSize[1];
 
-    DblPoint3D origin = _canvasCenter
-            + _horizontal * (point.x() - 0.5) * _canvasSize[0]
-            + transformedUp.xyz() * (0.5 - point.y()) * _canvasSize[1];
+    _isSetup = true;
+}
+
+Ray CameraInfo::generateRay(const GeometryUtils::DblPoint2D &point) const
+{
+    assert( _isSetup );
 
-    DblVector3D _direction = normalize(origin - _pos);
+    double u = point.x() - 0.5;
+    double v = 0.5 - point.y();
 
-    Ray r(_direction, origin);
+    DblPoint3D origin(_canvasCenter[0] + _horizontal[0] * u + _vertical[0] * v,
+                      _canvasCenter[1] + _horizontal[1] * u + _vertical[1] * v,
+                      _canvasCenter[2] + _horizontal[2] * u + _vertical[2] * v);
+
+    DblVector3D direction(origin.x() - _pos.x(),
+                          origin.y() - _pos.y(),
+                          origin.z() - _pos.z());
+    double invLength = 1.0 / sqrt( direction.x() * direction.x()
+                                 + direction.y() * direction.y()
+                                 + direction.z() * direction.z() );
+    direction.x() *= invLength;
+    direction.y() *= invLength;
+    direction.z() *= invLength;
+
+    Ray r(RealVector3D(direction.x(), direction.y(), direction.z()),
+          RealPoint3D(origin.x(), origin.y(), origin.z()));
     r.refractionRate() = 1.0;
 
     return r;
 }
+
+void CameraInfo::generateRays(size_t x0, size_t y0, size_t w, size_t h,
+                              size_t imageWidth, size_t imageHeight,
+                              const DblVector2D& shift, Ray *rays) const
+{
+    for(size_t i=0;i<h;i++)
+    {
+        float y = (float)(y0 + i) / (float)imageHeight;
+        for(size_t j=0;j<w;j++)
+        {
+            float x = (float)(x0 + j) / (float)imageWidth;
+
+            DblPoint2D pos(x + shift.x() / imageWidth,
+                           y + shift.y() / imageHeight);
+            rays[i * w + j] = generateRay(pos);
+            rays[i * w + j].order() = 0;
+        }
+    }
+}
@@ -11,13 +11,37 @@ class CameraInfo
 public:
     CameraInfo();
 
-    Ray generateRay(DblPoint2D& pos);
+    // precomputes the camera basis and the canvas center, must be called
+    // whenever the camera parameters change, before rays are generated
+    void setup();
+
+    // _up is given in camera space, looking down -z with y up, and is turned
+    // with the view direction; these convert it from and to world space for
+    // the current _dir
+    DblVector3D worldUp() const;
+    void setWorldUp(const DblVector3D& up);
+
+    Ray generateRay(const DblPoint2D& pos) const;
+
+    // generates the rays of a block of pixels into a contiguous buffer,
+    // row by row, every pixel position is shifted by the given sub-pixel offset
+    void generateRays(size_t x0, size_t y0, size_t w, size_t h,
+                      size_t imageWidth, size_t imageHeight,
+                      const DblVector2D& shift, Ray* rays) const;
 
     DblPoint3D _pos;
     DblVector3D _dir;
     DblVector3D _up;
     double _focalLength;
     double _canvasSize[2];
+
+private:
+    bool _isSetup;
+
+    // canvas center and the canvas spanning vectors, scaled by the canvas size
+    double _canvasCenter[3];
+    double _horizontal[3];
+    double _vertical[3];
 };
 
 #endif // CAMERAINFO_H
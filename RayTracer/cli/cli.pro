@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# headless renderer and benchmark of the ray tracing core
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = raytracer-cli
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../raytracercore.pri)
+
+SOURCES += main.cpp
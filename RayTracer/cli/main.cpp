@@ -0,0 +1,645 @@
+#include <QDir>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QThread>
+
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#include "scene.h"
+#include "raytracer.h"
+#include "framebuffer.h"
+#include "distributedrenderer.h"
+
+/*
+ * Headless renderer, needs no display:
+ *
+ * raytracer-cli render scene.scn [-o result.png] [-w 640] [-h 480] [-s 8] [-t 0]
+ *                      [-l 0] [--order row] [--timing] [--heatmap cost.png]
+ *                      [--workers 0] [--node command ...] [--tile 64]
+ * renders a scene into an image file, and optionally the number of
+ * traversal steps and tests spent on every pixel as a heatmap; with
+ * --workers or --node the tiles are rendered by worker processes, local
+ * ones or the given commands followed by "worker", e.g.
+ * --node "ssh host /path/to/raytracer-cli", -t is then per worker
+ *
+ * raytracer-cli worker
+ * renders the tiles requested on the standard input, started by render
+ *
+ * raytracer-cli animate scene.scn [-o frame%04d.png] [-w 640] [-h 480] [-s 8]
+ *                       [-t 0] [-l 0] [--order row] [--frames first-last]
+ * renders the frames of an animated scene one after the other into the
+ * numbered images, the frame number replaces the %d of the name; the
+ * hierarchy is refitted between frames and the frame buffer reused
+ *
+ * raytracer-cli benchmark [scene.scn ...] [-d scenes] [-w 320] [-h 240]
+ *                         [-s 8] [-t 0] [-l 0] [--order row] [-r 3] [--timing]
+ *                         [--report report.json]
+ * renders every given scene, or every .scn file of the directory, several
+ * times and writes a JSON report with the median wall time of every phase
+ * and the ray counts
+ *
+ * -s is the number of samples per pixel, -t the number of threads, 0 for
+ * one per core, -l the number of lights sampled per shading point, 0 for
+ * all of them, --order the order of the pixels within a tile, row, morton
+ * or hilbert, -r the number of runs per scene; --timing also measures the
+ * time spent in tracing, lighting and the scene queries, summed over the
+ * threads, which slows the rendering down a little
+ */
+
+namespace
+{
+struct Options
+{
+    Options():
+        output("result.png"),
+        sceneDir("scenes"),
+        width(640),
+        height(480),
+        sampleNumber(8),
+        threadNumber(0),
+        lightSampleNumber(0),
+        pixelOrder(RowOrder),
+        repeatNumber(3),
+        timing(false),
+        workerNumber(0),
+        tileSize(64),
+        firstFrame(0),
+        lastFrame(-1)
+    {}
+
+    string mode;
+    vector<string> scenes;
+    string output;
+    string report;
+    string sceneDir;
+    string heatmap;
+    int width;
+    int height;
+    int sampleNumber;
+    int threadNumber;
+    int lightSampleNumber;
+    PixelOrder pixelOrder;
+    int repeatNumber;
+    bool timing;
+
+    // distributed rendering, program is this executable
+    string program;
+    int workerNumber;
+    vector<string> nodes;
+    int tileSize;
+
+    // frames to animate, those of the scene when lastFrame < firstFrame
+    int firstFrame;
+    int lastFrame;
+};
+
+// wall times in seconds and ray counts of one run
+struct RunResult
+{
+    RunResult():
+        loadTime(0),
+        renderTime(0),
+        writeTime(0)
+    {}
+
+    double loadTime;
+    double renderTime;
+    double writeTime;
+    RayStatistics statistics;
+};
+
+void printUsage()
+{
+    cerr << "usage: raytracer-cli render scene.scn [-o image] [-w width] [-h height]"
+            " [-s samples] [-t threads] [-l lights] [--order curve] [--timing] [--heatmap image]"
+            " [--workers n] [--node command] [--tile size]" << endl
+         << "       raytracer-cli worker" << endl
+         << "       raytracer-cli animate scene.scn [-o pattern] [-w width] [-h height]"
+            " [-s samples] [-t threads] [-l lights] [--order curve] [--frames first-last]" << endl
+         << "       raytracer-cli benchmark [scene.scn ...] [-d directory] [-w width] [-h height]"
+            " [-s samples] [-t threads] [-l lights] [--order curve] [-r runs] [--timing] [--report file]" << endl;
+}
+
+bool parseOptions(int argc, char *argv[], Options& opt)
+{
+    if( argc < 2 )
+        return false;
+
+    opt.program = argv[0];
+    opt.mode = argv[1];
+    if( opt.mode == "benchmark" )
+    {
+        // smaller frames by default, the suite runs every scene several times
+        opt.width = 320;
+        opt.height = 240;
+        opt.output.clear();
+    }
+    else if( opt.mode == "animate" )
+        opt.output = "frame%04d.png";
+    else if( opt.mode != "render" )
+        return false;
+
+    for(int i=2;i<argc;i++)
+    {
+        string arg = argv[i];
+        if( arg.empty() )
+            continue;
+
+        if( arg[0] != '-' )
+        {
+            opt.scenes.push_back(arg);
+            continue;
+        }
+
+        if( arg == "--timing" )
+        {
+            opt.timing = true;
+            continue;
+        }
+
+        if( i + 1 >= argc )
+            return false;
+        string val = argv[++i];
+
+        if( arg == "-o" )
+            opt.output = val;
+        else if( arg == "--report" )
+            opt.report = val;
+        else if( arg == "--heatmap" )
+            opt.heatmap = val;
+        else if( arg == "-d" )
+            opt.sceneDir = val;
+        else if( arg == "-w" )
+            opt.width = atoi(val.c_str());
+        else if( arg == "-h" )
+            opt.height = atoi(val.c_str());
+        else if( arg == "-s" )
+            opt.sampleNumber = atoi(val.c_str());
+        else if( arg == "-t" )
+            opt.threadNumber = atoi(val.c_str());
+        else if( arg == "-l" )
+            opt.lightSampleNumber = atoi(val.c_str());
+        else if( arg == "--order" )
+        {
+            if( val == "row" )
+                opt.pixelOrder = RowOrder;
+            else if( val == "morton" )
+                opt.pixelOrder = MortonOrder;
+            else if( val == "hilbert" )
+                opt.pixelOrder = HilbertOrder;
+            else
+                return false;
+        }
+        else if( arg == "-r" )
+            opt.repeatNumber = atoi(val.c_str());
+        else if( arg == "--workers" && opt.mode == "render" )
+            opt.workerNumber = atoi(val.c_str());
+        else if( arg == "--node" && opt.mode == "render" )
+            opt.nodes.push_back(val);
+        else if( arg == "--tile" )
+            opt.tileSize = atoi(val.c_str());
+        else if( arg == "--frames" && opt.mode == "animate" )
+        {
+            char dash = 0;
+            istringstream s(val);
+            if( !(s >> opt.firstFrame >> dash >> opt.lastFrame) || dash != '-'
+             || opt.lastFrame < opt.firstFrame )
+                return false;
+        }
+        else
+            return false;
+    }
+
+    if( opt.width <= 0 || opt.height <= 0 || opt.sampleNumber <= 0 || opt.repeatNumber <= 0
+     || opt.lightSampleNumber < 0 )
+        return false;
+
+    if( opt.mode == "render" )
+    {
+        // the workers only send back the pixels, and light all of them
+        bool distributed = opt.workerNumber > 0 || !opt.nodes.empty();
+        if( distributed && (opt.timing || !opt.heatmap.empty() || opt.lightSampleNumber > 0) )
+            return false;
+
+        return opt.scenes.size() == 1 && !opt.output.empty() && opt.tileSize > 0;
+    }
+
+    if( opt.mode == "animate" )
+        return opt.scenes.size() == 1 && opt.output.find('%') != string::npos;
+
+    if( opt.scenes.empty() )
+    {
+        QDir dir(QString::fromStdString(opt.sceneDir));
+        QStringList files = dir.entryList(QStringList("*.scn"), QDir::Files, QDir::Name);
+        for(int i=0;i<files.size();i++)
+            opt.scenes.push_back(dir.filePath(files[i]).toStdString());
+    }
+
+    return !opt.scenes.empty();
+}
+
+double seconds(const QElapsedTimer& timer)
+{
+    return timer.nsecsElapsed() * 1e-9;
+}
+
+const char* pixelOrderName(PixelOrder order)
+{
+    switch( order )
+    {
+    case MortonOrder:
+        return "morton";
+    case HilbertOrder:
+        return "hilbert";
+    default:
+        return "row";
+    }
+}
+
+void setupTracer(RayTracer& tracer, const Options& opt)
+{
+    tracer.setPixelOrder(opt.pixelOrder);
+
+    if( opt.lightSampleNumber > 0 )
+    {
+        tracer.setLightSelection(RayTracer::SampledLights);
+        tracer.setLightSampleNumber(opt.lightSampleNumber);
+    }
+}
+
+RunResult renderScene_Distributed(const string& sceneFile, const Options& opt, const string& output)
+{
+    RunResult result;
+    QElapsedTimer timer;
+
+    DistributedRenderer renderer;
+    renderer.setSceneFile(sceneFile);
+    renderer.setSize(opt.width, opt.height);
+    renderer.setSampleNumber(opt.sampleNumber);
+    renderer.setThreadNumber(opt.threadNumber);
+    renderer.setTileSize(opt.tileSize);
+
+    for(int i=0;i<opt.workerNumber;i++)
+        renderer.addWorker(QString::fromStdString(opt.program), QStringList("worker"));
+
+    for(size_t i=0;i<opt.nodes.size();i++)
+    {
+        istringstream s(opt.nodes[i]);
+        string program, arg;
+        QStringList arguments;
+        s >> program;
+        while( s >> arg )
+            arguments.push_back(QString::fromStdString(arg));
+        arguments.push_back("worker");
+
+        if( !program.empty() )
+            renderer.addWorker(QString::fromStdString(program), arguments);
+    }
+
+    // the workers load the scene themselves, it is part of the render time
+    timer.start();
+    renderer.execute();
+    result.renderTime = seconds(timer);
+    result.statistics = renderer.statistics();
+
+    if( renderer.workerFailures() || renderer.copiedTiles() )
+        cerr << renderer.workerFailures() << " worker failures, "
+             << renderer.copiedTiles() << " tiles copied from slow workers" << endl;
+
+    if( !output.empty() )
+    {
+        timer.start();
+        if( !renderer.result().saveImage(output) )
+            throw "failed to write the image.";
+        result.writeTime = seconds(timer);
+    }
+
+    return result;
+}
+
+RunResult renderScene(const string& sceneFile, const Options& opt, const string& output)
+{
+    if( opt.workerNumber > 0 || !opt.nodes.empty() )
+        return renderScene_Distributed(sceneFile, opt, output);
+
+    RunResult result;
+    QElapsedTimer timer;
+
+    // scene file, or its cache, and the acceleration structures
+    timer.start();
+    Scene scene(sceneFile);
+    result.loadTime = seconds(timer);
+
+    RayTracer tracer;
+    tracer.bindScene(&scene);
+    tracer.setSize(opt.width, opt.height);
+    tracer.setSampleNumber(opt.sampleNumber);
+    tracer.setThreadNumber(opt.threadNumber);
+    tracer.setOutputFile("");
+    tracer.setTiming(opt.timing);
+    tracer.setCostRecording(!opt.heatmap.empty());
+    setupTracer(tracer, opt);
+
+    timer.start();
+    tracer.execute();
+    result.renderTime = seconds(timer);
+    result.statistics = tracer.statistics();
+
+    if( !output.empty() )
+    {
+        timer.start();
+        if( !tracer.result().saveImage(output) )
+            throw "failed to write the image.";
+        result.writeTime = seconds(timer);
+    }
+
+    if( !opt.heatmap.empty() && !tracer.costHeatmap().saveImage(opt.heatmap) )
+        throw "failed to write the heatmap.";
+
+    return result;
+}
+
+// replaces the %d of the pattern, with an optional zero padded width such
+// as %04d, by the frame number; false when there is no single such field
+bool frameFileName(const string& pattern, int frame, string& filename)
+{
+    size_t pos = pattern.find('%');
+    if( pos == string::npos || pattern.find('%', pos + 1) != string::npos )
+        return false;
+
+    size_t end = pos + 1;
+    while( end < pattern.size() && isdigit((unsigned char)pattern[end]) )
+        end++;
+    if( end >= pattern.size() || pattern[end] != 'd' )
+        return false;
+
+    int width = atoi(pattern.substr(pos + 1, end - pos - 1).c_str());
+
+    ostringstream s;
+    s << pattern.substr(0, pos) << setfill('0') << setw(width) << frame << pattern.substr(end + 1);
+    filename = s.str();
+    return true;
+}
+
+double median(vector<double> values)
+{
+    sort(values.begin(), values.end());
+    size_t n = values.size();
+    return (n % 2) ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+string jsonString(const string& str)
+{
+    string s = "\"";
+    for(size_t i=0;i<str.size();i++)
+    {
+        char c = str[i];
+        if( c == '"' || c == '\\' )
+            s += '\\';
+        if( (unsigned char)c < 0x20 )
+            continue;
+        s += c;
+    }
+    return s + "\"";
+}
+
+int render(const Options& opt)
+{
+    try{
+        RunResult r = renderScene(opt.scenes[0], opt, opt.output);
+
+        cout << fixed << setprecision(3)
+             << opt.scenes[0] << " -> " << opt.output << endl
+             << "load " << r.loadTime << " s, render " << r.renderTime
+             << " s, write " << r.writeTime << " s" << endl
+             << "primary rays " << r.statistics.primaryRays
+             << ", secondary rays " << r.statistics.secondaryRays
+             << ", shadow rays " << r.statistics.shadowRays << endl
+             << "intersection tests " << r.statistics.intersectionTests
+             << ", shadow tests " << r.statistics.shadowTests
+             << ", node visits " << r.statistics.nodeVisits
+             << ", max depth " << r.statistics.maxDepth << endl;
+
+        if( opt.timing )
+        {
+            // summed over the threads, the phases are nested
+            const RayStatistics& s = r.statistics;
+            cout << "tiles " << s.tileNumber << " " << s.tileTime * 1e-9
+                 << " s, trace " << s.traceTime * 1e-9
+                 << " s, lighting " << s.lightingTime * 1e-9
+                 << " s, intersect " << s.intersectTime * 1e-9
+                 << " s, block test " << s.blockTestTime * 1e-9 << " s" << endl;
+        }
+
+        cout << setprecision(0)
+             << r.statistics.totalRays() / r.renderTime << " rays/s" << endl;
+    }
+    catch(const char* errstr)
+    {
+        cerr << opt.scenes[0] << ": " << errstr << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+int animate(const Options& opt)
+{
+    try{
+        QElapsedTimer timer;
+        timer.start();
+        Scene scene(opt.scenes[0]);
+        double loadTime = seconds(timer);
+
+        if( !scene.isAnimated() )
+            throw "the scene has no animation section.";
+
+        int first = opt.firstFrame, last = opt.lastFrame;
+        if( last < first )
+        {
+            first = scene.firstFrame();
+            last = scene.lastFrame();
+        }
+
+        string filename;
+        if( !frameFileName(opt.output, first, filename) )
+            throw "the output name needs a single %d field for the frame number.";
+
+        RayTracer tracer;
+        tracer.bindScene(&scene);
+        tracer.setSize(opt.width, opt.height);
+        tracer.setSampleNumber(opt.sampleNumber);
+        tracer.setThreadNumber(opt.threadNumber);
+        tracer.setOutputFile("");
+        setupTracer(tracer, opt);
+        // every frame is written before the next is rendered
+        tracer.setBufferReuse(true);
+
+        double updateTime = 0, renderTime = 0, writeTime = 0;
+        RayStatistics stats;
+
+        cout << fixed << setprecision(3);
+        for(int frame=first;frame<=last;frame++)
+        {
+            timer.start();
+            scene.setFrame(frame);
+            double update = seconds(timer);
+
+            timer.start();
+            tracer.execute();
+            double render = seconds(timer);
+
+            frameFileName(opt.output, frame, filename);
+            timer.start();
+            if( !tracer.result().saveImage(filename) )
+                throw "failed to write the image.";
+            double write = seconds(timer);
+
+            updateTime += update;
+            renderTime += render;
+            writeTime += write;
+            stats += tracer.statistics();
+
+            cout << "frame " << frame << " -> " << filename << ", update " << update * 1e3
+                 << " ms, render " << render << " s, write " << write << " s" << endl;
+        }
+
+        int frameNumber = last - first + 1;
+        cout << opt.scenes[0] << ": " << frameNumber << " frames" << endl
+             << "load " << loadTime << " s, update " << updateTime << " s, render "
+             << renderTime << " s, write " << writeTime << " s" << endl
+             << setprecision(2) << frameNumber / (updateTime + renderTime + writeTime)
+             << " frames/s, " << setprecision(0) << stats.totalRays() / renderTime << " rays/s" << endl;
+    }
+    catch(const char* errstr)
+    {
+        cerr << opt.scenes[0] << ": " << errstr << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+int benchmark(const Options& opt)
+{
+    int threadNumber = opt.threadNumber > 0 ? opt.threadNumber : QThread::idealThreadCount();
+    bool failed = false;
+
+    ostringstream s;
+    s << setprecision(6) << fixed;
+    s << "{" << endl
+      << "  \"precision\": " << (sizeof(Real) == sizeof(float) ? "\"single\"" : "\"double\"") << "," << endl
+      << "  \"width\": " << opt.width << "," << endl
+      << "  \"height\": " << opt.height << "," << endl
+      << "  \"samples\": " << opt.sampleNumber << "," << endl
+      << "  \"threads\": " << threadNumber << "," << endl
+      << "  \"light_samples\": " << opt.lightSampleNumber << "," << endl
+      << "  \"pixel_order\": \"" << pixelOrderName(opt.pixelOrder) << "\"," << endl
+      << "  \"runs\": " << opt.repeatNumber << "," << endl
+      << "  \"timing\": " << (opt.timing ? "true" : "false") << "," << endl
+      << "  \"scenes\": [";
+
+    for(size_t i=0;i<opt.scenes.size();i++)
+    {
+        const string& sceneFile = opt.scenes[i];
+        s << (i ? "," : "") << endl
+          << "    {" << endl
+          << "      \"scene\": " << jsonString(sceneFile) << "," << endl;
+
+        vector<double> loadTimes, renderTimes;
+        RayStatistics stats;
+        try{
+            for(int k=0;k<opt.repeatNumber;k++)
+            {
+                RunResult r = renderScene(sceneFile, opt, "");
+                loadTimes.push_back(r.loadTime);
+                renderTimes.push_back(r.renderTime);
+                stats = r.statistics;
+            }
+        }
+        catch(const char* errstr)
+        {
+            cerr << sceneFile << ": " << errstr << endl;
+            s << "      \"error\": " << jsonString(errstr) << endl
+              << "    }";
+            failed = true;
+            continue;
+        }
+
+        double renderTime = median(renderTimes);
+        s << "      \"load_seconds\": " << median(loadTimes) << "," << endl
+          << "      \"render_seconds\": " << renderTime << "," << endl
+          << "      \"render_seconds_min\": " << *min_element(renderTimes.begin(), renderTimes.end()) << "," << endl
+          << "      \"primary_rays\": " << stats.primaryRays << "," << endl
+          << "      \"secondary_rays\": " << stats.secondaryRays << "," << endl
+          << "      \"shadow_rays\": " << stats.shadowRays << "," << endl
+          << "      \"total_rays\": " << stats.totalRays() << "," << endl
+          << "      \"intersection_tests\": " << stats.intersectionTests << "," << endl
+          << "      \"shadow_tests\": " << stats.shadowTests << "," << endl
+          << "      \"node_visits\": " << stats.nodeVisits << "," << endl
+          << "      \"max_depth\": " << stats.maxDepth << "," << endl
+          << "      \"tiles\": " << stats.tileNumber << "," << endl;
+
+        if( opt.timing )
+        {
+            // thread seconds of the last run, the phases are nested
+            s << "      \"tile_seconds\": " << stats.tileTime * 1e-9 << "," << endl
+              << "      \"trace_seconds\": " << stats.traceTime * 1e-9 << "," << endl
+              << "      \"lighting_seconds\": " << stats.lightingTime * 1e-9 << "," << endl
+              << "      \"intersect_seconds\": " << stats.intersectTime * 1e-9 << "," << endl
+              << "      \"block_test_seconds\": " << stats.blockTestTime * 1e-9 << "," << endl;
+        }
+
+        s << "      \"rays_per_second\": " << stats.totalRays() / renderTime << endl
+          << "    }";
+
+        cerr << sceneFile << ": " << renderTime << " s" << endl;
+    }
+
+    s << endl << "  ]" << endl << "}" << endl;
+
+    if( opt.report.empty() )
+        cout << s.str();
+    else
+    {
+        ofstream f(opt.report.c_str());
+        f << s.str();
+        if( !f.good() )
+        {
+            cerr << "failed to write " << opt.report << endl;
+            return 1;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    if( argc == 2 && strcmp(argv[1], "worker") == 0 )
+        return DistributedRenderer::serve(cin, cout);
+
+    Options opt;
+    if( !parseOptions(argc, argv, opt) )
+    {
+        printUsage();
+        return 2;
+    }
+
+    if( opt.mode == "render" )
+        return render(opt);
+    else if( opt.mode == "animate" )
+        return animate(opt);
+    else
+        return benchmark(opt);
+}
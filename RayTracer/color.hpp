@@ -115,7 +115,7 @@ public:
     template <typename CT>
     friend ostream& operator << (ostream&, Color4<CT>&);
 
-    Color4 clamp(double lower, double upper)
+    Color4 clamp(T lower, T upper)
     {
         Color4 c;
         c.r() = Utils::clamp(lower, upper, r());
@@ -0,0 +1,446 @@
+#include "distributedrenderer.h"
+#include "scene.h"
+
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+// how long the coordinator waits for a worker before looking at the next
+const int POLL_INTERVAL = 5;
+const int STOP_TIMEOUT = 1000;
+// a hung worker must not hold the frame forever
+const qint64 TILE_TIMEOUT = 10 * 60 * 1000;
+}
+
+DistributedRenderer::DistributedRenderer():
+    _width(640),
+    _height(480),
+    _tileSize(64),
+    _sampleNumber(8),
+    _threadNumber(0),
+    _stragglerFactor(3.0),
+    _maxRestarts(2),
+    _tileTimeout(TILE_TIMEOUT),
+    _remaining(0),
+    _tileTime(0),
+    _timedTiles(0),
+    _copiedTiles(0),
+    _workerFailures(0)
+{
+}
+
+DistributedRenderer::~DistributedRenderer()
+{
+    for(size_t i=0;i<_workers.size();i++)
+    {
+        stop(*_workers[i]);
+        delete _workers[i];
+    }
+}
+
+void DistributedRenderer::addWorker(const QString &program, const QStringList &arguments)
+{
+    Worker* w = new Worker;
+    w->program = program;
+    w->arguments = arguments;
+    w->process = 0;
+    w->state = Worker::Stopped;
+    w->tile = -1;
+    w->restarts = 0;
+    _workers.push_back(w);
+}
+
+void DistributedRenderer::execute()
+{
+    if( _workers.empty() )
+        throw "no render workers.";
+    if( _width <= 0 || _height <= 0 )
+        throw "invalid frame size.";
+
+    _result = FrameBuffer(_width, _height);
+    _statistics = RayStatistics();
+    _copiedTiles = 0;
+    _workerFailures = 0;
+    _tileTime = 0;
+    _timedTiles = 0;
+
+    // the tiles in scan order
+    TileScheduler scheduler;
+    scheduler.setup(_width, _height, _tileSize, 1);
+
+    _tiles.clear();
+    _pending.clear();
+    Tile t;
+    while( scheduler.nextTile(0, t) )
+    {
+        _pending.push_back(_tiles.size());
+        _tiles.push_back(t);
+    }
+
+    _running.assign(_tiles.size(), 0);
+    _finished.assign(_tiles.size(), false);
+    _remaining = _tiles.size();
+
+    for(size_t i=0;i<_workers.size();i++)
+    {
+        _workers[i]->restarts = 0;
+        start(*_workers[i]);
+    }
+
+    while( _remaining > 0 )
+    {
+        bool alive = false;
+        for(size_t i=0;i<_workers.size();i++)
+        {
+            Worker& w = *_workers[i];
+            if( w.state == Worker::Stopped )
+                continue;
+
+            poll(w, POLL_INTERVAL);
+
+            if( w.state == Worker::Idle )
+                assign(w);
+            else if( (w.state == Worker::Busy || w.state == Worker::Starting)
+                  && _tileTimeout > 0 && w.timer.elapsed() > _tileTimeout )
+                fail(w, w.state == Worker::Busy ? "tile timed out" : "scene loading timed out");
+
+            alive |= (w.state != Worker::Stopped);
+        }
+
+        if( !alive )
+            throw "all render workers failed.";
+    }
+
+    // the workers still busy render copies of finished tiles
+    for(size_t i=0;i<_workers.size();i++)
+        stop(*_workers[i]);
+}
+
+void DistributedRenderer::start(Worker &w)
+{
+    w.process = new QProcess;
+    w.process->start(w.program, w.arguments);
+    w.buffer.clear();
+    w.tile = -1;
+    w.state = Worker::Starting;
+    w.timer.start();
+
+    if( !w.process->waitForStarted() )
+    {
+        fail(w, "cannot start the worker");
+        return;
+    }
+
+    ostringstream s;
+    s << "FRAME " << _width << " " << _height << " " << _sampleNumber
+      << " " << _threadNumber << " " << _sceneFile << "\n";
+    send(w, s.str());
+}
+
+void DistributedRenderer::stop(Worker &w)
+{
+    if( w.process )
+    {
+        if( w.state == Worker::Busy )
+            w.process->kill();
+        else
+        {
+            w.process->write(QByteArray("QUIT\n"));
+            w.process->waitForBytesWritten(STOP_TIMEOUT);
+            w.process->closeWriteChannel();
+        }
+
+        if( !w.process->waitForFinished(STOP_TIMEOUT) )
+        {
+            w.process->kill();
+            w.process->waitForFinished(STOP_TIMEOUT);
+        }
+
+        delete w.process;
+        w.process = 0;
+    }
+
+    w.state = Worker::Stopped;
+    w.tile = -1;
+}
+
+void DistributedRenderer::fail(Worker &w, const string &reason)
+{
+    cerr << "render worker " << w.program.toStdString() << ": " << reason << endl;
+    _workerFailures++;
+
+    // the tile goes back to the front of the queue, unless a copy of it
+    // is still running elsewhere
+    int tile = w.tile;
+    if( tile >= 0 )
+    {
+        _running[tile]--;
+        if( !_finished[tile] && _running[tile] == 0 )
+            _pending.push_front(tile);
+        w.tile = -1;
+    }
+
+    if( w.process )
+    {
+        w.process->kill();
+        w.process->waitForFinished(STOP_TIMEOUT);
+        delete w.process;
+        w.process = 0;
+    }
+    w.state = Worker::Stopped;
+
+    if( w.restarts < _maxRestarts )
+    {
+        w.restarts++;
+        start(w);
+    }
+}
+
+bool DistributedRenderer::send(Worker &w, const string &message)
+{
+    QByteArray data(message.c_str(), message.size());
+    if( w.process->write(data) != (qint64)data.size() || !w.process->waitForBytesWritten() )
+    {
+        fail(w, "cannot write to the worker");
+        return false;
+    }
+    return true;
+}
+
+void DistributedRenderer::poll(Worker &w, int timeout)
+{
+    if( w.state == Worker::Busy || w.state == Worker::Starting )
+        w.process->waitForReadyRead(timeout);
+
+    w.buffer.append(w.process->readAllStandardOutput());
+
+    // what the worker prints besides the protocol is passed on
+    QByteArray err = w.process->readAllStandardError();
+    if( !err.isEmpty() )
+        cerr << err.constData();
+
+    while( w.state != Worker::Stopped && handleMessage(w) )
+        ;
+
+    if( w.state != Worker::Stopped && w.process->state() == QProcess::NotRunning )
+        fail(w, "worker exited");
+}
+
+bool DistributedRenderer::handleMessage(Worker &w)
+{
+    int end = w.buffer.indexOf('\n');
+    if( end < 0 )
+        return false;
+
+    string line(w.buffer.constData(), end);
+    istringstream s(line);
+    string cmd;
+    s >> cmd;
+
+    if( cmd == "READY" )
+    {
+        // the pixels are sent as they are in memory
+        size_t floatSize = 0;
+        int byteOrder = 0;
+        s >> floatSize >> byteOrder;
+        w.buffer.remove(0, end + 1);
+
+        if( floatSize != sizeof(float) || byteOrder != Q_BYTE_ORDER )
+        {
+            w.restarts = _maxRestarts;
+            fail(w, "worker with another float layout");
+            return false;
+        }
+
+        if( w.state == Worker::Starting )
+            w.state = Worker::Idle;
+        return true;
+    }
+    else if( cmd == "DONE" )
+    {
+        int id = -1;
+        RayStatistics stats;
+        size_t bytes = 0;
+        s >> id >> stats.primaryRays >> stats.secondaryRays >> stats.shadowRays >> bytes;
+
+        if( !s || id != w.tile )
+        {
+            fail(w, "unexpected tile result");
+            return false;
+        }
+
+        const Tile& t = _tiles[id];
+        if( bytes != t.width * t.height * 4 * sizeof(float) )
+        {
+            fail(w, "tile result of the wrong size");
+            return false;
+        }
+
+        // wait for the whole tile
+        if( (size_t)w.buffer.size() < end + 1 + bytes )
+            return false;
+
+        if( !_finished[id] )
+        {
+            const char* data = w.buffer.constData() + end + 1;
+            size_t rowBytes = t.width * 4 * sizeof(float);
+            for(size_t i=0;i<t.height;i++)
+                memcpy(_result.pixel(t.x, t.y + i), data + i * rowBytes, rowBytes);
+
+            _finished[id] = true;
+            _remaining--;
+            _statistics += stats;
+
+            _tileTime += w.timer.elapsed();
+            _timedTiles++;
+        }
+
+        _running[id]--;
+        w.buffer.remove(0, end + 1 + bytes);
+        w.tile = -1;
+        w.state = Worker::Idle;
+        return true;
+    }
+    else if( cmd == "ERROR" )
+    {
+        fail(w, line.size() > 6 ? line.substr(6) : "worker error");
+        return false;
+    }
+
+    fail(w, "unknown message " + line);
+    return false;
+}
+
+void DistributedRenderer::assign(Worker &w)
+{
+    int tile = -1;
+    if( !_pending.empty() )
+    {
+        tile = _pending.front();
+        _pending.pop_front();
+    }
+    else
+    {
+        tile = straggler();
+        if( tile < 0 )
+            return;
+        _copiedTiles++;
+    }
+
+    const Tile& t = _tiles[tile];
+    ostringstream s;
+    s << "TILE " << tile << " " << t.x << " " << t.y << " " << t.width << " " << t.height << "\n";
+
+    w.tile = tile;
+    w.state = Worker::Busy;
+    w.timer.start();
+    _running[tile]++;
+
+    send(w, s.str());
+}
+
+int DistributedRenderer::straggler() const
+{
+    if( _timedTiles == 0 )
+        return -1;
+
+    double limit = _stragglerFactor * _tileTime / _timedTiles;
+
+    // the tile running the longest, which has no copy yet
+    int tile = -1;
+    qint64 longest = 0;
+    for(size_t i=0;i<_workers.size();i++)
+    {
+        const Worker& w = *_workers[i];
+        if( w.state != Worker::Busy || _finished[w.tile] || _running[w.tile] > 1 )
+            continue;
+
+        qint64 elapsed = w.timer.elapsed();
+        if( elapsed > limit && elapsed > longest )
+        {
+            longest = elapsed;
+            tile = w.tile;
+        }
+    }
+
+    return tile;
+}
+
+int DistributedRenderer::serve(istream &in, ostream &out)
+{
+    Scene* scene = 0;
+    RayTracer tracer;
+    tracer.setOutputFile("");
+
+    int code = 0;
+    while( in.good() )
+    {
+        string line;
+        getline(in, line);
+        if( line.empty() )
+            continue;
+
+        istringstream s(line);
+        string cmd;
+        s >> cmd;
+
+        try{
+            if( cmd == "FRAME" )
+            {
+                int width = 0, height = 0, samples = 0, threads = 0;
+                string sceneFile;
+                s >> width >> height >> samples >> threads;
+                getline(s >> ws, sceneFile);
+                if( sceneFile.empty() || width <= 0 || height <= 0 )
+                    throw "malformed frame request.";
+
+                delete scene;
+                scene = 0;
+                scene = new Scene(sceneFile);
+
+                tracer.bindScene(scene);
+                tracer.setSize(width, height);
+                tracer.setSampleNumber(samples);
+                tracer.setThreadNumber(threads);
+
+                out << "READY " << sizeof(float) << " " << Q_BYTE_ORDER << endl;
+            }
+            else if( cmd == "TILE" )
+            {
+                int id = -1;
+                Tile t;
+                s >> id >> t.x >> t.y >> t.width >> t.height;
+                if( !s || !scene )
+                    throw "malformed tile request.";
+
+                FrameBuffer image(t.width, t.height);
+                tracer.renderRegion(t, image);
+
+                const RayStatistics& stats = tracer.statistics();
+                size_t bytes = t.width * t.height * 4 * sizeof(float);
+                out << "DONE " << id << " " << stats.primaryRays << " " << stats.secondaryRays
+                    << " " << stats.shadowRays << " " << bytes << "\n";
+                out.write((const char*)image.rawData(), bytes);
+                out.flush();
+            }
+            else if( cmd == "QUIT" )
+                break;
+            else
+                throw "unknown request.";
+        }
+        catch(const char* errstr)
+        {
+            out << "ERROR " << errstr << endl;
+            code = 1;
+        }
+        catch(const string& errstr)
+        {
+            out << "ERROR " << errstr << endl;
+            code = 1;
+        }
+    }
+
+    delete scene;
+    return code;
+}
@@ -0,0 +1,146 @@
+#ifndef DISTRIBUTEDRENDERER_H
+#define DISTRIBUTEDRENDERER_H
+
+#include <QProcess>
+#include <QByteArray>
+#include <QStringList>
+#include <QElapsedTimer>
+
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "raytracer.h"
+
+/*
+ * Renders a frame with worker processes: the frame is split into tiles,
+ * every worker loads the scene and renders the tiles it is sent, and the
+ * coordinator puts the returned pixels together.
+ *
+ * The workers are started as commands and talk over their standard input
+ * and output, a command running the worker on another host, e.g. through
+ * ssh, spreads the frame over several machines; the scene file must then
+ * be found under the same path there.
+ *
+ * protocol, one line per message:
+ * coordinator  FRAME <width> <height> <samples> <threads> <scene file>
+ * worker       READY <float size> <byte order>, once the scene is loaded
+ * coordinator  TILE <id> <x> <y> <width> <height>
+ * worker       DONE <id> <primary> <secondary> <shadow rays> <bytes>
+ *              followed by the floats of the tile, row by row
+ * worker       ERROR <message>
+ * coordinator  QUIT, or closes the input
+ *
+ * A worker that exits, reports an error, sends a malformed message or
+ * misses the deadline of its tile is restarted a few times and its tile is
+ * queued again. Once the queue is
+ * empty, an idle worker also takes the tile that has been running the
+ * longest, if it runs much longer than the tiles so far; the first copy
+ * finished is kept.
+ */
+class DistributedRenderer
+{
+public:
+    DistributedRenderer();
+    ~DistributedRenderer();
+
+    // a worker started as program with its arguments, the program must
+    // serve the protocol on its standard input and output
+    void addWorker(const QString& program, const QStringList& arguments = QStringList());
+    size_t workerNumber() const { return _workers.size(); }
+
+    void setSceneFile(const string& filename) { _sceneFile = filename; }
+    void setSize(int w, int h) { _width = w; _height = h; }
+    void setTileSize(int s) { _tileSize = s; }
+    void setSampleNumber(int n) { _sampleNumber = n; }
+    // render threads of every worker, 0 for one per core
+    void setThreadNumber(int n) { _threadNumber = n; }
+
+    // a tile is copied to an idle worker once it runs factor times longer
+    // than the average tile
+    void setStragglerFactor(double f) { _stragglerFactor = f; }
+    void setMaxRestarts(int n) { _maxRestarts = n; }
+    // a worker not done with its tile, or not ready with the scene, after
+    // the given milliseconds is killed, 0 waits forever
+    void setTileTimeout(qint64 ms) { _tileTimeout = ms; }
+
+    // renders the frame, throws when no worker is left to finish it
+    void execute();
+
+    const FrameBuffer& result() const { return _result; }
+    // ray counts of the tiles kept
+    const RayStatistics& statistics() const { return _statistics; }
+    size_t copiedTiles() const { return _copiedTiles; }
+    size_t workerFailures() const { return _workerFailures; }
+
+    // worker side, serves the requests read from in until QUIT or the end
+    // of the input; returns the exit code of the worker
+    static int serve(istream& in, ostream& out);
+
+private:
+    struct Worker
+    {
+        enum State
+        {
+            Starting,
+            Idle,
+            Busy,
+            Stopped
+        };
+
+        QString program;
+        QStringList arguments;
+        QProcess* process;
+        QByteArray buffer;
+        State state;
+        int tile;
+        // since the worker was started or sent its tile
+        QElapsedTimer timer;
+        int restarts;
+    };
+
+    void start(Worker& w);
+    void stop(Worker& w);
+    void fail(Worker& w, const string& reason);
+    bool send(Worker& w, const string& message);
+
+    // reads what the worker sent and handles its complete messages
+    void poll(Worker& w, int timeout);
+    bool handleMessage(Worker& w);
+    void assign(Worker& w);
+    int straggler() const;
+
+private:
+    vector<Worker*> _workers;
+
+    string _sceneFile;
+    int _width;
+    int _height;
+    int _tileSize;
+    int _sampleNumber;
+    int _threadNumber;
+    double _stragglerFactor;
+    int _maxRestarts;
+    qint64 _tileTimeout;
+
+    // tiles of the frame, the tiles waiting for a worker, how many workers
+    // render each tile and whether it is done
+    vector<Tile> _tiles;
+    deque<int> _pending;
+    vector<int> _running;
+    vector<bool> _finished;
+    size_t _remaining;
+
+    // render time of the finished tiles, in milliseconds
+    qint64 _tileTime;
+    size_t _timedTiles;
+
+    FrameBuffer _result;
+    RayStatistics _statistics;
+    size_t _copiedTiles;
+    size_t _workerFailures;
+};
+
+#endif // DISTRIBUTEDRENDERER_H
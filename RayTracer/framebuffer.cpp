@@ -0,0 +1,103 @@
+#include "framebuffer.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+// one ARGB32 pixel, 0xAARRGGBB, the alpha is not scaled by the exposure
+inline QRgb quantizePixel(const float* p, float scale)
+{
+    int c[4];
+    for(int k=0;k<4;k++)
+    {
+        float v = p[k] * (k < 3 ? scale : 255.0f);
+        c[k] = (v > 0) ? ((v < 255.0f) ? (int)v : 255) : 0;
+    }
+    return qRgba(c[0], c[1], c[2], c[3]);
+}
+}
+
+FrameBuffer::FrameBuffer():
+    _width(0),
+    _height(0),
+    _exposure(1.0f)
+{
+}
+
+FrameBuffer::FrameBuffer(size_t w, size_t h):
+    _width(w),
+    _height(h),
+    _exposure(1.0f),
+    _data(w * h * 4, 0.0f)
+{
+    // opaque black until rendered
+    for(size_t i=3;i<_data.size();i+=4)
+        _data[i] = 1.0f;
+}
+
+void FrameBuffer::tonemap(uchar *dst, size_t bytesPerLine, size_t y0, size_t y1) const
+{
+    const float scale = _exposure * 255.0f;
+
+    for(size_t y=y0;y<y1;y++)
+    {
+        const float* src = pixel(0, y);
+        QRgb* out = (QRgb*)(dst + y * bytesPerLine);
+        size_t x = 0;
+
+#if defined(__SSE2__) && (Q_BYTE_ORDER == Q_LITTLE_ENDIAN)
+        // four pixels per step: scale, clamp, swap red and blue into the
+        // memory order of ARGB32, truncate, and saturate down to bytes
+        const __m128 s = _mm_setr_ps(scale, scale, scale, 255.0f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 maxValue = _mm_set1_ps(255.0f);
+
+        for(;x+4<=_width;x+=4)
+        {
+            __m128i c[4];
+            for(int k=0;k<4;k++)
+            {
+                __m128 v = _mm_mul_ps(_mm_loadu_ps(src + (x + k) * 4), s);
+                // a NaN component ends up 0, as in the scalar path
+                v = _mm_min_ps(_mm_max_ps(v, zero), maxValue);
+                v = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 1, 2));
+                c[k] = _mm_cvttps_epi32(v);
+            }
+
+            __m128i lo = _mm_packs_epi32(c[0], c[1]);
+            __m128i hi = _mm_packs_epi32(c[2], c[3]);
+            _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(lo, hi));
+        }
+#endif
+
+        for(;x<_width;x++)
+            out[x] = quantizePixel(src + x * 4, scale);
+    }
+}
+
+QImage FrameBuffer::toQImage() const
+{
+    // a new image per call, receivers on different threads never share one
+    QImage image(_width, _height, QImage::Format_ARGB32);
+    if( image.isNull() )
+        return image;
+
+    uchar* bits = image.bits();
+    size_t bytesPerLine = image.bytesPerLine();
+
+#pragma omp parallel for schedule(static)
+    for(int y=0;y<(int)_height;y++)
+        tonemap(bits, bytesPerLine, y, y + 1);
+
+    return image;
+}
+
+bool FrameBuffer::saveImage(const string &filename) const
+{
+    if( filename.empty() )
+        return false;
+
+    return toQImage().save(filename.c_str());
+}
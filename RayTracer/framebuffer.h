@@ -0,0 +1,65 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "color.hpp"
+
+#include <QImage>
+#include <string>
+#include <vector>
+using namespace std;
+
+/*
+ * Frame the ray tracer renders into: four floats per pixel, red, green,
+ * blue and alpha, row by row, tonemapped into 8 bit images in the layout
+ * of QImage::Format_ARGB32.
+ *
+ * The pass scales the colors by the exposure, clamps them to [0, 1] and
+ * quantizes them, several pixels at a time, straight into the scanlines of
+ * the QImage. toQImage tonemaps into a new image on every call, so several
+ * threads may convert the same frame at once.
+ */
+class FrameBuffer
+{
+public:
+    FrameBuffer();
+    FrameBuffer(size_t w, size_t h);
+
+    const size_t& width() const { return _width; }
+    const size_t& height() const { return _height; }
+
+    void setExposure(float e) { _exposure = e; }
+    float exposure() const { return _exposure; }
+
+    const float* pixel(size_t x, size_t y) const { return &_data[(y * _width + x) * 4]; }
+    float* pixel(size_t x, size_t y) { return &_data[(y * _width + x) * 4]; }
+    const float* rawData() const { return _data.empty() ? 0 : &_data[0]; }
+
+    void setPixel(size_t x, size_t y, const float* value)
+    {
+        float* p = pixel(x, y);
+        p[0] = value[0]; p[1] = value[1]; p[2] = value[2]; p[3] = value[3];
+    }
+
+    template <typename T>
+    void setPixel(size_t x, size_t y, const Color4<T>& c)
+    {
+        float* p = pixel(x, y);
+        p[0] = c.r(); p[1] = c.g(); p[2] = c.b(); p[3] = c.a();
+    }
+
+    // runs the tonemapping pass into a new 8 bit image
+    QImage toQImage() const;
+    bool saveImage(const string& filename) const;
+
+    // tonemaps rows [y0, y1) into the ARGB32 image starting at dst, whose
+    // rows are bytesPerLine apart
+    void tonemap(uchar* dst, size_t bytesPerLine, size_t y0, size_t y1) const;
+
+private:
+    size_t _width;
+    size_t _height;
+    float _exposure;
+    vector<float> _data;
+};
+
+#endif // FRAMEBUFFER_H
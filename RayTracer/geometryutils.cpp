@@ -109,4 +109,31 @@ double squareDistance(const DblPoint3D &p1, const DblPoint3D &p2)
     double l = length(v);
     return l * l;
 }
+
+float dotProduct(const FltVector3D& v1, const FltVector3D& v2)
+{
+    return v1.x() * v2.x() + v1.y() * v2.y() + v1.z() * v2.z();
+}
+
+FltVector3D crossProduct(const FltVector3D& v1, const FltVector3D& v2)
+{
+    return FltVector3D(v1.y() * v2.z() - v1.z() * v2.y(),
+                       v1.z() * v2.x() - v1.x() * v2.z(),
+                       v1.x() * v2.y() - v1.y() * v2.x());
+}
+
+FltVector3D normalize(const FltPoint3D& v)
+{
+    FltPoint3D nv = v;
+    float length = sqrt(nv.x() * nv.x() + nv.y() * nv.y() + nv.z() * nv.z());
+    if( length == 0 )
+        return v;
+    else
+        return (nv / length);
+}
+
+float length(const FltVector3D& v)
+{
+    return sqrt( v.x() * v.x() + v.y() * v.y() + v.z() * v.z() );
+}
 }
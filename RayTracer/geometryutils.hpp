@@ -334,6 +334,8 @@ public:
 
     template <typename MT, typename PT>
     friend Point4D<PT> operator*(const Matrix<MT>& m, const Point4D<PT>& p);
+    template <typename MT, typename PT>
+    friend Point4D<PT> operator*(const Matrix4<MT>& m, const Point4D<PT>& p);
 
     template <typename PT>
     friend istream& operator>>(istream& s, Point4D<PT>& p);
@@ -399,6 +401,17 @@ Point4D<PT> operator*(const Matrix<MT>& m, const Point4D<PT>& p)
         throw "matrix and vector dimension mismatch!";
 }
 
+template <typename MT, typename PT>
+Point4D<PT> operator*(const Matrix4<MT>& m, const Point4D<PT>& p)
+{
+    PT vp[4] = { p.x(), p.y(), p.z(), p.w() };
+    PT t_vp[4];
+    for(size_t i=0;i<4;i++)
+        t_vp[i] = m(i, 0) * vp[0] + m(i, 1) * vp[1] + m(i, 2) * vp[2] + m(i, 3) * vp[3];
+
+    return Point4D<PT>(t_vp[0], t_vp[1], t_vp[2], t_vp[3]);
+}
+
 template <typename T>
 struct Polygon
 {
@@ -414,6 +427,11 @@ typedef DblPoint3D DblVector3D;
 typedef DblPoint4D DblVector4D;
 typedef Polygon<double> DblPolygon;
 
+typedef Point2D<float> FltPoint2D;
+typedef Point3D<float> FltPoint3D;
+typedef FltPoint2D FltVector2D;
+typedef FltPoint3D FltVector3D;
+
 void assignPolygonOrientation(DblPolygon& polygon);
 double dotProduct(const DblVector2D& v1, const DblVector2D& v2);
 double dotProduct(const DblVector3D& v1, const DblVector3D& v2);
@@ -428,6 +446,12 @@ double distance(const DblPoint2D& p1, const DblPoint2D& p2);
 double distance(const DblPoint3D& p1, const DblPoint3D& p2);
 double squareDistance(const DblPoint2D& p1, const DblPoint2D& p2);
 double squareDistance(const DblPoint3D& p1, const DblPoint3D& p2);
+
+// single precision versions for the float build of the ray tracer
+float dotProduct(const FltVector3D& v1, const FltVector3D& v2);
+FltVector3D crossProduct(const FltVector3D& v1, const FltVector3D& v2);
+FltVector3D normalize(const FltVector3D& v);
+float length(const FltVector3D& v);
 }
 
 #endif //GEOMETRY_UTILS_H
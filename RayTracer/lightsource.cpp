@@ -1,7 +1,11 @@
 #include "lightsource.h"
 #include "utility.hpp"
 
-LightSource::LightSource()
+#include "mathutil.hpp"
+
+LightSource::LightSource():
+    _type(POINT),
+    _radius(0)
 {
 }
 
@@ -10,6 +14,58 @@ LightSource::LightSourceType LightSource::interpretType(const std::string &str)
     string lowerStr = Utils::toLower(str);
     if( lowerStr == "point" )
         return POINT;
+    else if( lowerStr == "sphere" )
+        return SPHERE;
+    else if( lowerStr == "area" )
+        return AREA;
     else
         return UNKNOWN;
 }
+
+RealPoint3D LightSource::samplePoint(const RealPoint3D &from, Real u, Real v) const
+{
+    switch( _type )
+    {
+    case SPHERE:
+    {
+        // uniform point on the disk through the center facing from
+        RealVector3D w = _pos - from;
+        Real len = length(w);
+        if( len <= 0 || _radius <= 0 )
+            return _pos;
+        w = w / len;
+
+        RealVector3D a = fabs(w.x()) > 0.5 ? RealVector3D(0, 1, 0) : RealVector3D(1, 0, 0);
+        RealVector3D t1 = normalize( crossProduct(w, a) );
+        RealVector3D t2 = crossProduct(w, t1);
+
+        Real r = _radius * sqrt(u);
+        Real phi = 2.0 * MathUtils::PI * v;
+        return _pos + t1 * (r * cos(phi)) + t2 * (r * sin(phi));
+    }
+    case AREA:
+        return _pos + _edges[0] * (u - 0.5) + _edges[1] * (v - 0.5);
+    default:
+        return _pos;
+    }
+}
+
+BoundingBox LightSource::boundingBox() const
+{
+    BoundingBox box;
+    switch( _type )
+    {
+    case SPHERE:
+        box.expand(RealPoint3D(_pos.x() - _radius, _pos.y() - _radius, _pos.z() - _radius));
+        box.expand(RealPoint3D(_pos.x() + _radius, _pos.y() + _radius, _pos.z() + _radius));
+        break;
+    case AREA:
+        for(int i=0;i<4;i++)
+            box.expand(RealPoint3D(_pos + _edges[0] * ((i & 1) - 0.5) + _edges[1] * ((i >> 1) - 0.5)));
+        break;
+    default:
+        box.expand(_pos);
+        break;
+    }
+    return box;
+}
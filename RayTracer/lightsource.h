@@ -5,7 +5,13 @@
 using namespace GeometryUtils;
 
 #include "color.hpp"
+#include "realtype.hpp"
+#include "boundingbox.hpp"
 
+// point light, or a light with an extent: a sphere around _pos of the given
+// radius, or a rectangle centered at _pos spanned by the two edges; lights
+// with an extent cast soft shadows, every shading point is lit from a point
+// sampled on them
 class LightSource
 {
 public:
@@ -15,7 +21,8 @@ public:
         // LINE,
         // BAND,
         // CUBE,
-        // SPHERE,
+        SPHERE,
+        AREA,
         UNKNOWN
     };
 
@@ -23,9 +30,21 @@ public:
 
     static LightSourceType interpretType(const string&);
 
-    DblPoint3D _pos;
-    DblColor4 _color;
+    // point on the light for the uniform numbers u and v, a sphere is
+    // sampled on its disk facing from
+    RealPoint3D samplePoint(const RealPoint3D& from, Real u, Real v) const;
+
+    BoundingBox boundingBox() const;
+
+    // mean of the color channels, used to pick the important lights
+    Real intensity() const { return (_color.r() + _color.g() + _color.b()) / 3.0; }
+
+    RealPoint3D _pos;
+    RealColor4 _color;
     LightSourceType _type;
+
+    Real _radius;
+    RealVector3D _edges[2];
 };
 
 #endif // LIGHTSOURCE_H
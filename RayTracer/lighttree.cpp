@@ -0,0 +1,154 @@
+#include "lighttree.h"
+
+#include <algorithm>
+
+namespace
+{
+struct CenterLess
+{
+    CenterLess(const vector<BoundingBox>& boxes, int axis):
+        _boxes(boxes), _axis(axis)
+    {}
+
+    bool operator()(unsigned int a, unsigned int b) const
+    {
+        return _boxes[a].center(_axis) < _boxes[b].center(_axis);
+    }
+
+    const vector<BoundingBox>& _boxes;
+    int _axis;
+};
+}
+
+LightTree::LightTree()
+{
+}
+
+void LightTree::clear()
+{
+    _nodes.clear();
+    _order.clear();
+}
+
+Real LightTree::attenuation(Real d)
+{
+    const Real constantAtt = 1;
+    const Real linearAtt = 0.025;
+    const Real quadraticAtt = 0.0005;
+
+    return 1.0 / ( constantAtt + linearAtt * d + quadraticAtt * d * d);
+}
+
+void LightTree::build(const LightSource *lights, size_t lightNumber)
+{
+    clear();
+    if( lightNumber == 0 )
+        return;
+
+    vector<BoundingBox> boxes(lightNumber);
+    vector<Real> intensities(lightNumber);
+    _order.resize(lightNumber);
+    for(size_t i=0;i<lightNumber;i++)
+    {
+        boxes[i] = lights[i].boundingBox();
+        intensities[i] = lights[i].intensity();
+        _order[i] = i;
+    }
+
+    _nodes.reserve(2 * lightNumber - 1);
+    buildRecursive(0, lightNumber, boxes, intensities);
+}
+
+unsigned int LightTree::buildRecursive(size_t begin, size_t end,
+                                       const vector<BoundingBox> &boxes,
+                                       const vector<Real> &intensities)
+{
+    unsigned int nodeIdx = _nodes.size();
+    _nodes.push_back(LightNode());
+
+    BoundingBox box, centerBox;
+    Real intensity = 0;
+    for(size_t i=begin;i<end;i++)
+    {
+        unsigned int idx = _order[i];
+        box.expand(boxes[idx]);
+        centerBox.expand(RealPoint3D(boxes[idx].center(0), boxes[idx].center(1), boxes[idx].center(2)));
+        intensity += intensities[idx];
+    }
+
+    _nodes[nodeIdx]._box = box;
+    _nodes[nodeIdx]._intensity = intensity;
+
+    if( end - begin == 1 )
+    {
+        _nodes[nodeIdx]._offset = _order[begin];
+        _nodes[nodeIdx]._count = 1;
+        return nodeIdx;
+    }
+
+    // median split along the longest extent of the light centers, which
+    // keeps the tree balanced for the hundreds of similar lights of
+    // architectural scenes
+    size_t mid = (begin + end) / 2;
+    nth_element(_order.begin() + begin, _order.begin() + mid, _order.begin() + end,
+                CenterLess(boxes, centerBox.longestAxis()));
+
+    buildRecursive(begin, mid, boxes, intensities);
+    unsigned int right = buildRecursive(mid, end, boxes, intensities);
+
+    _nodes[nodeIdx]._offset = right;
+    _nodes[nodeIdx]._count = 0;
+    return nodeIdx;
+}
+
+Real LightTree::importance(const LightNode &node, const RealPoint3D &p) const
+{
+    // distance from p to the nearest point of the box, 0 inside
+    Real d2 = 0;
+    Real coords[3] = { p.x(), p.y(), p.z() };
+    for(int k=0;k<3;k++)
+    {
+        Real d = 0;
+        if( coords[k] < node._box._min[k] )
+            d = node._box._min[k] - coords[k];
+        else if( coords[k] > node._box._max[k] )
+            d = coords[k] - node._box._max[k];
+        d2 += d * d;
+    }
+
+    return node._intensity * attenuation(sqrt(d2));
+}
+
+int LightTree::sample(const RealPoint3D &p, Real u, Real &pdf) const
+{
+    pdf = 0;
+    if( _nodes.empty() )
+        return -1;
+
+    pdf = 1;
+    unsigned int nodeIdx = 0;
+    while( !_nodes[nodeIdx].isLeaf() )
+    {
+        unsigned int left = nodeIdx + 1, right = _nodes[nodeIdx]._offset;
+        Real wl = importance(_nodes[left], p);
+        Real wr = importance(_nodes[right], p);
+        Real pl = (wl + wr > 0) ? wl / (wl + wr) : 0.5;
+
+        // u is rescaled to the part of [0, 1) of the child taken
+        if( u < pl )
+        {
+            u = u / pl;
+            pdf *= pl;
+            nodeIdx = left;
+        }
+        else
+        {
+            u = (u - pl) / (1 - pl);
+            pdf *= 1 - pl;
+            nodeIdx = right;
+        }
+        if( u >= 1 ) u = 0.99999;
+    }
+
+    return _nodes[nodeIdx]._offset;
+}
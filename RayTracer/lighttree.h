@@ -0,0 +1,58 @@
+#ifndef LIGHTTREE_H
+#define LIGHTTREE_H
+
+#include <vector>
+using namespace std;
+
+#include "boundingbox.hpp"
+#include "lightsource.h"
+
+// node of the flattened light hierarchy, laid out as the BVH nodes
+// interior node: left child is the next node, _offset is the right child
+// leaf node: _offset is the light, _count is 1
+struct LightNode
+{
+    BoundingBox _box;
+    Real _intensity;
+    unsigned int _offset;
+    unsigned int _count;
+
+    bool isLeaf() const { return _count > 0; }
+};
+
+// binary hierarchy over the light sources of a scene, every node bounds
+// its lights and sums their intensity; a light is picked for a shading
+// point by walking down from the root and taking each child with a
+// probability proportional to its estimated contribution there, its
+// intensity over the attenuation at the nearest point of its box
+class LightTree
+{
+public:
+    LightTree();
+
+    void build(const LightSource* lights, size_t lightNumber);
+    void clear();
+
+    // picks a light for the point p with the uniform number u, returns its
+    // index and the probability it was picked with, -1 without lights
+    int sample(const RealPoint3D& p, Real u, Real& pdf) const;
+
+    size_t nodeNumber() const { return _nodes.size(); }
+    const vector<LightNode>& nodes() const { return _nodes; }
+
+    // distance falloff of the lights, the attenuation of the shading
+    static Real attenuation(Real d);
+
+protected:
+    unsigned int buildRecursive(size_t begin, size_t end,
+                                const vector<BoundingBox>& boxes,
+                                const vector<Real>& intensities);
+    Real importance(const LightNode& node, const RealPoint3D& p) const;
+
+private:
+    vector<LightNode> _nodes;
+    // light indices, in leaf order once built
+    vector<unsigned int> _order;
+};
+
+#endif // LIGHTTREE_H
@@ -3,10 +3,35 @@
 #include "GL/glew.h"
 #include "GL/glut.h"
 
+#include <cstring>
+#include <iostream>
+using namespace std;
+
 #include "mainwindow.h"
+#include "scenecache.h"
 
 int main(int argc, char *argv[])
 {
+    // RayTracer --convert scene.scn [cache.scb]
+    // writes the binary cache of a scene file, picked up when the scene is opened
+    if( argc >= 3 && strcmp(argv[1], "--convert") == 0 )
+    {
+        string sceneFile = argv[2];
+        string cacheFile = (argc >= 4) ? argv[3] : SceneCache::cacheFileName(sceneFile);
+
+        try{
+            if( SceneCache::convert(sceneFile, cacheFile) )
+                return 0;
+        }
+        catch(const char* errstr)
+        {
+            cerr << errstr << endl;
+        }
+
+        cerr << "failed to convert " << sceneFile << endl;
+        return 1;
+    }
+
     QApplication a(argc, argv);
     glutInit(&argc, argv);
     MainWindow w;
@@ -106,6 +106,10 @@ void MainWindow::processSceneFile(const QString &filename)
         {
             cerr << errstr << endl;
         }
+        catch(const char* errstr)
+        {
+            cerr << errstr << endl;
+        }
     }
 }
 
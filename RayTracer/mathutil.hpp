@@ -500,7 +500,58 @@ void Matrix<T>::print(const char* name)
     }
 }
 
+// 4x4 matrix kept in place, for transforms computed while rendering, where
+// the heap allocations of Matrix would be contended between the threads
+template <typename T>
+class Matrix4
+{
+public:
+    Matrix4()
+    {
+        memset(_data, 0, sizeof(_data));
+    }
+
+    inline T& operator()(size_t row, size_t col) {
+        return _data[row * 4 + col];
+    }
+    inline const T& operator()(size_t row, size_t col) const {
+        return _data[row * 4 + col];
+    }
+
+    Matrix4 operator*(const Matrix4& rhs) const
+    {
+        Matrix4 m;
+        for (size_t i=0;i<4;i++)
+            for (size_t j=0;j<4;j++)
+            {
+                T sum = 0;
+                for (size_t k=0;k<4;k++)
+                    sum += (*this)(i, k) * rhs(k, j);
+                m(i, j) = sum;
+            }
+
+        return m;
+    }
+
+    static Matrix4 unit()
+    {
+        Matrix4 m;
+        for (size_t i=0;i<4;i++)
+            m(i, i) = 1;
+
+        return m;
+    }
+
+    const T* rawData() const {
+        return _data;
+    }
+
+private:
+    T _data[16];
+};
+
 typedef Matrix<double> DblMatrix;
+typedef Matrix4<double> DblMatrix4;
 typedef Vector<double> DblVector;
 }
 #endif
@@ -147,6 +147,84 @@ Matrix<T> makeRotationMatrix_deg(T degX, T degY, T degZ, RotationOrder order)
     return makeRotationMatrix( radX, radY, radZ, order );
 }
 
+// the same rotations as fixed size matrices, they allocate nothing
+template <typename T>
+Matrix4<T> makeXRotationMatrix4( T r )
+{
+    Matrix4<T> mat = Matrix4<T>::unit();
+
+    double sinR = sin(r);
+    double cosR = cos(r);
+
+    mat(1, 1) = cosR;   mat(1, 2) = -sinR;
+    mat(2, 1) = sinR;   mat(2, 2) = cosR;
+
+    return mat;
+}
+
+template <typename T>
+Matrix4<T> makeYRotationMatrix4( T r )
+{
+    Matrix4<T> mat = Matrix4<T>::unit();
+
+    double sinR = sin(r);
+    double cosR = cos(r);
+
+    mat(0, 0) = cosR;   mat(0, 2) = sinR;
+    mat(2, 0) = -sinR;  mat(2, 2) = cosR;
+
+    return mat;
+}
+
+template <typename T>
+Matrix4<T> makeZRotationMatrix4( T r )
+{
+    Matrix4<T> mat = Matrix4<T>::unit();
+
+    double sinR = sin(r);
+    double cosR = cos(r);
+
+    mat(0, 0) = cosR;   mat(0, 1) = -sinR;
+    mat(1, 0) = sinR;   mat(1, 1) = cosR;
+
+    return mat;
+}
+
+template <typename T>
+Matrix4<T> makeRotationMatrix4(T rx, T ry, T rz, RotationOrder order)
+{
+    Matrix4<T> Rx = makeXRotationMatrix4(rx);
+    Matrix4<T> Ry = makeYRotationMatrix4(ry);
+    Matrix4<T> Rz = makeZRotationMatrix4(rz);
+
+    switch(order)
+    {
+    default:
+    case XYZ:
+        return Rx * Ry * Rz;
+    case XZY:
+        return Rx * Rz * Ry;
+    case YXZ:
+        return Ry * Rx * Rz;
+    case YZX:
+        return Ry * Rz * Rx;
+    case ZXY:
+        return Rz * Rx * Ry;
+    case ZYX:
+        return Rz * Ry * Rx;
+    }
+}
+
+template <typename T>
+Matrix4<T> makeRotationMatrix4_deg(T degX, T degY, T degZ, RotationOrder order)
+{
+    T radX = degX / 180.0 * MathUtils::PI;
+    T radY = degY / 180.0 * MathUtils::PI;
+    T radZ = degZ / 180.0 * MathUtils::PI;
+
+    return makeRotationMatrix4( radX, radY, radZ, order );
+}
+
 }
 
 #endif // MATRIXUTIL_HPP
@@ -4,19 +4,35 @@
 #include "modelviewer.h"
 #include "scene.h"
 #include "shape.h"
+#include "polygonmesh.h"
 
 #include "imageviewer.h"
 
 ModelViewer::ModelViewer(QWidget *parent) :    
     GL3DCanvas(parent),
     _scene(0),
-    _vmode(OpenGL)
+    _vmode(OpenGL),
+    _renderThread(&_tracer)
 {
     connect(&_tracer, SIGNAL(sig_progress(double)), this, SIGNAL(sig_progress(double)));
+    connect(&_tracer, SIGNAL(sig_passFinished(QSharedPointer<FrameBuffer>,int,int)),
+            this, SLOT(slot_passFinished(QSharedPointer<FrameBuffer>,int,int)));
+    connect(&_renderThread, SIGNAL(finished()), this, SLOT(slot_renderFinished()));
+
+    // show a preview quickly, refine it while rendering
+    _tracer.setProgressiveRendering(true);
+}
+
+ModelViewer::~ModelViewer()
+{
+    stopRendering();
 }
 
 void ModelViewer::bindScene(Scene *s)
 {
+    // the frame in progress still reads the previous scene
+    stopRendering();
+
     _scene = s;
 
     updateSceneParameters(width(), height());
@@ -138,14 +154,16 @@ void ModelViewer::renderScene_OpenGL()
     for(int i=0;i<shapeCount;i++)
     {
         const Shape* s = _scene->shape(i);
+        if( !s )
+            continue;
 
         switch( s->type() )
         {
         case Shape::SPHERE:
         {
             const Sphere* shape = dynamic_cast<const Sphere*>(s);
-            DblPoint3D center = shape->center();
-            DblColor4 color = shape->color();
+            RealPoint3D center = shape->center();
+            RealColor4 color = shape->color();
 
             glColor4f(color.r(), color.g(), color.b(), color.a());
             GLfloat mat_diffuse[] = {color.r(), color.g(), color.b(), color.a()};
@@ -159,12 +177,24 @@ void ModelViewer::renderScene_OpenGL()
         }
         case Shape::TRIANGLE:
         {
+            const Triangle* shape = dynamic_cast<const Triangle*>(s);
+            RealColor4 color = shape->color();
+
+            glColor4f(color.r(), color.g(), color.b(), color.a());
+            GLfloat mat_diffuse[] = {color.r(), color.g(), color.b(), color.a()};
+            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, mat_diffuse);
+
+            glBegin(GL_TRIANGLES);
+            glNormal3f(shape->normal().x(), shape->normal().y(), shape->normal().z());
+            for(int i=0;i<3;i++)
+                glVertex3f(shape->vertex(i).x(), shape->vertex(i).y(), shape->vertex(i).z());
+            glEnd();
             break;
         }
         case Shape::RECTANGLE:
         {
             const Rectangle* shape = dynamic_cast<const Rectangle*>(s);
-            DblColor4 color = shape->color();
+            RealColor4 color = shape->color();
 
             glColor4f(color.r(), color.g(), color.b(), color.a());
             GLfloat mat_diffuse[] = {color.r(), color.g(), color.b(), color.a()};
@@ -187,6 +217,26 @@ void ModelViewer::renderScene_OpenGL()
         }
         case Shape::POLYGONMESH:
         {
+            const PolygonMesh* shape = dynamic_cast<const PolygonMesh*>(s);
+            RealColor4 color = shape->color();
+
+            glColor4f(color.r(), color.g(), color.b(), color.a());
+            GLfloat mat_diffuse[] = {color.r(), color.g(), color.b(), color.a()};
+            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, mat_diffuse);
+
+            glBegin(GL_TRIANGLES);
+            for(size_t j=0;j<shape->triangleNumber();j++)
+            {
+                const unsigned int* tri = shape->triangle(j);
+                for(int k=0;k<3;k++)
+                {
+                    const Real* n = shape->vertexNormal(tri[k]);
+                    const Real* v = shape->vertex(tri[k]);
+                    glNormal3f(n[0], n[1], n[2]);
+                    glVertex3f(v[0], v[1], v[2]);
+                }
+            }
+            glEnd();
             break;
         }
         default:
@@ -311,16 +361,42 @@ void ModelViewer::renderScene_RayTracing()
 
 }
 
+void ModelViewer::stopRendering()
+{
+    if( !_renderThread.isRunning() )
+        return;
+
+    _tracer.cancel();
+    _renderThread.wait();
+}
+
 void ModelViewer::slot_render()
 {
+    if( !_scene || _renderThread.isRunning() )
+        return;
+
+    // pop up a window showing the rendered image, it is updated after
+    // every pass
+    _renderViewer = new ImageViewer;
+    _renderViewer->show();
+
     _tracer.bindScene(_scene);
     _tracer.setSize(width(), height());
-    _tracer.execute();
-    // pop up a window showing the rendered image
-    ImageViewer* _iv = new ImageViewer;
-    RGBAImage img = _tracer.result();
-    _iv->setImage(img.toQImage());
-    _iv->show();
+    _renderThread.start();
+}
+
+void ModelViewer::slot_renderFinished()
+{
+    if( _tracer.isCancelled() )
+        cout << "ray tracing cancelled." << endl;
+    else
+        cout << "ray tracing complete." << endl;
+}
+
+void ModelViewer::slot_passFinished(QSharedPointer<FrameBuffer> image, int, int)
+{
+    if( _renderViewer )
+        _renderViewer->setImage(image->toQImage());
 }
 
 void ModelViewer::keyPressEvent(QKeyEvent *e)
@@ -331,7 +407,16 @@ void ModelViewer::keyPressEvent(QKeyEvent *e)
     {
         slot_render();
         e->accept();
-        cout << "ray tracing complete." << endl;
+        break;
+    }
+    case Qt::Key_Escape:
+    {
+        if( _renderThread.isRunning() )
+        {
+            _tracer.cancel();
+            e->accept();
+        }
+        break;
     }
     default:
         break;
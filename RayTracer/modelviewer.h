@@ -4,7 +4,10 @@
 #include "gl3dcanvas.h"
 #include "raytracer.h"
 
+#include <QPointer>
+
 class Scene;
+class ImageViewer;
 
 class ModelViewer : public GL3DCanvas
 {
@@ -16,6 +19,7 @@ public:
     };
 
     ModelViewer(QWidget *parent = 0);
+    ~ModelViewer();
 
     QSize sizeHint() const
     {
@@ -39,6 +43,10 @@ signals:
 
 public slots:
     void slot_render();
+    void slot_passFinished(QSharedPointer<FrameBuffer> image, int pass, int passNumber);
+
+private slots:
+    void slot_renderFinished();
 
 protected:
     void initializeGL();
@@ -55,6 +63,9 @@ private:
     void renderScene_OpenGL();
     void renderScene_RayTracing();
 
+    // cancels the rendering in progress and waits for it to stop
+    void stopRendering();
+
     void renderInfo();
     void renderBoundingBox();
     void renderGround();
@@ -66,6 +77,13 @@ private:
     Scene* _scene;
     ViewingMode _vmode;
     RayTracer _tracer;
+
+    // the rendering runs off the GUI thread, the passes come back queued
+    // through sig_passFinished and the events keep being processed
+    RenderThread _renderThread;
+
+    // shows the passes of the rendering in progress
+    QPointer<ImageViewer> _renderViewer;
 };
 
 #endif // MODELVIEWER_H
@@ -0,0 +1,706 @@
+#include "polygonmesh.h"
+#include "animation.h"
+#include "utility.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <climits>
+
+TriangleRay::TriangleRay(const Ray &r)
+{
+    RealVector3D d = normalize( r.dir() );
+
+    org[0] = r.origin().x(), org[1] = r.origin().y(), org[2] = r.origin().z();
+    dir[0] = d.x(), dir[1] = d.y(), dir[2] = d.z();
+
+    // the dimension where the direction is largest becomes z
+    kz = 0;
+    if( fabs(dir[1]) > fabs(dir[kz]) ) kz = 1;
+    if( fabs(dir[2]) > fabs(dir[kz]) ) kz = 2;
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+
+    // keep the winding of the triangles
+    if( dir[kz] < 0 )
+    {
+        int tmp = kx;
+        kx = ky;
+        ky = tmp;
+    }
+
+    sx = dir[kx] / dir[kz];
+    sy = dir[ky] / dir[kz];
+    sz = 1.0 / dir[kz];
+}
+
+bool intersectTriangle(const TriangleRay &r, const Real *v0, const Real *v1, const Real *v2,
+                       Real tmin, Real tmax, Real &t, Real bary[3])
+{
+    // vertices relative to the ray origin
+    Real A[3] = { v0[0] - r.org[0], v0[1] - r.org[1], v0[2] - r.org[2] };
+    Real B[3] = { v1[0] - r.org[0], v1[1] - r.org[1], v1[2] - r.org[2] };
+    Real C[3] = { v2[0] - r.org[0], v2[1] - r.org[1], v2[2] - r.org[2] };
+
+    // shear and scale the vertices
+    Real Ax = A[r.kx] - r.sx * A[r.kz];
+    Real Ay = A[r.ky] - r.sy * A[r.kz];
+    Real Bx = B[r.kx] - r.sx * B[r.kz];
+    Real By = B[r.ky] - r.sy * B[r.kz];
+    Real Cx = C[r.kx] - r.sx * C[r.kz];
+    Real Cy = C[r.ky] - r.sy * C[r.kz];
+
+    // scaled barycentric coordinates
+    Real U = Cx * By - Cy * Bx;
+    Real V = Ax * Cy - Ay * Cx;
+    Real W = Bx * Ay - By * Ax;
+
+    // the ray passes exactly through an edge, decide in double precision
+    if( U == 0 || V == 0 || W == 0 )
+    {
+        U = (Real)((double)Cx * (double)By - (double)Cy * (double)Bx);
+        V = (Real)((double)Ax * (double)Cy - (double)Ay * (double)Cx);
+        W = (Real)((double)Bx * (double)Ay - (double)By * (double)Ax);
+    }
+
+    // both sides of the triangle are hit
+    if( (U < 0 || V < 0 || W < 0) && (U > 0 || V > 0 || W > 0) )
+        return false;
+
+    Real det = U + V + W;
+    if( det == 0 )
+        return false;
+
+    Real Az = r.sz * A[r.kz];
+    Real Bz = r.sz * B[r.kz];
+    Real Cz = r.sz * C[r.kz];
+    Real T = U * Az + V * Bz + W * Cz;
+
+    Real invDet = 1.0 / det;
+    t = T * invDet;
+    if( t <= tmin || t >= tmax )
+        return false;
+
+    bary[0] = U * invDet;
+    bary[1] = V * invDet;
+    bary[2] = W * invDet;
+    return true;
+}
+
+namespace
+{
+// hits closer than this are taken as the surface the ray starts from
+const Real ZERO_THRESHOLD = 1e-3;
+
+// nearest hit query over the triangles of a mesh
+struct NearestHitVisitor
+{
+    NearestHitVisitor(const PolygonMesh& mesh, const TriangleRay& ray, Real tmax):
+        _mesh(mesh), _ray(ray), _t(tmax), _triangle(-1)
+    {}
+
+    double tmax() const { return _t; }
+
+    bool operator()(unsigned int idx)
+    {
+        const unsigned int* tri = _mesh.triangle(idx);
+        Real t, bary[3];
+        if( intersectTriangle(_ray, _mesh.vertex(tri[0]), _mesh.vertex(tri[1]), _mesh.vertex(tri[2]),
+                              ZERO_THRESHOLD, _t, t, bary) )
+        {
+            _t = t;
+            _triangle = idx;
+            _bary[0] = bary[0], _bary[1] = bary[1], _bary[2] = bary[2];
+        }
+        return false;
+    }
+
+    const PolygonMesh& _mesh;
+    const TriangleRay& _ray;
+    Real _t;
+    int _triangle;
+    Real _bary[3];
+};
+
+// any hit query, stops at the first triangle found
+struct AnyHitVisitor
+{
+    AnyHitVisitor(const PolygonMesh& mesh, const TriangleRay& ray, Real tmax):
+        _mesh(mesh), _ray(ray), _t(tmax), _blocked(false)
+    {}
+
+    double tmax() const { return _t; }
+
+    bool operator()(unsigned int idx)
+    {
+        const unsigned int* tri = _mesh.triangle(idx);
+        Real t, bary[3];
+        _blocked = intersectTriangle(_ray, _mesh.vertex(tri[0]), _mesh.vertex(tri[1]), _mesh.vertex(tri[2]),
+                                     ZERO_THRESHOLD, _t, t, bary);
+        return _blocked;
+    }
+
+    const PolygonMesh& _mesh;
+    const TriangleRay& _ray;
+    Real _t;
+    bool _blocked;
+};
+
+void inverseDirection(const TriangleRay& r, double orig[3], double invDir[3])
+{
+    for(int k=0;k<3;k++)
+    {
+        orig[k] = r.org[k];
+        invDir[k] = 1.0 / r.dir[k];
+    }
+}
+
+string fileExtension(const string& filename)
+{
+    size_t pos = filename.find_last_of('.');
+    if( pos == string::npos )
+        return "";
+    return Utils::toLower(filename.substr(pos + 1));
+}
+}
+
+PolygonMesh::PolygonMesh():
+    Shape(POLYGONMESH),
+    _scale(1.0),
+    _offset(0, 0, 0),
+    _vertexArray(0),
+    _normalArray(0),
+    _vertexNumber(0),
+    _triangleArray(0),
+    _triangleNumber(0)
+{
+    _refractionRate = 0;
+}
+
+PolygonMesh::~PolygonMesh()
+{
+}
+
+istream& operator>>(istream& s, PolygonMesh& m)
+{
+    s >> m._fileName;
+
+    // the scale and the offset are optional
+    Real scale;
+    if( s >> scale )
+    {
+        m._scale = scale;
+
+        RealVector3D offset;
+        if( s >> offset.x() >> offset.y() >> offset.z() )
+            m._offset = offset;
+    }
+
+    return s;
+}
+
+bool PolygonMesh::intersect(const Ray &r, Hit &h)
+{
+    TriangleRay ray(r);
+    double orig[3], invDir[3];
+    inverseDirection(ray, orig, invDir);
+
+    NearestHitVisitor visitor(*this, ray, h.t());
+    _bvh.traverse(orig, invDir, visitor);
+
+    if( visitor._triangle < 0 )
+        return false;
+
+    // interpolated vertex normal
+    const unsigned int* tri = triangle(visitor._triangle);
+    RealVector3D normal(0, 0, 0);
+    for(int k=0;k<3;k++)
+    {
+        const Real* n = vertexNormal(tri[k]);
+        normal = normal + RealVector3D(n[0], n[1], n[2]) * visitor._bary[k];
+    }
+
+    if( length(normal) == 0 )
+    {
+        const Real* v0 = vertex(tri[0]);
+        const Real* v1 = vertex(tri[1]);
+        const Real* v2 = vertex(tri[2]);
+        normal = crossProduct(RealVector3D(v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2]),
+                              RealVector3D(v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2]));
+    }
+
+    if( _refractionRate > 0 )
+        h.set( visitor._t, _color, normal, true, true, _refractionRate );
+    else
+        h.set( visitor._t, _color, normal );
+
+    return true;
+}
+
+bool PolygonMesh::blockTest(const Ray &r, Real t)
+{
+    TriangleRay ray(r);
+    double orig[3], invDir[3];
+    inverseDirection(ray, orig, invDir);
+
+    AnyHitVisitor visitor(*this, ray, t);
+    _bvh.traverse(orig, invDir, visitor);
+
+    return visitor._blocked;
+}
+
+BoundingBox PolygonMesh::boundingBox() const
+{
+    return _bvh.bounds();
+}
+
+void PolygonMesh::load(const string &filename)
+{
+    _fileName = filename;
+
+    _vertices.clear();
+    _normals.clear();
+    _triangles.clear();
+    _bvh.clear();
+
+    string ext = fileExtension(filename);
+    if( ext == "obj" )
+        loadOBJ(filename);
+    else if( ext == "ply" )
+        loadPLY(filename);
+    else
+        throw "unsupported mesh file format.";
+
+    setup();
+}
+
+void PolygonMesh::attach(const Real *vertices, const Real *normals, size_t vertexNumber,
+                         const unsigned int *triangles, size_t triangleNumber,
+                         const BVHNode *nodes, size_t nodeNumber, const unsigned int *indices, size_t indexNumber)
+{
+    _vertices.clear();
+    _normals.clear();
+    _triangles.clear();
+
+    _vertexArray = vertices;
+    _normalArray = normals;
+    _vertexNumber = vertexNumber;
+    _triangleArray = triangles;
+    _triangleNumber = triangleNumber;
+
+    _bvh.attach(nodes, nodeNumber, indices, indexNumber);
+}
+
+void PolygonMesh::setTransform(const Transform &t)
+{
+    if( _restVertices.empty() )
+    {
+        // attached buffers are read only, the mesh gets its own copies
+        _restVertices.assign(_vertexArray, _vertexArray + _vertexNumber * 3);
+        _restNormals.assign(_normalArray, _normalArray + _vertexNumber * 3);
+        _vertices = _restVertices;
+        _normals = _restNormals;
+        _vertexArray = _vertices.empty() ? 0 : &_vertices[0];
+        _normalArray = _normals.empty() ? 0 : &_normals[0];
+    }
+
+    for(size_t i=0;i<_vertexNumber;i++)
+    {
+        const Real* v = &_restVertices[i * 3];
+        const Real* n = &_restNormals[i * 3];
+        RealPoint3D p = t.apply(RealPoint3D(v[0], v[1], v[2]));
+        RealVector3D normal = t.rotate(RealVector3D(n[0], n[1], n[2]));
+
+        _vertices[i * 3 + 0] = p.x();
+        _vertices[i * 3 + 1] = p.y();
+        _vertices[i * 3 + 2] = p.z();
+        _normals[i * 3 + 0] = normal.x();
+        _normals[i * 3 + 1] = normal.y();
+        _normals[i * 3 + 2] = normal.z();
+    }
+
+    // a rigid motion keeps the triangles together, so the refitted
+    // hierarchy is as good as a rebuilt one
+    _triangleBoxes.resize(_triangleNumber);
+    for(size_t i=0;i<_triangleNumber;i++)
+    {
+        const unsigned int* tri = triangle(i);
+        BoundingBox& box = _triangleBoxes[i];
+        box.reset();
+        for(int k=0;k<3;k++)
+            box.expand(RealPoint3D(_vertices[tri[k] * 3 + 0],
+                                   _vertices[tri[k] * 3 + 1],
+                                   _vertices[tri[k] * 3 + 2]));
+    }
+
+    _bvh.refit(_triangleBoxes);
+}
+
+void PolygonMesh::setup()
+{
+    size_t vertexNumber = _vertices.size() / 3;
+    size_t triangleNumber = _triangles.size() / 3;
+
+    _vertexArray = _vertices.empty() ? 0 : &_vertices[0];
+    _vertexNumber = vertexNumber;
+    _triangleArray = _triangles.empty() ? 0 : &_triangles[0];
+    _triangleNumber = triangleNumber;
+
+    for(size_t i=0;i<_triangles.size();i++)
+    {
+        if( _triangles[i] >= vertexNumber )
+            throw "mesh vertex index out of range.";
+    }
+
+    for(size_t i=0;i<vertexNumber;i++)
+    {
+        _vertices[i * 3 + 0] = _vertices[i * 3 + 0] * _scale + _offset.x();
+        _vertices[i * 3 + 1] = _vertices[i * 3 + 1] * _scale + _offset.y();
+        _vertices[i * 3 + 2] = _vertices[i * 3 + 2] * _scale + _offset.z();
+    }
+
+    // the face normals are not normalized, so larger faces weigh more
+    _normals.assign(vertexNumber * 3, 0);
+    _normalArray = _normals.empty() ? 0 : &_normals[0];
+    vector<BoundingBox> boxes(triangleNumber);
+    for(size_t i=0;i<triangleNumber;i++)
+    {
+        const unsigned int* tri = triangle(i);
+        const Real* v0 = vertex(tri[0]);
+        const Real* v1 = vertex(tri[1]);
+        const Real* v2 = vertex(tri[2]);
+
+        RealVector3D faceNormal = crossProduct(RealVector3D(v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2]),
+                                               RealVector3D(v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2]));
+        for(int k=0;k<3;k++)
+        {
+            _normals[tri[k] * 3 + 0] += faceNormal.x();
+            _normals[tri[k] * 3 + 1] += faceNormal.y();
+            _normals[tri[k] * 3 + 2] += faceNormal.z();
+
+            boxes[i].expand(RealPoint3D(_vertices[tri[k] * 3 + 0],
+                                        _vertices[tri[k] * 3 + 1],
+                                        _vertices[tri[k] * 3 + 2]));
+        }
+    }
+
+    // vertices of no face, or only of degenerate ones, keep a zero normal
+    for(size_t i=0;i<vertexNumber;i++)
+    {
+        RealVector3D n(_normals[i * 3 + 0], _normals[i * 3 + 1], _normals[i * 3 + 2]);
+        if( n.x() == 0 && n.y() == 0 && n.z() == 0 )
+            continue;
+
+        n = normalize( n );
+        _normals[i * 3 + 0] = n.x();
+        _normals[i * 3 + 1] = n.y();
+        _normals[i * 3 + 2] = n.z();
+    }
+
+    _bvh.build(boxes);
+}
+
+void PolygonMesh::loadOBJ(const string &filename)
+{
+    ifstream f(filename.c_str());
+    if( !f.is_open() )
+        throw "failed to open mesh file.";
+
+    string line;
+    vector<unsigned int> face;
+    while( getline(f, line) )
+    {
+        istringstream sline(line);
+        string tag;
+        sline >> tag;
+
+        if( tag == "v" )
+        {
+            Real x, y, z;
+            if( !(sline >> x >> y >> z) )
+                throw "invalid vertex in OBJ file.";
+            _vertices.push_back(x);
+            _vertices.push_back(y);
+            _vertices.push_back(z);
+        }
+        else if( tag == "f" )
+        {
+            // the vertex index comes before the first slash, indices start
+            // at 1, negative ones count back from the last vertex
+            face.clear();
+            string token;
+            while( sline >> token )
+            {
+                long idx = strtol(token.substr(0, token.find('/')).c_str(), 0, 10);
+                if( idx < 0 )
+                    idx += _vertices.size() / 3;
+                else
+                    idx -= 1;
+
+                // checked before it is narrowed to the index type, the
+                // range of the vertices is checked in setup
+                if( idx < 0 || (unsigned long)idx > UINT_MAX )
+                    throw "invalid face in OBJ file.";
+                face.push_back((unsigned int)idx);
+            }
+
+            for(size_t k=2;k<face.size();k++)
+            {
+                _triangles.push_back(face[0]);
+                _triangles.push_back(face[k - 1]);
+                _triangles.push_back(face[k]);
+            }
+        }
+    }
+}
+
+namespace
+{
+enum PLYFormat
+{
+    PLY_ASCII,
+    PLY_BINARY_LITTLE_ENDIAN,
+    PLY_BINARY_BIG_ENDIAN
+};
+
+enum PLYType
+{
+    PLY_CHAR, PLY_UCHAR, PLY_SHORT, PLY_USHORT,
+    PLY_INT, PLY_UINT, PLY_FLOAT, PLY_DOUBLE,
+    PLY_UNKNOWN
+};
+
+struct PLYProperty
+{
+    string name;
+    PLYType type;
+
+    // list properties have a count type in front of the values
+    bool isList;
+    PLYType countType;
+};
+
+struct PLYElement
+{
+    string name;
+    size_t count;
+    vector<PLYProperty> properties;
+};
+
+PLYType interpretPLYType(const string& str)
+{
+    if( str == "char" || str == "int8" ) return PLY_CHAR;
+    if( str == "uchar" || str == "uint8" ) return PLY_UCHAR;
+    if( str == "short" || str == "int16" ) return PLY_SHORT;
+    if( str == "ushort" || str == "uint16" ) return PLY_USHORT;
+    if( str == "int" || str == "int32" ) return PLY_INT;
+    if( str == "uint" || str == "uint32" ) return PLY_UINT;
+    if( str == "float" || str == "float32" ) return PLY_FLOAT;
+    if( str == "double" || str == "float64" ) return PLY_DOUBLE;
+    return PLY_UNKNOWN;
+}
+
+size_t sizeOfPLYType(PLYType type)
+{
+    switch( type )
+    {
+    case PLY_CHAR: case PLY_UCHAR: return 1;
+    case PLY_SHORT: case PLY_USHORT: return 2;
+    case PLY_INT: case PLY_UINT: case PLY_FLOAT: return 4;
+    case PLY_DOUBLE: return 8;
+    default: return 0;
+    }
+}
+
+bool isHostLittleEndian()
+{
+    unsigned short v = 1;
+    return *((unsigned char*)&v) == 1;
+}
+
+double readPLYValue(istream& s, PLYType type, PLYFormat format)
+{
+    if( format == PLY_ASCII )
+    {
+        double v;
+        if( !(s >> v) )
+            throw "unexpected end of PLY file.";
+        return v;
+    }
+
+    unsigned char bytes[8];
+    size_t size = sizeOfPLYType(type);
+    if( !s.read((char*)bytes, size) )
+        throw "unexpected end of PLY file.";
+
+    if( (format == PLY_BINARY_LITTLE_ENDIAN) != isHostLittleEndian() )
+    {
+        for(size_t i=0;i<size/2;i++)
+        {
+            unsigned char tmp = bytes[i];
+            bytes[i] = bytes[size - 1 - i];
+            bytes[size - 1 - i] = tmp;
+        }
+    }
+
+    switch( type )
+    {
+    case PLY_CHAR: { signed char v; memcpy(&v, bytes, 1); return v; }
+    case PLY_UCHAR: { unsigned char v; memcpy(&v, bytes, 1); return v; }
+    case PLY_SHORT: { short v; memcpy(&v, bytes, 2); return v; }
+    case PLY_USHORT: { unsigned short v; memcpy(&v, bytes, 2); return v; }
+    case PLY_INT: { int v; memcpy(&v, bytes, 4); return v; }
+    case PLY_UINT: { unsigned int v; memcpy(&v, bytes, 4); return v; }
+    case PLY_FLOAT: { float v; memcpy(&v, bytes, 4); return v; }
+    case PLY_DOUBLE: { double v; memcpy(&v, bytes, 8); return v; }
+    default: throw "unknown PLY property type.";
+    }
+}
+}
+
+void PolygonMesh::loadPLY(const string &filename)
+{
+    ifstream f(filename.c_str(), ios::in | ios::binary);
+    if( !f.is_open() )
+        throw "failed to open mesh file.";
+
+    string line;
+    getline(f, line);
+    if( line.compare(0, 3, "ply") != 0 )
+        throw "not a PLY file.";
+
+    // header
+    PLYFormat format = PLY_ASCII;
+    vector<PLYElement> elements;
+    while( true )
+    {
+        if( !getline(f, line) )
+            throw "unexpected end of PLY header.";
+
+        istringstream sline(line);
+        string tag;
+        sline >> tag;
+
+        if( tag == "format" )
+        {
+            string val;
+            sline >> val;
+            if( val == "ascii" )
+                format = PLY_ASCII;
+            else if( val == "binary_little_endian" )
+                format = PLY_BINARY_LITTLE_ENDIAN;
+            else if( val == "binary_big_endian" )
+                format = PLY_BINARY_BIG_ENDIAN;
+            else
+                throw "unknown PLY format.";
+        }
+        else if( tag == "element" )
+        {
+            PLYElement e;
+            sline >> e.name >> e.count;
+            elements.push_back(e);
+        }
+        else if( tag == "property" )
+        {
+            if( elements.empty() )
+                throw "PLY property outside of an element.";
+
+            PLYProperty p;
+            string type;
+            sline >> type;
+            if( type == "list" )
+            {
+                string countType, valueType;
+                sline >> countType >> valueType >> p.name;
+                p.isList = true;
+                p.countType = interpretPLYType(countType);
+                p.type = interpretPLYType(valueType);
+            }
+            else
+            {
+                sline >> p.name;
+                p.isList = false;
+                p.countType = PLY_UNKNOWN;
+                p.type = interpretPLYType(type);
+            }
+
+            if( p.type == PLY_UNKNOWN || (p.isList && p.countType == PLY_UNKNOWN) )
+                throw "unknown PLY property type.";
+            elements.back().properties.push_back(p);
+        }
+        else if( tag == "end_header" )
+            break;
+    }
+
+    // body, the elements come in the order of the header
+    vector<double> values;
+    vector<unsigned int> face;
+    for(size_t i=0;i<elements.size();i++)
+    {
+        const PLYElement& e = elements[i];
+        bool isVertex = (e.name == "vertex");
+        bool isFace = (e.name == "face");
+
+        int xyz[3] = { -1, -1, -1 };
+        if( isVertex )
+        {
+            for(size_t k=0;k<e.properties.size();k++)
+            {
+                if( e.properties[k].name == "x" ) xyz[0] = k;
+                if( e.properties[k].name == "y" ) xyz[1] = k;
+                if( e.properties[k].name == "z" ) xyz[2] = k;
+            }
+            if( xyz[0] < 0 || xyz[1] < 0 || xyz[2] < 0 )
+                throw "PLY vertices without positions.";
+            _vertices.reserve(e.count * 3);
+        }
+
+        for(size_t j=0;j<e.count;j++)
+        {
+            values.resize(e.properties.size());
+            for(size_t k=0;k<e.properties.size();k++)
+            {
+                const PLYProperty& p = e.properties[k];
+                if( !p.isList )
+                {
+                    values[k] = readPLYValue(f, p.type, format);
+                    continue;
+                }
+
+                size_t count = (size_t)readPLYValue(f, p.countType, format);
+                bool isIndexList = isFace && (p.name == "vertex_indices" || p.name == "vertex_index");
+                if( isIndexList )
+                    face.clear();
+                for(size_t l=0;l<count;l++)
+                {
+                    double v = readPLYValue(f, p.type, format);
+                    if( !isIndexList )
+                        continue;
+
+                    // checked before it is converted to the index type, the
+                    // range of the vertices is checked in setup
+                    if( !(v >= 0 && v <= UINT_MAX) )
+                        throw "invalid face in PLY file.";
+                    face.push_back((unsigned int)v);
+                }
+
+                if( isIndexList )
+                {
+                    for(size_t l=2;l<face.size();l++)
+                    {
+                        _triangles.push_back(face[0]);
+                        _triangles.push_back(face[l - 1]);
+                        _triangles.push_back(face[l]);
+                    }
+                }
+            }
+
+            if( isVertex )
+            {
+                _vertices.push_back(values[xyz[0]]);
+                _vertices.push_back(values[xyz[1]]);
+                _vertices.push_back(values[xyz[2]]);
+            }
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef POLYGONMESH_H
+#define POLYGONMESH_H
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "shape.h"
+#include "bvh.h"
+
+struct Transform;
+
+// ray prepared for the watertight ray/triangle test of Woop et al., the
+// vertices are translated to the ray origin and sheared so that the ray
+// runs along the z axis, edges shared by two triangles are then tested
+// identically for both and no ray slips through the mesh
+struct TriangleRay
+{
+    TriangleRay(const Ray& r);
+
+    Real org[3];
+    Real dir[3];
+    int kx, ky, kz;
+    Real sx, sy, sz;
+};
+
+// tests the triangle (v0, v1, v2) for a hit between tmin and tmax, returns
+// the distance and the barycentric weights of the three vertices
+bool intersectTriangle(const TriangleRay& r, const Real* v0, const Real* v1, const Real* v2,
+                       Real tmin, Real tmax, Real& t, Real bary[3]);
+
+// indexed triangle mesh, the triangles refer to a shared vertex buffer and
+// are organized in their own bounding volume hierarchy, so that a mesh of
+// any size is a single shape of the scene
+class PolygonMesh : public Shape
+{
+public:
+    PolygonMesh();
+    virtual ~PolygonMesh();
+
+    virtual bool intersect(const Ray &r, Hit &h);
+    virtual bool blockTest(const Ray &r, Real t);
+    virtual BoundingBox boundingBox() const;
+
+    // loads an OBJ or PLY file, told apart by the extension, polygons are
+    // split into triangle fans; the vertices are scaled and moved by the
+    // parameters read from the scene file
+    void load(const string& filename);
+
+    // uses transformed vertices, normals, triangles and a hierarchy built
+    // before, e.g. by a scene cache, in place, the buffers are not copied
+    // and must outlive the mesh
+    void attach(const Real* vertices, const Real* normals, size_t vertexNumber,
+                const unsigned int* triangles, size_t triangleNumber,
+                const BVHNode* nodes, size_t nodeNumber, const unsigned int* indices, size_t indexNumber);
+
+    // places the mesh with the transform applied to the vertices and
+    // normals as loaded, kept by the first call, and refits the hierarchy
+    void setTransform(const Transform& t);
+
+    const string& fileName() const { return _fileName; }
+
+    size_t vertexNumber() const { return _vertexNumber; }
+    size_t triangleNumber() const { return _triangleNumber; }
+
+    const Real* vertex(size_t idx) const { return _vertexArray + idx * 3; }
+    const Real* vertexNormal(size_t idx) const { return _normalArray + idx * 3; }
+    const unsigned int* triangle(size_t idx) const { return _triangleArray + idx * 3; }
+
+    const BVH& hierarchy() const { return _bvh; }
+
+    // mesh file, uniform scale and offset
+    friend istream& operator>>(istream&, PolygonMesh&);
+
+protected:
+    void loadOBJ(const string& filename);
+    void loadPLY(const string& filename);
+
+    // transforms the vertices, computes the vertex normals and builds the
+    // hierarchy, once the buffers are filled
+    void setup();
+
+private:
+    string _fileName;
+    Real _scale;
+    RealVector3D _offset;
+
+    // x, y, z of every vertex, and the area weighted vertex normals
+    vector<Real> _vertices;
+    vector<Real> _normals;
+
+    // three vertex indices per triangle
+    vector<unsigned int> _triangles;
+
+    // arrays read by the queries, the buffers above once loaded, or
+    // attached memory
+    const Real* _vertexArray;
+    const Real* _normalArray;
+    size_t _vertexNumber;
+    const unsigned int* _triangleArray;
+    size_t _triangleNumber;
+
+    BVH _bvh;
+
+    // vertices and normals as loaded, once the mesh is transformed, and the
+    // triangle boxes of the last refit
+    vector<Real> _restVertices;
+    vector<Real> _restNormals;
+    vector<BoundingBox> _triangleBoxes;
+};
+
+#endif // POLYGONMESH_H
@@ -0,0 +1,41 @@
+#include "raypacket.h"
+
+void RayPacket::load(const Ray *rays, size_t n)
+{
+    if( n > capacity )
+        n = capacity;
+    size = n;
+
+    for(size_t i=0;i<capacity;i++)
+    {
+        if( i < n )
+        {
+            const Ray& r = rays[i];
+            ox[i] = r.origin().x(), oy[i] = r.origin().y(), oz[i] = r.origin().z();
+
+            // same normalization as the scalar shape tests
+            Real x = r.dir().x(), y = r.dir().y(), z = r.dir().z();
+            Real l = sqrt(x * x + y * y + z * z);
+            if( l != 0 )
+            {
+                Real invLength = 1.0 / l;
+                x = x * invLength, y = y * invLength, z = z * invLength;
+            }
+            dx[i] = x, dy[i] = y, dz[i] = z;
+            t[i] = REAL_MAX;
+        }
+        else
+        {
+            ox[i] = oy[i] = oz[i] = 0;
+            dx[i] = 0, dy[i] = 0, dz[i] = 1;
+
+            // no shape reports a hit closer than zero
+            t[i] = 0;
+        }
+
+        idx[i] = 1.0 / dx[i];
+        idy[i] = 1.0 / dy[i];
+        idz[i] = 1.0 / dz[i];
+        shape[i] = -1;
+    }
+}
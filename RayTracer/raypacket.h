@@ -0,0 +1,51 @@
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include "raytracer.h"
+#include "simdutil.hpp"
+
+// number of rays traced together, a multiple of the simd width
+#ifndef RAY_PACKET_SIZE
+#define RAY_PACKET_SIZE 8
+#endif
+
+// vector pack of the core scalar type
+typedef SIMDUtils::PackOf<Real>::Type RealPack;
+
+// the packet loops step by whole packs, a partial pack would read past the
+// arrays of the packet
+#if __cplusplus >= 201103L
+static_assert(RAY_PACKET_SIZE % RealPack::width == 0,
+              "RAY_PACKET_SIZE must be a multiple of the simd width of Real");
+#else
+typedef char RayPacketSizeMultipleOfSimdWidth[RAY_PACKET_SIZE % RealPack::width == 0 ? 1 : -1];
+#endif
+
+// structure of arrays layout of a group of coherent rays, only used for the
+// primary rays, the directions are normalized when the packet is loaded
+struct RayPacket
+{
+    static const size_t capacity = RAY_PACKET_SIZE;
+
+    Real ox[RAY_PACKET_SIZE], oy[RAY_PACKET_SIZE], oz[RAY_PACKET_SIZE];
+    Real dx[RAY_PACKET_SIZE], dy[RAY_PACKET_SIZE], dz[RAY_PACKET_SIZE];
+    Real idx[RAY_PACKET_SIZE], idy[RAY_PACKET_SIZE], idz[RAY_PACKET_SIZE];
+
+    // nearest hit distance and the index of the shape hit, -1 for no hit
+    Real t[RAY_PACKET_SIZE];
+    int shape[RAY_PACKET_SIZE];
+
+    // number of valid rays, unused lanes can never record a hit
+    size_t size;
+
+    void load(const Ray* rays, size_t n);
+
+    // bits of the valid lanes among the width lanes starting at ray i, in
+    // the order of a move mask
+    int activeLanes(size_t i, int width) const
+    {
+        return size - i >= (size_t)width ? (1 << width) - 1 : (1 << (size - i)) - 1;
+    }
+};
+
+#endif // RAYPACKET_H
@@ -1,21 +1,92 @@
 #include "raytracer.h"
 #include "scene.h"
+#include "camerainfo.h"
+#include "raypacket.h"
+#include "lighttree.h"
+#include "utility.hpp"
 
 #include <cfloat>
+#include <algorithm>
+#include <QElapsedTimer>
+#include <QMetaType>
 
 #define USE_OPENMP 1
 
+namespace
+{
+// adds the wall time of its scope to a nanosecond counter, does nothing
+// when timing is off
+class ScopedTimer
+{
+public:
+    ScopedTimer(quint64& counter, bool enabled):
+        _counter(enabled ? &counter : 0)
+    {
+        if( _counter )
+            _timer.start();
+    }
+
+    ~ScopedTimer()
+    {
+        if( _counter )
+            *_counter += _timer.nsecsElapsed();
+    }
+
+private:
+    quint64* _counter;
+    QElapsedTimer _timer;
+};
+}
+
+QAtomicInt RayTracer::_lastStatisticsStamp = 0;
+
 RayTracer::RayTracer():
     _scene(0),
     _canvas(0),
-    _threaded(false),
+    _threaded(true),
+    _threadNumber(0),
+    _tileSize(32),
+    _pixelOrder(RowOrder),
     _isMSAAEnabled(true),
     _MSAASampleNumber(8),
-    _bgColor(DblColor4(1, 1, 1, 1)),
+    _samplingMode(FixedSampling),
+    _initialSampleNumber(2),
+    _maxSampleNumber(8),
+    _adaptiveThreshold(0.02),
+    _lightSelection(AllLights),
+    _lightSampleNumber(8),
+    _bgColor(RealColor4(1, 1, 1, 1)),
     _directLightingFactor(1),
     _reflectionFactor(0.25),
     _refractionFactor(0.8),
-    _maxIterations(16)
+    _maxIterations(16),
+    _iterativeTracing(true),
+    _contributionThreshold(1e-3),
+    _packetTracing(true),
+    _occluderCaching(true),
+    _workerFrame(0),
+    _busyWorkers(0),
+    _stopWorkers(false),
+    _outputFile("result.png"),
+    _threadStatisticsNumber(0),
+    _statisticsStamp(_lastStatisticsStamp.fetchAndAddOrdered(1) + 1),
+    _frame(0),
+    _timing(false),
+    _costRecording(false),
+    _progressive(false),
+    _previewBlockSize(8),
+    _previewPass(false),
+    _cancelled(0),
+    _isRendering(0),
+    _targetImage(0),
+    _targetX(0),
+    _targetY(0),
+    _frameWidth(0),
+    _frameHeight(0),
+    _renderImage(new FrameBuffer),
+    _bufferReuse(false),
+    _finishedTiles(0),
+    _totalTiles(0)
 {
     _shiftVector[0] = DblVector2D(0, 0);
     _shiftVector[1] = DblVector2D(-0.25, -0.5);
@@ -26,23 +97,164 @@ RayTracer::RayTracer():
     _shiftVector[5] = DblVector2D(-0.5, -0.75);
     _shiftVector[6] = DblVector2D(-0.75, -0.5);
     _shiftVector[7] = DblVector2D(-0.5, -0.5);
+
+    // adaptive sampling takes the shifts in this order, the first ones are
+    // spread over the whole pixel
+    int sampleOrder[8] = {0, 4, 7, 1, 2, 3, 5, 6};
+    for(int i=0;i<8;i++)
+        _adaptiveSampleOrder[i] = sampleOrder[i];
+
+    // passes rendered on a RenderThread are queued to their receivers
+    qRegisterMetaType<QSharedPointer<FrameBuffer> >("QSharedPointer<FrameBuffer>");
+}
+
+RayTracer::~RayTracer()
+{
+    stopWorkers();
+
+    for(size_t i=0;i<_threadStatistics.size();i++)
+        delete _threadStatistics[i];
+
+    for(size_t i=0;i<_tileBuffers.size();i++)
+        delete _tileBuffers[i];
+}
+
+void RayTracer::setSampleNumber(int n)
+{
+    if( n < 1 ) n = 1;
+    if( n > 8 ) n = 8;
+
+    _isMSAAEnabled = (n > 1);
+    _MSAASampleNumber = n;
+}
+
+RayStatistics& RayTracer::localStatistics()
+{
+    if( !_statisticsSlot.hasLocalData() )
+        _statisticsSlot.setLocalData(new StatisticsSlot);
+
+    StatisticsSlot* slot = _statisticsSlot.localData();
+    if( slot->stamp != _statisticsStamp )
+    {
+        QMutexLocker locker(&_statisticsMutex);
+        if( _threadStatisticsNumber == _threadStatistics.size() )
+            _threadStatistics.push_back(new RayStatistics);
+        slot->statistics = _threadStatistics[_threadStatisticsNumber++];
+        *slot->statistics = RayStatistics();
+        slot->stamp = _statisticsStamp;
+    }
+
+    return *(slot->statistics);
+}
+
+void RayTracer::resetStatistics()
+{
+    QMutexLocker locker(&_statisticsMutex);
+
+    _threadStatisticsNumber = 0;
+    _statisticsStamp = _lastStatisticsStamp.fetchAndAddOrdered(1) + 1;
+}
+
+void RayTracer::mergeStatistics()
+{
+    QMutexLocker locker(&_statisticsMutex);
+
+    _frameStatistics = RayStatistics();
+    for(size_t i=0;i<_threadStatisticsNumber;i++)
+        _frameStatistics += *_threadStatistics[i];
+}
+
+vector<RayStatistics> RayTracer::threadStatistics()
+{
+    QMutexLocker locker(&_statisticsMutex);
+
+    vector<RayStatistics> stats;
+    for(size_t i=0;i<_threadStatisticsNumber;i++)
+        stats.push_back(*_threadStatistics[i]);
+    return stats;
+}
+
+void RayTracer::recordPixelCost(size_t x, size_t y, float cost)
+{
+    // the previews do not cover the frame pixel by pixel
+    if( !_costRecording || _previewPass || _pixelCosts.empty() )
+        return;
+
+    _pixelCosts[y * _canvas->width + x] = cost;
+}
+
+FrameBuffer RayTracer::costHeatmap() const
+{
+    size_t width = _canvas ? _canvas->width : 0;
+    size_t height = _canvas ? _canvas->height : 0;
+    FrameBuffer image(width, height);
+    if( _pixelCosts.size() != width * height || _pixelCosts.empty() )
+        return image;
+
+    float maxCost = *max_element(_pixelCosts.begin(), _pixelCosts.end());
+    if( maxCost <= 0 )
+        maxCost = 1;
+
+    // blue, cyan, green, yellow, red
+    const Real ramp[5][3] = { {0, 0, 1}, {0, 1, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0} };
+
+    for(size_t i=0;i<height;i++)
+    {
+        for(size_t j=0;j<width;j++)
+        {
+            Real v = _pixelCosts[i * width + j] / maxCost * 4;
+            int k = (int)v;
+            if( k > 3 ) k = 3;
+            Real f = v - k;
+
+            RealColor4 c(ramp[k][0] * (1 - f) + ramp[k + 1][0] * f,
+                         ramp[k][1] * (1 - f) + ramp[k + 1][1] * f,
+                         ramp[k][2] * (1 - f) + ramp[k + 1][2] * f, 1);
+            image.setPixel(j, i, c);
+        }
+    }
+
+    return image;
 }
 
 void RayTracer::execute()
 {
+    _cancelled = 0;
+    _isRendering = 1;
+
+    // the slots of the previous frame are stale from here on
+    resetStatistics();
+    _frame++;
+
+    if( _costRecording )
+        _pixelCosts.assign(_canvas->width * _canvas->height, 0);
+    else
+        _pixelCosts.clear();
+
+    // camera basis is computed once per frame
+    _scene->cameraInfo().setup();
+
     if( _threaded )
     {
-        rayTracing_Threaded();
+        if( _progressive )
+            rayTracing_Progressive();
+        else
+            rayTracing_Threaded();
     }
     else
     {
         rayTracing();
     }
+
+    mergeStatistics();
+
+    _isRendering = 0;
 }
 
 void RayTracer::rayTracing()
 {
-    RGBAImage& image = (*_canvas->img);
+    QSharedPointer<FrameBuffer> buffer = frameBuffer();
+    FrameBuffer& image = (*buffer);
 
 #if !(USE_OPENMP)
     double accumulatedProgress = 0;
@@ -50,7 +262,7 @@ void RayTracer::rayTracing()
 #endif
 
 #if USE_OPENMP
-#pragma omp parallel for
+#pragma omp parallel for schedule(dynamic)
 #endif
     for(size_t i=0;i<image.height();i++)
     {
@@ -59,220 +271,1060 @@ void RayTracer::rayTracing()
         emit sig_progress(accumulatedProgress);
 #endif
 
-        float x;
-        float y = (float)i / (float)image.height();
         for(size_t j=0;j<image.width();j++)
         {
-            x = (float)j / (float)image.width();
+            image.setPixel(j, i, renderPixel(j, i));
+        }
+    }
 
-            if( _isMSAAEnabled )
-            {
-                DblColor4 finalColor(0, 0, 0, 0);
+    if( !_outputFile.empty() )
+        image.saveImage(_outputFile);
 
-                for(int k=0;k<_MSAASampleNumber;k++)
-                {
-                    DblPoint2D pos(x, y);
-                    pos.x() = pos.x() + _shiftVector[k].x() / image.width();
-                    pos.y() = pos.y() + _shiftVector[k].y() / image.height();
-                    Ray r = _scene->cameraInfo().generateRay(pos);
-                    r.order() = 0;
-                    Hit h;
-
-                    if( trace( r, h ) )
-                    {
-                        //cout << "(" << j << ", " << i << ")" << h.color() << endl;
-                        finalColor = finalColor + h.color().clamp(0.0, 1.0);
-                    }
-                    else
-                        finalColor = finalColor + _bgColor;
-                }
+    _renderImage = buffer;
+    emit sig_passFinished(buffer, 0, 1);
+}
+
+RealColor4 RayTracer::renderPixel(size_t j, size_t i)
+{
+    float x = (float)j / (float)_canvas->width;
+    float y = (float)i / (float)_canvas->height;
 
-                finalColor = finalColor / (double) _MSAASampleNumber;
+    RayStatistics& stats = localStatistics();
+    stats.primaryRays += _isMSAAEnabled ? _MSAASampleNumber : 1;
+    quint64 work = stats.work();
 
-                image.setPixel(j, i, finalColor.toRGBAPixel());
+    if( _isMSAAEnabled )
+    {
+        RealColor4 finalColor(0, 0, 0, 0);
+
+        for(int k=0;k<_MSAASampleNumber;k++)
+        {
+            DblPoint2D pos(x, y);
+            pos.x() = pos.x() + _shiftVector[k].x() / _canvas->width;
+            pos.y() = pos.y() + _shiftVector[k].y() / _canvas->height;
+            Ray r = _scene->cameraInfo().generateRay(pos);
+            r.order() = 0;
+            Hit h;
+
+            if( trace( r, h ) )
+            {
+                //cout << "(" << j << ", " << i << ")" << h.color() << endl;
+                finalColor = finalColor + h.color().clamp(0.0, 1.0);
             }
             else
-            {
-                DblPoint2D pos(x, y);
-                Ray r = _scene->cameraInfo().generateRay(pos);
-                r.order() = 0;
-                Hit h;
+                finalColor = finalColor + _bgColor;
+        }
 
-                if( trace( r, h ) )
-                {
-                    //cout << "(" << j << ", " << i << ")" << h.color() << endl;
-                    image.setPixel(j, i, h.color().clamp(0.0, 1.0).toRGBAPixel());
-                }
-                else
-                    image.setPixel(j, i, _bgColor.toRGBAPixel());
+        recordPixelCost(j, i, stats.work() - work);
+        return finalColor / (double) _MSAASampleNumber;
+    }
+    else
+    {
+        DblPoint2D pos(x, y);
+        Ray r = _scene->cameraInfo().generateRay(pos);
+        r.order() = 0;
+        Hit h;
+
+        bool hit = trace( r, h );
+        recordPixelCost(j, i, stats.work() - work);
+
+        if( hit )
+        {
+            //cout << "(" << j << ", " << i << ")" << h.color() << endl;
+            return h.color().clamp(0.0, 1.0);
+        }
+        else
+            return _bgColor;
+    }
+}
+
+bool RayTracer::trace(const Ray &r, Hit &h)
+{
+    ScopedTimer timer(localStatistics().traceTime, _timing);
+
+    if( _iterativeTracing )
+        return trace_Iterative( r, h );
+    else
+        return trace_Recursive( r, h );
+}
+
+bool RayTracer::trace_Recursive(const Ray &r, Hit &h)
+{
+    RayStatistics& stats = localStatistics();
+    if( r.order() > 0 )
+        stats.secondaryRays++;
+    if( r.order() > stats.maxDepth )
+        stats.maxDepth = r.order();
+
+    bool hit;
+    {
+        ScopedTimer timer(stats.intersectTime, _timing);
+        hit = _scene->intersect(r, h, &stats);
+    }
+
+    if( hit )
+    {
+        shade_Recursive( r, h );
+        return true;
+    }
+    else
+    {
+        h.color() = _bgColor;
+        return false;
+    }
+}
+
+void RayTracer::shade_Recursive(const Ray &r, Hit &h)
+{
+    // termination for maximum iterations
+    if( r.order() >= _maxIterations )
+    {
+        h.color() = evaluateLighting( r, h );
+        return;
+    }
+
+    bool compositionFlag[2] = {false};
+
+    Hit reflectedHit;
+    Hit refractedHit;
+
+    // has reflected ray
+    if( h.reflected() )
+    {
+        // trace reflected ray
+        Ray reflectedRay = reflect( r, h );
+        reflectedRay.order() = r.order() + 1;
+
+        if( trace_Recursive( reflectedRay, reflectedHit ) )
+        {
+            compositionFlag[0] = true;
+
+            // inner reflection
+            const Real ZERO_THRESHD = 1e-9;
+            if( abs(r.refractionRate() - h.refractionRate()) < ZERO_THRESHD
+            && r.refractionRate() > 1 )
+            {
+                // reduce the intensity of inner reflection
+                reflectedHit.color() = reflectedHit.color() * 0.25;
             }
         }
     }
 
-    image.saveImage("result.png");
+    // has refracted ray
+    if( h.refracted() )
+    {
+        // trace refracted ray
+        Ray refractedRay = refract( r, h );
+        refractedRay.order() = r.order() + 1;
 
-    _renderImage = image;
+        if( trace_Recursive( refractedRay, refractedHit ) )
+        {
+            compositionFlag[1] = true;
+            refractedHit.color() = RealColor4::blend(refractedHit.color(), h.color());
+        }
+    }
+
+    // composite the colors
+    RealColor4 directLighting = evaluateLighting( r, h );
+
+    if( compositionFlag[1] )
+    {
+        h.color() = (directLighting * _directLightingFactor
+                     + reflectedHit.color() * _reflectionFactor
+                     + refractedHit.color() * _refractionFactor);
+    }
+    else if( compositionFlag[0] )
+    {
+        h.color() = (directLighting * _directLightingFactor
+                     + reflectedHit.color() * _reflectionFactor);
+    }
+    else
+        h.color() = directLighting;
 }
 
-bool RayTracer::trace(const Ray &r, Hit &h)
+namespace
 {
-    if( _scene->intersect(r, h) )
+// pending node of the ray tree, the hit is already resolved
+struct RayTreeNode
+{
+    Ray ray;
+    Hit hit;
+    Real weight;
+};
+
+// ray trees are at most _maxIterations + 1 deep, and every level leaves at
+// most one sibling on the stack
+const size_t RAY_TREE_STACK_SIZE = 32;
+}
+
+bool RayTracer::trace_Iterative(const Ray &r, Hit &h)
+{
+    RayStatistics& stats = localStatistics();
+
+    bool hit;
+    {
+        ScopedTimer timer(stats.intersectTime, _timing);
+        hit = _scene->intersect(r, h, &stats);
+    }
+
+    if( !hit )
+    {
+        h.color() = _bgColor;
+        return false;
+    }
+
+    evaluateRayTree(r, h);
+    return true;
+}
+
+void RayTracer::shadeHit(const Ray &r, Hit &h)
+{
+    ScopedTimer timer(localStatistics().traceTime, _timing);
+
+    if( _iterativeTracing )
+        evaluateRayTree(r, h);
+    else
+        shade_Recursive(r, h);
+}
+
+void RayTracer::evaluateRayTree(const Ray &r, Hit &h)
+{
+    RayTreeNode stack[RAY_TREE_STACK_SIZE];
+    size_t stackSize = 0;
+
+    stack[0].ray = r;
+    stack[0].hit = h;
+    stack[0].weight = 1.0;
+    stackSize = 1;
+
+    RealColor4 accuColor(0, 0, 0, 0);
+
+    RayStatistics& stats = localStatistics();
+
+    while( stackSize > 0 )
     {
+        stackSize--;
+        Ray curRay = stack[stackSize].ray;
+        Hit curHit = stack[stackSize].hit;
+        Real weight = stack[stackSize].weight;
+
+        if( curRay.order() > stats.maxDepth )
+            stats.maxDepth = curRay.order();
+
         // termination for maximum iterations
-        if( r.order() >= _maxIterations )
+        if( curRay.order() >= _maxIterations
+         || stackSize + 2 > RAY_TREE_STACK_SIZE )
         {
-            h.color() = evaluateLighting( r, h );
-            return true;
+            accuColor = accuColor + evaluateLighting( curRay, curHit ) * weight;
+            continue;
         }
 
+        // resolve both branches first, the composition depends on which of them hit
         bool compositionFlag[2] = {false};
 
-        Hit reflectedHit;
-        Hit refractedHit;
+        Ray reflectedRay, refractedRay;
+        Hit reflectedHit, refractedHit;
 
-        // has reflected ray
-        if( h.reflected() )
+        if( curHit.reflected() )
         {
-            // trace reflected ray
-            Ray reflectedRay = reflect( r, h );
-            reflectedRay.order() = r.order() + 1;
+            reflectedRay = reflect( curRay, curHit );
+            reflectedRay.order() = curRay.order() + 1;
+            ScopedTimer timer(stats.intersectTime, _timing);
+            compositionFlag[0] = _scene->intersect( reflectedRay, reflectedHit, &stats );
+            stats.secondaryRays++;
+        }
 
-            if( trace( reflectedRay, reflectedHit ) )
-            {
-                compositionFlag[0] = true;
+        if( curHit.refracted() )
+        {
+            refractedRay = refract( curRay, curHit );
+            refractedRay.order() = curRay.order() + 1;
+            ScopedTimer timer(stats.intersectTime, _timing);
+            compositionFlag[1] = _scene->intersect( refractedRay, refractedHit, &stats );
+            stats.secondaryRays++;
+        }
 
-                // inner reflection
-                const double ZERO_THRESHD = 1e-9;
-                if( abs(r.refractionRate() - h.refractionRate()) < ZERO_THRESHD
-                && r.refractionRate() > 1 )
-                {
-                    // reduce the intensity of inner reflection
-                    reflectedHit.color() = reflectedHit.color() * 0.25;
-                }
-            }
+        RealColor4 directLighting = evaluateLighting( curRay, curHit );
+
+        if( !compositionFlag[0] && !compositionFlag[1] )
+        {
+            accuColor = accuColor + directLighting * weight;
+            continue;
         }
 
-        // has refracted ray
-        if( h.refracted() )
+        accuColor = accuColor + directLighting * (_directLightingFactor * weight);
+
+        Real reflectedWeight = weight * _reflectionFactor;
+        if( compositionFlag[0] )
         {
-            // trace refracted ray
-            Ray refractedRay = refract( r, h );
-            refractedRay.order() = r.order() + 1;
+            // reduce the intensity of inner reflection
+            const Real ZERO_THRESHD = 1e-9;
+            if( abs(curRay.refractionRate() - curHit.refractionRate()) < ZERO_THRESHD
+            && curRay.refractionRate() > 1 )
+                reflectedWeight *= 0.25;
+        }
 
-            if( trace( refractedRay, refractedHit ) )
+        if( compositionFlag[1] )
+        {
+            // a missed reflected ray still contributes the background
+            if( !compositionFlag[0] && curHit.reflected() )
+                accuColor = accuColor + _bgColor * reflectedWeight;
+
+            // the refracted color is blended with the surface color
+            Real alpha = curHit.color().a();
+            accuColor = accuColor + curHit.color() * (alpha * weight * _refractionFactor);
+
+            Real refractedWeight = weight * _refractionFactor * (1.0 - alpha);
+            if( refractedWeight >= _contributionThreshold )
             {
-                compositionFlag[1] = true;
-                refractedHit.color() = DblColor4::blend(refractedHit.color(), h.color());
+                stack[stackSize].ray = refractedRay;
+                stack[stackSize].hit = refractedHit;
+                stack[stackSize].weight = refractedWeight;
+                stackSize++;
             }
         }
 
-        // composite the colors
-        DblColor4 directLighting = evaluateLighting( r, h );
+        if( compositionFlag[0] && reflectedWeight >= _contributionThreshold )
+        {
+            stack[stackSize].ray = reflectedRay;
+            stack[stackSize].hit = reflectedHit;
+            stack[stackSize].weight = reflectedWeight;
+            stackSize++;
+        }
+    }
 
-        if( compositionFlag[1] )
+    h.color() = accuColor;
+}
+
+// hit point of a ray being lit, with what every light needs of it
+struct ShadingPoint
+{
+    const Hit* hit;
+    RealPoint3D pos;
+    RealVector3D normal;
+    RealVector3D toEye;
+    vector<int>* occluders;
+    RayStatistics* stats;
+};
+
+namespace
+{
+// numbers in [0, 1) hashed from a shading point and a salt, so that a
+// frame samples its lights the same whatever the thread schedule
+inline quint32 hashPoint(const RealPoint3D& p, quint32 salt)
+{
+    const Real v[3] = { p.x(), p.y(), p.z() };
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(v);
+
+    quint32 h = 2166136261u ^ salt;
+    for(size_t i=0;i<sizeof(v);i++)
+        h = (h ^ bytes[i]) * 16777619u;
+
+    h ^= h >> 16; h *= 0x7feb352du;
+    h ^= h >> 15; h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+inline Real unitValue(quint32 h)
+{
+    return (h >> 8) * (1.0 / 16777216.0);
+}
+}
+
+RealColor4 RayTracer::evaluateLighting(const Ray &r, const Hit &h)
+{
+    ShadingPoint sp;
+    sp.hit = &h;
+    sp.pos = r.origin() + r.dir() * h.t();
+    sp.normal = normalize( h.normal() );
+
+    const DblPoint3D& eyePos = _scene->cameraInfo()._pos;
+    RealPoint3D eye(eyePos.x(), eyePos.y(), eyePos.z());
+    sp.toEye = normalize( eye - sp.pos );
+
+    size_t lightNumber = _scene->lightSourcesNumber();
+
+    sp.occluders = 0;
+    if( _occluderCaching )
+    {
+        if( !_occluderCache.hasLocalData() )
+            _occluderCache.setLocalData(new vector<int>);
+        sp.occluders = _occluderCache.localData();
+        if( sp.occluders->size() != lightNumber )
+            sp.occluders->assign(lightNumber, -1);
+    }
+
+    RayStatistics& stats = localStatistics();
+    ScopedTimer timer(stats.lightingTime, _timing);
+    sp.stats = &stats;
+
+    RealColor4 accuVal(0, 0, 0, 1);
+
+    const LightTree* tree = _scene->lightTree();
+    if( _lightSelection == SampledLights && tree && lightNumber > (size_t)_lightSampleNumber )
+    {
+        // a few lights picked by their estimated contribution, each weighted
+        // by the inverse of its probability, so that on average the sum is
+        // the one over all lights; the picks are stratified over [0, 1)
+        stats.shadowRays += _lightSampleNumber;
+
+        Real u0 = unitValue(hashPoint(sp.pos, 0));
+        for(int k=0;k<_lightSampleNumber;k++)
         {
-            h.color() = (directLighting * _directLightingFactor
-                         + reflectedHit.color() * _reflectionFactor
-                         + refractedHit.color() * _refractionFactor);
+            Real u = u0 + (Real)k / _lightSampleNumber;
+            if( u >= 1 ) u -= 1;
+
+            Real pdf;
+            int idx = tree->sample(sp.pos, u, pdf);
+            if( idx >= 0 && pdf > 0 )
+                addLight(idx, 1.0 / (pdf * _lightSampleNumber), sp, accuVal);
         }
-        else if( compositionFlag[0] )
+    }
+    else
+    {
+        // go through all light sources
+        stats.shadowRays += lightNumber;
+        for(size_t i=0;i<lightNumber;i++)
+            addLight(i, 1.0, sp, accuVal);
+    }
+
+    accuVal = accuVal / (Real) lightNumber;
+    accuVal.a() = 1;
+
+    return accuVal;
+}
+
+void RayTracer::addLight(size_t idx, Real weight, const ShadingPoint &sp, RealColor4 &accuVal)
+{
+    // object property
+    RealColor4 m_ambient(0.05, 0.05, 0.05, 1.0);
+    RealColor4 m_diffuse = sp.hit->color();
+    RealColor4 m_specular(1.0, 1.0, 1.0, 1.0);
+    Real m_shininess = 50.0;
+
+    const Hit& h = *sp.hit;
+    const RealPoint3D& hitPoint = sp.pos;
+    const RealVector3D& N = sp.normal;
+    RayStatistics& stats = *sp.stats;
+
+    const LightSource& l = _scene->lightSource(idx);
+
+    // lights with an extent are lit from a point sampled on them
+    RealPoint3D lightPos = l._pos;
+    if( l._type != LightSource::POINT )
+    {
+        quint32 hash = hashPoint(hitPoint, 2 * idx + 1);
+        lightPos = l.samplePoint(hitPoint, unitValue(hash), unitValue(hashPoint(hitPoint, hash)));
+    }
+
+    RealVector3D L = lightPos - hitPoint;
+
+    Real distLH = length( L );
+    Ray rayLH;
+    rayLH.dir() = normalize(L);
+    rayLH.origin() = hitPoint;
+
+    bool isTranslucent = false;
+    RealColor4 lightColor = l._color;
+    int* occluder = sp.occluders ? &(*sp.occluders)[idx] : 0;
+    bool blocked;
+    {
+        ScopedTimer blockTimer(stats.blockTestTime, _timing);
+        blocked = _scene->blockTest( rayLH, distLH, isTranslucent, lightColor, occluder, &stats );
+    }
+
+    if( blocked )
+    {
+        if( !isTranslucent )
+            return;
+    }
+    else
+        lightColor = l._color;
+
+    Real d = length( L );
+    Real att = LightTree::attenuation(d);
+    L = normalize( L );
+
+    const RealVector3D& E = sp.toEye;
+
+    Real NdotL = dotProduct(N, L);
+    if( NdotL < 0 ) NdotL = 0;
+
+    RealColor4 Iamb = RealColor4(m_ambient.r() * h.color().r(),
+                               m_ambient.g() * h.color().g(),
+                               m_ambient.b() * h.color().b(),
+                               m_ambient.a() * h.color().a());
+
+    RealVector3D R = normalize( 2.0 * NdotL * N - L );
+
+    RealColor4 Idiff = m_diffuse * NdotL;
+
+    Real RdotE = dotProduct(R, E);
+    if( RdotE < 0 ) RdotE = 0;
+    RealColor4 Ispec = m_specular * pow( RdotE, m_shininess );
+
+    Real intensityFactor = 1.0;
+    if( isTranslucent )
+        intensityFactor = lightColor.a();
+    accuVal = accuVal
+            + (Idiff + Ispec + Iamb) * att * intensityFactor * powf(intensityFactor, 2.0) * weight
+            + (1.0 - powf(intensityFactor, 2.0) ) * lightColor * weight;
+}
+
+int RayTracer::threadNumber() const
+{
+    int threadNumber = _threadNumber;
+    if( threadNumber <= 0 )
+        threadNumber = QThread::idealThreadCount();
+    if( threadNumber <= 0 )
+        threadNumber = 1;
+
+    return threadNumber;
+}
+
+QSharedPointer<FrameBuffer> RayTracer::frameBuffer()
+{
+    if( _bufferReuse && !_renderImage.isNull()
+     && _renderImage->width() == _canvas->width && _renderImage->height() == _canvas->height )
+        return _renderImage;
+
+    // otherwise the frame is rendered into a new buffer, so that the
+    // previous result stays valid for whoever still holds it
+    return QSharedPointer<FrameBuffer>(new FrameBuffer(_canvas->width, _canvas->height));
+}
+
+void RayTracer::rayTracing_Threaded()
+{
+    QSharedPointer<FrameBuffer> image = frameBuffer();
+
+    _finishedTiles = 0;
+    _totalTiles = TileScheduler::countTiles(image->width(), image->height(), _tileSize);
+
+    renderTiles(*image, threadNumber());
+
+    _renderImage = image;
+    if( isCancelled() )
+        return;
+
+    if( !_outputFile.empty() )
+        image->saveImage(_outputFile);
+
+    emit sig_passFinished(image, 0, 1);
+}
+
+void RayTracer::rayTracing_Progressive()
+{
+    size_t width = _canvas->width, height = _canvas->height;
+
+    // preview passes at 1/blockSize of the resolution, then the full frame
+    vector<size_t> blockSizes;
+    for(int b=_previewBlockSize;b>1;b/=2)
+        blockSizes.push_back(b);
+    blockSizes.push_back(1);
+
+    int passNumber = blockSizes.size();
+
+    _finishedTiles = 0;
+    _totalTiles = 0;
+    for(int pass=0;pass<passNumber;pass++)
+    {
+        size_t b = blockSizes[pass];
+        _totalTiles += TileScheduler::countTiles((width + b - 1) / b, (height + b - 1) / b, _tileSize);
+    }
+
+    int threads = threadNumber();
+
+    for(int pass=0;pass<passNumber && !isCancelled();pass++)
+    {
+        size_t b = blockSizes[pass];
+        QSharedPointer<FrameBuffer> image(new FrameBuffer(width, height));
+
+        if( b == 1 )
         {
-            h.color() = (directLighting * _directLightingFactor
-                         + reflectedHit.color() * _reflectionFactor);
+            renderTiles(*image, threads);
         }
         else
-            h.color() = directLighting;
+        {
+            // previews take one sample per pixel, the low resolution image
+            // is scaled up to the frame size
+            FrameBuffer preview((width + b - 1) / b, (height + b - 1) / b);
 
-        return true;
+            _previewPass = true;
+            renderTiles(preview, threads);
+            _previewPass = false;
+
+            for(size_t i=0;i<height;i++)
+                for(size_t j=0;j<width;j++)
+                    image->setPixel(j, i, preview.pixel(j / b, i / b));
+        }
+
+        // a pass interrupted halfway is dropped, the previous one is kept
+        if( isCancelled() )
+            break;
+
+        _renderImage = image;
+        emit sig_passFinished(image, pass, passNumber);
     }
-    else
+
+    if( !isCancelled() && !_outputFile.empty() )
+        _renderImage->saveImage(_outputFile);
+}
+
+void RayTracer::renderRegion(const Tile &region, FrameBuffer &image)
+{
+    if( region.x + region.width > _canvas->width || region.y + region.height > _canvas->height
+     || image.width() != region.width || image.height() != region.height )
+        throw "render region out of the frame.";
+
+    _cancelled = 0;
+    _isRendering = 1;
+
+    resetStatistics();
+    _frame++;
+    _pixelCosts.clear();
+
+    _scene->cameraInfo().setup();
+
+    _finishedTiles = 0;
+    _totalTiles = TileScheduler::countTiles(region.width, region.height, _tileSize);
+
+    renderTiles(image, threadNumber(), &region);
+
+    mergeStatistics();
+
+    _isRendering = 0;
+}
+
+void RayTracer::renderTiles(FrameBuffer &image, int threadNumber, const Tile* region)
+{
+    _scheduler.setup(image.width(), image.height(), _tileSize, threadNumber);
+
+    _targetImage = &image;
+    _targetX = region ? region->x : 0;
+    _targetY = region ? region->y : 0;
+    _frameWidth = region ? _canvas->width : image.width();
+    _frameHeight = region ? _canvas->height : image.height();
+
+    while( _tileBuffers.size() < (size_t)threadNumber )
+        _tileBuffers.push_back(new TileBuffers);
+
+    startWorkers(threadNumber);
+
+    // wakes the pool once and waits until every thread is done
     {
-        h.color() = _bgColor;
-        return false;
+        QMutexLocker locker(&_workerMutex);
+        _busyWorkers = _workers.size();
+        _workerFrame++;
+        _frameStarted.wakeAll();
+
+        while( _busyWorkers > 0 )
+            _frameDone.wait(&_workerMutex);
     }
+
+    _targetImage = 0;
 }
 
-DblColor4 RayTracer::evaluateLighting(const Ray &r, const Hit &h)
+void RayTracer::startWorkers(int threadNumber)
 {
-    double constantAtt, linearAtt, quadraticAtt;
-    constantAtt = 1;
-    linearAtt = 0.025;
-    quadraticAtt = 0.0005;
+    if( _workers.size() == (size_t)threadNumber )
+        return;
 
-    // object property
-    DblColor4 m_ambient(0.05, 0.05, 0.05, 1.0);
-    DblColor4 m_diffuse = h.color();
-    DblColor4 m_specular(1.0, 1.0, 1.0, 1.0);
-    double m_shininess = 50.0;
+    stopWorkers();
 
-    DblPoint3D hitPoint = r.origin() + r.dir() * h.t();
-    DblVector3D N = normalize( h.normal() );
+    // a restarted pool joins at the current frame, the threads must not
+    // take the frame already rendered for the next one
+    int frame;
+    {
+        QMutexLocker locker(&_workerMutex);
+        frame = _workerFrame;
+    }
 
-    DblColor4 accuVal(0, 0, 0, 1);
+    for(int i=0;i<threadNumber;i++)
+    {
+        _workers.push_back(new RayTracingThread(this, &_scheduler, i, frame));
+        _workers.back()->start();
+    }
+}
 
-    // go through all light sources
-    for(size_t i=0;i<_scene->lightSourcesNumber();i++)
+void RayTracer::stopWorkers()
+{
     {
-        const LightSource& l = _scene->lightSource(i);
+        QMutexLocker locker(&_workerMutex);
+        _stopWorkers = true;
+        _frameStarted.wakeAll();
+    }
+
+    for(size_t i=0;i<_workers.size();i++)
+    {
+        _workers[i]->wait();
+        delete _workers[i];
+    }
+    _workers.clear();
 
-        DblVector3D L = l._pos - hitPoint;
+    _stopWorkers = false;
+}
+
+bool RayTracer::waitForFrame(int &frame)
+{
+    QMutexLocker locker(&_workerMutex);
+    while( !_stopWorkers && _workerFrame == frame )
+        _frameStarted.wait(&_workerMutex);
 
-        double distLH = length( L );
-        Ray rayLH;
-        rayLH.dir() = normalize(L);
-        rayLH.origin() = hitPoint;
+    frame = _workerFrame;
+    return !_stopWorkers;
+}
+
+void RayTracer::workerFinished()
+{
+    QMutexLocker locker(&_workerMutex);
+    if( --_busyWorkers == 0 )
+        _frameDone.wakeAll();
+}
+
+void RayTracer::traceRays(const Ray *rays, size_t n, RealColor4 *colors, float *costs)
+{
+    RayStatistics& stats = localStatistics();
+    stats.primaryRays += n;
 
-        bool isTranslucent = false;
-        DblColor4 lightColor = l._color;
-        if( _scene->blockTest( rayLH, distLH, isTranslucent, lightColor ) )
+    if( _packetTracing )
+    {
+        for(size_t p=0;p<n;p+=RAY_PACKET_SIZE)
         {
-            if( !isTranslucent )
-                continue;
+            size_t m = n - p;
+            if( m > RAY_PACKET_SIZE )
+                m = RAY_PACKET_SIZE;
+
+            Hit hits[RAY_PACKET_SIZE];
+            bool flags[RAY_PACKET_SIZE];
+            quint64 work = stats.work();
+            {
+                ScopedTimer timer(stats.intersectTime, _timing);
+                _scene->intersectPacket(&rays[p], m, hits, flags, &stats);
+            }
+
+            // the packet traversal is shared evenly by its rays
+            float packetCost = (float)(stats.work() - work) / m;
+
+            // secondary rays are incoherent, they go through the scalar path
+            for(size_t l=0;l<m;l++)
+            {
+                work = stats.work();
+                if( flags[l] )
+                {
+                    shadeHit( rays[p + l], hits[l] );
+                    colors[p + l] = hits[l].color().clamp(0.0, 1.0);
+                }
+                else
+                    colors[p + l] = _bgColor;
+
+                if( costs )
+                    costs[p + l] = packetCost + (stats.work() - work);
+            }
+        }
+    }
+    else
+    {
+        for(size_t p=0;p<n;p++)
+        {
+            quint64 work = stats.work();
+
+            Hit h;
+            if( trace( rays[p], h ) )
+                colors[p] = h.color().clamp(0.0, 1.0);
             else
-                ;
+                colors[p] = _bgColor;
+
+            if( costs )
+                costs[p] = stats.work() - work;
         }
-        else
-            lightColor = l._color;
+    }
+}
+
+void RayTracer::traceRays_Ordered(const Ray *rays, size_t n, TileBuffers &buffers,
+                                  RealColor4 *colors, float *costs)
+{
+    if( _pixelOrder == RowOrder )
+    {
+        traceRays(rays, n, colors, costs);
+        return;
+    }
+
+    const vector<size_t>& order = buffers.order;
 
-        double d = length( L );
-        double att = 1.0 / ( constantAtt + linearAtt * d + quadraticAtt * d * d);
-        L = normalize( L );
+    buffers.orderedRays.resize(n);
+    buffers.orderedColors.resize(n);
+    buffers.orderedCosts.resize(costs ? n : 0);
 
-        DblVector3D E = normalize( _scene->cameraInfo()._pos - hitPoint );
+    for(size_t p=0;p<n;p++)
+        buffers.orderedRays[p] = rays[order[p]];
 
-        double NdotL = dotProduct(N, L);
-        if( NdotL < 0 ) NdotL = 0;
+    traceRays(&buffers.orderedRays[0], n, &buffers.orderedColors[0],
+              costs ? &buffers.orderedCosts[0] : 0);
 
-        DblColor4 Iamb = DblColor4(m_ambient.r() * h.color().r(),
-                                   m_ambient.g() * h.color().g(),
-                                   m_ambient.b() * h.color().b(),
-                                   m_ambient.a() * h.color().a());
+    for(size_t p=0;p<n;p++)
+        colors[order[p]] = buffers.orderedColors[p];
 
-        DblVector3D R = normalize( 2.0 * NdotL * N - L );
+    for(size_t p=0;p<buffers.orderedCosts.size();p++)
+        costs[order[p]] = buffers.orderedCosts[p];
+}
+
+namespace
+{
+// the pixel order of the tile size, computed again only when it changes
+void updatePixelOrder(TileBuffers& buffers, PixelOrder order, const Tile& t)
+{
+    if( order == RowOrder )
+        return;
+
+    if( buffers.orderType != order || buffers.orderWidth != t.width || buffers.orderHeight != t.height )
+    {
+        pixelOrder(order, t.width, t.height, buffers.order);
+        buffers.orderType = order;
+        buffers.orderWidth = t.width;
+        buffers.orderHeight = t.height;
+    }
+}
+}
 
-        DblColor4 Idiff = m_diffuse * NdotL;
+void RayTracer::renderTile(const Tile &t, TileBuffers &buffers)
+{
+    FrameBuffer& image = (*_targetImage);
 
-        double RdotE = dotProduct(R, E);
-        if( RdotE < 0 ) RdotE = 0;
-        DblColor4 Ispec = m_specular * pow( RdotE, m_shininess );
+    bool isMSAAEnabled = _isMSAAEnabled && !_previewPass;
 
-        double intensityFactor = 1.0;
-        if( isTranslucent )
-            intensityFactor = lightColor.a();
-        accuVal = accuVal
-                + (Idiff + Ispec + Iamb) * att * intensityFactor * powf(intensityFactor, 2.0)
-                + (1.0 - powf(intensityFactor, 2.0) ) * lightColor;
+    if( isMSAAEnabled && _samplingMode == AdaptiveSampling )
+    {
+        renderTile_Adaptive(t, buffers);
+        return;
     }
 
-    accuVal = accuVal / (double) _scene->lightSourcesNumber();
-    accuVal.a() = 1;
+    const CameraInfo& camInfo = _scene->cameraInfo();
 
-    return accuVal;
+    // position of the tile in the frame
+    size_t x0 = _targetX + t.x, y0 = _targetY + t.y;
+
+    size_t pixelNumber = t.width * t.height;
+    vector<Ray>& rays = buffers.rays;
+    vector<RealColor4>& samples = buffers.samples;
+    vector<RealColor4>& colors = buffers.colors;
+    rays.resize(pixelNumber);
+    samples.resize(pixelNumber);
+    colors.assign(pixelNumber, RealColor4(0, 0, 0, 0));
+
+    bool recordCosts = _costRecording && !_previewPass;
+    vector<float>& sampleCosts = buffers.sampleCosts;
+    vector<float>& costs = buffers.costs;
+    sampleCosts.resize(recordCosts ? pixelNumber : 0);
+    costs.assign(recordCosts ? pixelNumber : 0, 0);
+
+    int sampleNumber = isMSAAEnabled ? _MSAASampleNumber : 1;
+
+    updatePixelOrder(buffers, _pixelOrder, t);
+
+    // one batch of primary rays per sample
+    for(int k=0;k<sampleNumber;k++)
+    {
+        DblVector2D shift = isMSAAEnabled ? _shiftVector[k] : DblVector2D(0, 0);
+        camInfo.generateRays(x0, y0, t.width, t.height,
+                             _frameWidth, _frameHeight,
+                             shift, &rays[0]);
+
+        traceRays_Ordered(&rays[0], pixelNumber, buffers, &samples[0], recordCosts ? &sampleCosts[0] : 0);
+
+        for(size_t p=0;p<pixelNumber;p++)
+            colors[p] = colors[p] + samples[p];
+
+        for(size_t p=0;p<costs.size();p++)
+            costs[p] += sampleCosts[p];
+    }
+
+    for(size_t i=0;i<t.height;i++)
+    {
+        for(size_t j=0;j<t.width;j++)
+        {
+            RealColor4 c = colors[i * t.width + j] / (double) sampleNumber;
+            image.setPixel(t.x + j, t.y + i, c);
+
+            if( recordCosts )
+                recordPixelCost(x0 + j, y0 + i, costs[i * t.width + j]);
+        }
+    }
 }
 
-void RayTracer::rayTracing_Threaded()
+namespace
+{
+inline double luminance(const RealColor4& c)
+{
+    return Utils::convertToGrayScaleValue(c.r(), c.g(), c.b());
+}
+}
+
+void RayTracer::renderTile_Adaptive(const Tile &t, TileBuffers &buffers)
 {
+    FrameBuffer& image = (*_targetImage);
+    const CameraInfo& camInfo = _scene->cameraInfo();
+
+    size_t x0 = _targetX + t.x, y0 = _targetY + t.y;
+
+    size_t pixelNumber = t.width * t.height;
+    vector<Ray>& rays = buffers.rays;
+    vector<RealColor4>& samples = buffers.samples;
+    vector<RealColor4>& colors = buffers.colors;
+    vector<double>& lumSum = buffers.lumSum;
+    vector<double>& lumSquareSum = buffers.lumSquareSum;
+    rays.resize(pixelNumber);
+    samples.resize(pixelNumber);
+    colors.assign(pixelNumber, RealColor4(0, 0, 0, 0));
+    lumSum.assign(pixelNumber, 0);
+    lumSquareSum.assign(pixelNumber, 0);
+
+    vector<float>& sampleCosts = buffers.sampleCosts;
+    vector<float>& costs = buffers.costs;
+    sampleCosts.resize(_costRecording ? pixelNumber : 0);
+    costs.assign(_costRecording ? pixelNumber : 0, 0);
+    float* sampleCostPtr = _costRecording ? &sampleCosts[0] : 0;
+
+    int maxSamples = _maxSampleNumber;
+    if( maxSamples > _MSAASampleNumber ) maxSamples = _MSAASampleNumber;
+    if( maxSamples < 1 ) maxSamples = 1;
+
+    int initialSamples = _initialSampleNumber;
+    if( initialSamples > maxSamples ) initialSamples = maxSamples;
+    if( initialSamples < 1 ) initialSamples = 1;
+
+    updatePixelOrder(buffers, _pixelOrder, t);
+
+    // first pass, a few samples for every pixel
+    for(int k=0;k<initialSamples;k++)
+    {
+        camInfo.generateRays(x0, y0, t.width, t.height,
+                             _frameWidth, _frameHeight,
+                             _shiftVector[_adaptiveSampleOrder[k]], &rays[0]);
+
+        traceRays_Ordered(&rays[0], pixelNumber, buffers, &samples[0], sampleCostPtr);
+
+        for(size_t p=0;p<costs.size();p++)
+            costs[p] += sampleCosts[p];
 
+        for(size_t p=0;p<pixelNumber;p++)
+        {
+            double l = luminance(samples[p]);
+            colors[p] = colors[p] + samples[p];
+            lumSum[p] += l;
+            lumSquareSum[p] += l * l;
+        }
+    }
+
+    // refine the pixels that are noisy or differ from their neighbors; room
+    // for the whole tile, however many pixels the tiles of the thread refine
+    vector<size_t>& refined = buffers.refined;
+    refined.clear();
+    refined.reserve(pixelNumber);
+    for(size_t i=0;i<t.height;i++)
+    {
+        for(size_t j=0;j<t.width;j++)
+        {
+            size_t p = i * t.width + j;
+            double mean = lumSum[p] / initialSamples;
+            double variance = lumSquareSum[p] / initialSamples - mean * mean;
+
+            bool refine = ( variance > _adaptiveThreshold * _adaptiveThreshold );
+
+            // neighbors outside the tile are not available yet
+            if( !refine && j > 0 )
+                refine = abs(mean - lumSum[p - 1] / initialSamples) > _adaptiveThreshold;
+            if( !refine && j + 1 < t.width )
+                refine = abs(mean - lumSum[p + 1] / initialSamples) > _adaptiveThreshold;
+            if( !refine && i > 0 )
+                refine = abs(mean - lumSum[p - t.width] / initialSamples) > _adaptiveThreshold;
+            if( !refine && i + 1 < t.height )
+                refine = abs(mean - lumSum[p + t.width] / initialSamples) > _adaptiveThreshold;
+
+            if( refine )
+                refined.push_back(p);
+        }
+    }
+
+    // second pass, the remaining samples for the selected pixels only
+    size_t refinedNumber = refined.size();
+    for(int k=initialSamples;k<maxSamples && refinedNumber > 0;k++)
+    {
+        const DblVector2D& shift = _shiftVector[_adaptiveSampleOrder[k]];
+        for(size_t r=0;r<refinedNumber;r++)
+        {
+            size_t p = refined[r];
+            size_t x = x0 + p % t.width;
+            size_t y = y0 + p / t.width;
+
+            float fx = (float)x / (float)_frameWidth;
+            float fy = (float)y / (float)_frameHeight;
+            DblPoint2D pos(fx + shift.x() / _frameWidth,
+                           fy + shift.y() / _frameHeight);
+            rays[r] = camInfo.generateRay(pos);
+            rays[r].order() = 0;
+        }
+
+        traceRays(&rays[0], refinedNumber, &samples[0], sampleCostPtr);
+
+        for(size_t r=0;r<refinedNumber;r++)
+            colors[refined[r]] = colors[refined[r]] + samples[r];
+
+        for(size_t r=0;r<refinedNumber && !costs.empty();r++)
+            costs[refined[r]] += sampleCosts[r];
+    }
+
+    size_t r = 0;
+    for(size_t p=0;p<pixelNumber;p++)
+    {
+        int sampleNumber = initialSamples;
+        if( r < refinedNumber && refined[r] == p )
+        {
+            sampleNumber = maxSamples;
+            r++;
+        }
+
+        RealColor4 c = colors[p] / (double) sampleNumber;
+        image.setPixel(t.x + p % t.width, t.y + p / t.width, c);
+
+        if( _costRecording )
+            recordPixelCost(x0 + p % t.width, y0 + p / t.width, costs[p]);
+    }
+}
+
+void RayTracer::tileFinished()
+{
+    QMutexLocker locker(&_progressMutex);
+
+    _finishedTiles++;
+    emit sig_progress((double) _finishedTiles / (double) _totalTiles);
+}
+
+void RayTracingThread::run()
+{
+    int frame = _frame;
+    while( _tracer->waitForFrame(frame) )
+    {
+        RayStatistics& stats = _tracer->localStatistics();
+
+        Tile t;
+        while( !_tracer->isCancelled() && _scheduler->nextTile(_workerId, t) )
+        {
+            {
+                ScopedTimer timer(stats.tileTime, _tracer->_timing);
+                _tracer->renderTile(t, *_tracer->_tileBuffers[_workerId]);
+            }
+            stats.tileNumber++;
+
+            _tracer->tileFinished();
+        }
+
+        _tracer->workerFinished();
+    }
+}
+
+void RenderThread::run()
+{
+    _tracer->execute();
 }
 
 void RayTracer::setSize(int w, int h)
@@ -292,15 +1344,15 @@ Ray RayTracer::reflect(const Ray &r, const Hit &h)
 {
     Ray fr;
 
-    DblPoint3D hitPoint = r.origin() + r.dir() * h.t();
+    RealPoint3D hitPoint = r.origin() + r.dir() * h.t();
 
-    DblVector3D N = normalize( h.normal() );
-    DblVector3D L = r.dir() * -1;
+    RealVector3D N = normalize( h.normal() );
+    RealVector3D L = r.dir() * -1;
     L = normalize( L );
-    double NdotL = dotProduct(N, L);
+    Real NdotL = dotProduct(N, L);
     if( NdotL < 0 ) NdotL = 0;
 
-    DblVector3D R = normalize( 2.0 * NdotL * N - L );
+    RealVector3D R = normalize( 2.0 * NdotL * N - L );
 
     fr.origin() = hitPoint;
     fr.dir() = R;
@@ -313,17 +1365,17 @@ Ray RayTracer::refract(const Ray &r, const Hit &h)
 {
     Ray fr;
 
-    DblPoint3D hitPoint = r.origin() + r.dir() * h.t();
+    RealPoint3D hitPoint = r.origin() + r.dir() * h.t();
 
-    DblVector3D N = normalize( h.normal() );
-    DblVector3D L = r.dir();
+    RealVector3D N = normalize( h.normal() );
+    RealVector3D L = r.dir();
     L = normalize( L );
 
-    double LdotN = dotProduct(N, L);
+    Real LdotN = dotProduct(N, L);
 
     bool isEntering = (LdotN < 0);
 
-    double c1, c2;
+    Real c1, c2;
 
     if( isEntering )
     {        
@@ -347,7 +1399,7 @@ Ray RayTracer::refract(const Ray &r, const Hit &h)
         fr.refractionRate() = 1.0;
 
         fr.origin() = hitPoint;
-        double factor = c1 * c1 - c2 * c2 * ( 1.0 - LdotN * LdotN);
+        Real factor = c1 * c1 - c2 * c2 * ( 1.0 - LdotN * LdotN);
         if( factor <= 0 )
         {
             // should be total reflection, here simplify it with tangent leaving ray
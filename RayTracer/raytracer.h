@@ -5,35 +5,45 @@
 using namespace GeometryUtils;
 
 #include "color.hpp"
+#include "realtype.hpp"
 
-#include "rgbaimage.h"
+#include "framebuffer.h"
+#include "tilescheduler.h"
 
 #include <cfloat>
+#include <limits>
 #include <QThread>
-#include <QApplication>
-
-class Ray
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadStorage>
+#include <QAtomicInt>
+#include <QSharedPointer>
+
+// rays and hits are templates over the scalar type, the core uses the
+// instantiation on Real
+template <typename T>
+class RayT
 {
 public:
-    Ray():
+    RayT():
         _order(0),
         _refractionRate(0)
     {}
 
-    Ray(const DblVector3D& dir, const DblPoint3D& origin):
+    RayT(const Point3D<T>& dir, const Point3D<T>& origin):
         _origin(origin),
         _dir(dir)
     {}
-    ~Ray(){}
+    ~RayT(){}
 
-    Ray(const Ray& other):
+    RayT(const RayT& other):
         _origin(other._origin),
         _dir(other._dir),
         _order(other._order),
         _refractionRate(other._refractionRate)
     {}
 
-    Ray& operator=(const Ray& other)
+    RayT& operator=(const RayT& other)
     {
         if( this == &other )
             return (*this);
@@ -47,45 +57,46 @@ public:
         }
     }
 
-    DblPoint3D pointAt( double t )
+    Point3D<T> pointAt( T t )
     {
         // _dir is always normalized
         return _origin + _dir * t;
     }
 
-    DblPoint3D& origin() { return _origin; }
-    const DblPoint3D& origin() const { return _origin; }
+    Point3D<T>& origin() { return _origin; }
+    const Point3D<T>& origin() const { return _origin; }
 
-    DblPoint3D& dir() { return _dir; }
-    const DblPoint3D& dir() const { return _dir; }
+    Point3D<T>& dir() { return _dir; }
+    const Point3D<T>& dir() const { return _dir; }
 
     size_t& order() { return _order; }
     const size_t& order() const { return _order; }
 
-    double& refractionRate() { return _refractionRate; }
-    const double& refractionRate() const { return _refractionRate; }
+    T& refractionRate() { return _refractionRate; }
+    const T& refractionRate() const { return _refractionRate; }
 
     friend class RayTracer;
 
 private:
-    DblPoint3D _origin;
-    DblVector3D _dir;
+    Point3D<T> _origin;
+    Point3D<T> _dir;
     size_t _order;
-    double _refractionRate;
+    T _refractionRate;
 };
 
-class Hit
+template <typename T>
+class HitT
 {
 public:
-    Hit():_t(DBL_MAX), _color(0, 0, 0, 0),
+    HitT():_t(numeric_limits<T>::max()), _color(0, 0, 0, 0),
         _normal(0, 0, 0),
         _reflected(false),
         _refracted(false),
         _refractionRate(0)
     {}
-    ~Hit(){}
+    ~HitT(){}
 
-    Hit(const Hit& other):
+    HitT(const HitT& other):
         _t(other._t),
         _color(other._color),
         _normal(other._normal),
@@ -94,7 +105,7 @@ public:
         _refractionRate(other._refractionRate)
     {}
 
-    Hit& operator=(const Hit& other)
+    HitT& operator=(const HitT& other)
     {
         if( this == &other )
         {
@@ -112,11 +123,11 @@ public:
         }
     }
 
-    void set( double t, const DblColor4& c,
-              const DblVector3D& normal,
+    void set( T t, const Color4<T>& c,
+              const Point3D<T>& normal,
               bool refl = true,
               bool refr = false,
-              double refrRate = 0)
+              T refrRate = 0)
     {
         _t = t;
         _color = c;
@@ -126,11 +137,11 @@ public:
         _refractionRate = refrRate;
     }
 
-    double& t() { return _t; }
-    const double& t() const {return _t; }
+    T& t() { return _t; }
+    const T& t() const {return _t; }
 
-    DblColor4& color() { return _color; }
-    const DblColor4& color() const { return _color; }
+    Color4<T>& color() { return _color; }
+    const Color4<T>& color() const { return _color; }
 
     bool& reflected() { return _reflected; }
     const bool& reflected() const { return _reflected; }
@@ -138,76 +149,344 @@ public:
     bool& refracted() { return _refracted; }
     const bool& refracted() const { return _refracted; }
 
-    DblVector3D& normal() { return _normal; }
-    const DblVector3D& normal() const { return _normal; }
+    Point3D<T>& normal() { return _normal; }
+    const Point3D<T>& normal() const { return _normal; }
 
-    double& refractionRate() { return _refractionRate; }
-    const double& refractionRate() const { return _refractionRate; }
+    T& refractionRate() { return _refractionRate; }
+    const T& refractionRate() const { return _refractionRate; }
 
     friend class RayTracer;
 
 private:
-    double _t;
-    DblColor4 _color;
+    T _t;
+    Color4<T> _color;
 
     // hit point normal
-    DblVector3D _normal;
+    Point3D<T> _normal;
 
     bool _reflected;
     bool _refracted;
-    double _refractionRate;
+    T _refractionRate;
 };
 
+typedef RayT<Real> Ray;
+typedef HitT<Real> Hit;
+
+// size of the frames, every frame is rendered into a new buffer
 class Canvas
 {
 public:
-    Canvas():img(0){}
+    Canvas():width(0), height(0){}
     Canvas(size_t w, size_t h):
-        img(new RGBAImage(w, h, 0.0))
+        width(w),
+        height(h)
     {}
 
-    ~Canvas()
+    friend class RayTracer;
+
+private:
+    size_t width;
+    size_t height;
+};
+
+class Scene;
+class RayTracer;
+struct ShadingPoint;
+
+// work done by one thread during a frame, or by all of them
+struct RayStatistics
+{
+    RayStatistics():
+        primaryRays(0),
+        secondaryRays(0),
+        shadowRays(0),
+        intersectionTests(0),
+        shadowTests(0),
+        nodeVisits(0),
+        maxDepth(0),
+        tileNumber(0),
+        traceTime(0),
+        lightingTime(0),
+        intersectTime(0),
+        blockTestTime(0),
+        tileTime(0)
+    {}
+
+    RayStatistics& operator+=(const RayStatistics& other)
     {
-        if( img )
-            delete img;
+        primaryRays += other.primaryRays;
+        secondaryRays += other.secondaryRays;
+        shadowRays += other.shadowRays;
+        intersectionTests += other.intersectionTests;
+        shadowTests += other.shadowTests;
+        nodeVisits += other.nodeVisits;
+        if( other.maxDepth > maxDepth )
+            maxDepth = other.maxDepth;
+        tileNumber += other.tileNumber;
+        traceTime += other.traceTime;
+        lightingTime += other.lightingTime;
+        intersectTime += other.intersectTime;
+        blockTestTime += other.blockTestTime;
+        tileTime += other.tileTime;
+        return (*this);
     }
 
-    friend class RayTracer;
+    quint64 totalRays() const { return primaryRays + secondaryRays + shadowRays; }
+
+    // traversal steps and shape tests, the cost measure of the heatmap
+    quint64 work() const { return nodeVisits + intersectionTests + shadowTests; }
+
+    // camera rays, reflected and refracted rays, rays towards the lights
+    quint64 primaryRays;
+    quint64 secondaryRays;
+    quint64 shadowRays;
+
+    // ray/shape tests of the nearest hit and of the shadow queries, and
+    // hierarchy nodes visited by both
+    quint64 intersectionTests;
+    quint64 shadowTests;
+    quint64 nodeVisits;
+
+    // deepest reflection or refraction level reached
+    size_t maxDepth;
+    quint64 tileNumber;
+
+    // nanoseconds spent in trace, evaluateLighting, Scene::intersect,
+    // Scene::blockTest and per tile, only measured when timing is enabled;
+    // the scopes nest, lighting and the scene queries are part of trace
+    quint64 traceTime;
+    quint64 lightingTime;
+    quint64 intersectTime;
+    quint64 blockTestTime;
+    quint64 tileTime;
+};
 
-private:
-    RGBAImage* img;
+// scratch buffers of a tile thread, kept by the tracer from frame to frame;
+// they grow to the tile size once, after that rendering a tile allocates
+// nothing and the threads do not contend in the allocator
+struct TileBuffers
+{
+    TileBuffers():
+        orderType(RowOrder),
+        orderWidth(0),
+        orderHeight(0)
+    {}
+
+    vector<Ray> rays;
+    vector<RealColor4> samples;
+    vector<RealColor4> colors;
+    vector<float> sampleCosts;
+    vector<float> costs;
+
+    // pixel order of the last tile size, and the rays and results in it
+    vector<size_t> order;
+    PixelOrder orderType;
+    size_t orderWidth, orderHeight;
+    vector<Ray> orderedRays;
+    vector<RealColor4> orderedColors;
+    vector<float> orderedCosts;
+
+    // adaptive sampling
+    vector<double> lumSum;
+    vector<double> lumSquareSum;
+    vector<size_t> refined;
 };
 
-// threaded ray tracing
+// threaded ray tracing, each thread renders tiles handed out by the scheduler;
+// the threads are pooled by the tracer and render every frame until it stops
+// them
 class RayTracingThread : public QThread
 {
+public:
+    // frame is the last frame of the pool when the thread is created, the
+    // thread waits for the next one
+    RayTracingThread(RayTracer* tracer, TileScheduler* scheduler, size_t workerId, int frame):
+        _tracer(tracer),
+        _scheduler(scheduler),
+        _workerId(workerId),
+        _frame(frame)
+    {}
 
-};
+protected:
+    void run();
 
-class Scene;
+private:
+    RayTracer* _tracer;
+    TileScheduler* _scheduler;
+    size_t _workerId;
+    int _frame;
+};
 
 class RayTracer : public QObject
 {
     Q_OBJECT
 public:
+    enum SamplingMode
+    {
+        FixedSampling,
+        AdaptiveSampling
+    };
+
+    enum LightSelection
+    {
+        AllLights,
+        SampledLights
+    };
+
     RayTracer();
+    ~RayTracer();
 
     void setSize(int w, int h);
     void bindScene(Scene *s);
     void execute();
 
-    const RGBAImage& result() { return _renderImage; }
+    // renders only the given region of the frame with the tile threads,
+    // into image, which has the size of the region; the result and the
+    // output file are left alone, used by the distributed render workers
+    void renderRegion(const Tile& region, FrameBuffer& image);
+
+    void setThreaded(bool threaded) { _threaded = threaded; }
+    void setThreadNumber(int n) { _threadNumber = n; }
+    void setTileSize(int s) { _tileSize = s; }
+    // order of the primary rays within a tile, rows by default
+    void setPixelOrder(PixelOrder order) { _pixelOrder = order; }
+
+    // ray trees are evaluated iteratively by default, branches whose
+    // contribution to the pixel drops below the threshold are culled
+    void setIterativeTracing(bool iterative) { _iterativeTracing = iterative; }
+    void setContributionThreshold(Real eps) { _contributionThreshold = eps; }
+
+    // primary rays of a tile are intersected in simd packets
+    void setPacketTracing(bool packet) { _packetTracing = packet; }
+
+    // every thread remembers the last opaque shape blocking each light and
+    // tests it first for the next shadow ray
+    void setOccluderCaching(bool caching) { _occluderCaching = caching; }
+
+    // samples per pixel, between 1 and 8, a single sample disables the
+    // anti-aliasing
+    void setSampleNumber(int n);
+
+    // the final image is written to this file, result.png by default, no
+    // file is written when it is empty
+    void setOutputFile(const string& filename) { _outputFile = filename; }
+
+    // scoped timers around the hot paths, they read the clock on every
+    // call and are off by default; the counters are always kept
+    void setTiming(bool timing) { _timing = timing; }
+
+    // records the cost of every pixel of the final pass, in traversal
+    // steps and shape tests summed over its samples
+    void setCostRecording(bool recording) { _costRecording = recording; }
+
+    // adaptive anti-aliasing traces a few samples per pixel first, then the
+    // remaining samples up to the maximum only where the luminance varies
+    // within the pixel or against its neighbors by more than the threshold
+    void setSamplingMode(SamplingMode m) { _samplingMode = m; }
+    void setInitialSampleNumber(int n) { _initialSampleNumber = n; }
+    void setMaxSampleNumber(int n) { _maxSampleNumber = n; }
+    void setAdaptiveThreshold(double t) { _adaptiveThreshold = t; }
+
+    // every shading point casts a shadow ray to every light by default;
+    // with sampled lights it picks a fixed number of them through the light
+    // hierarchy of the scene, the nearer and brighter ones more often, and
+    // weights them so that the lighting matches on average, at a cost that
+    // no longer grows with the number of lights
+    void setLightSelection(LightSelection s) { _lightSelection = s; }
+    void setLightSampleNumber(int n) { _lightSampleNumber = n > 0 ? n : 1; }
+
+    // progressive rendering first renders previews at a fraction of the
+    // resolution, starting with blocks of the given size and halving it each
+    // pass, then the final image, every finished pass is published through
+    // sig_passFinished; otherwise the frame is its only pass
+    void setProgressiveRendering(bool progressive) { _progressive = progressive; }
+    void setPreviewBlockSize(int s) { _previewBlockSize = s; }
+
+    // stops the threaded rendering after the tiles in flight, the result
+    // keeps the last finished pass
+    void cancel() { _cancelled = 1; }
+    bool isCancelled() const { return (int)_cancelled != 0; }
+    bool isRendering() const { return (int)_isRendering != 0; }
+
+    // a frame of the size of the previous result is rendered into its
+    // buffer, overwriting it, instead of a new one; for sequences that save
+    // every frame before the next, progressive passes always get new buffers
+    void setBufferReuse(bool reuse) { _bufferReuse = reuse; }
+
+    // frames are kept in floats, toQImage tonemaps them into 8 bits; the
+    // result belongs to the thread running execute and is only read there
+    // after it returns, the other threads get the frames through
+    // sig_passFinished
+    const FrameBuffer& result() { return (*_renderImage); }
+    QSharedPointer<FrameBuffer> sharedResult() { return _renderImage; }
+
+    // work of the last execute, merged over the threads at the end of the
+    // frame, and per thread
+    const RayStatistics& statistics() const { return _frameStatistics; }
+    vector<RayStatistics> threadStatistics();
+
+    // cost of every pixel of the last frame with cost recording on, row by
+    // row, and as an image from blue for the cheapest to red for the most
+    // expensive pixels
+    const vector<float>& pixelCosts() const { return _pixelCosts; }
+    FrameBuffer costHeatmap() const;
 
 signals:
     void sig_progress(double);
 
+    // the image is full size and is not written to after the signal, the
+    // receivers may keep it, unless buffer reuse renders the next frame into
+    // it; emitted on the thread running execute, the receivers of other
+    // threads get it queued
+    void sig_passFinished(QSharedPointer<FrameBuffer> image, int pass, int passNumber);
+
 protected:
     void rayTracing();
     void rayTracing_Threaded();
+    void rayTracing_Progressive();
+    // image holds the whole frame, or only the region when one is given
+    void renderTiles(FrameBuffer& image, int threadNumber, const Tile* region = 0);
+    int threadNumber() const;
+    QSharedPointer<FrameBuffer> frameBuffer();
+
+    RealColor4 renderPixel(size_t x, size_t y);
+    void renderTile(const Tile& t, TileBuffers& buffers);
+    void renderTile_Adaptive(const Tile& t, TileBuffers& buffers);
+    void traceRays(const Ray* rays, size_t n, RealColor4* colors, float* costs = 0);
+    // traces the rays of a tile in the pixel order of the buffers, the
+    // results are stored at the index of their ray
+    void traceRays_Ordered(const Ray* rays, size_t n, TileBuffers& buffers,
+                           RealColor4* colors, float* costs = 0);
+    void tileFinished();
+
+    // the pool of tile threads, started by the first frame and again only
+    // when the thread number changes; renderTiles wakes the threads once per
+    // frame and sleeps until the last of them is done
+    void startWorkers(int threadNumber);
+    void stopWorkers();
+    // called by the tile threads, false when the pool is stopped
+    bool waitForFrame(int& frame);
+    void workerFinished();
+
+    // counters of the calling thread for the current frame
+    RayStatistics& localStatistics();
+    void resetStatistics();
+    void mergeStatistics();
+    void recordPixelCost(size_t x, size_t y, float cost);
 
     bool trace( const Ray& r, Hit& h );
-
-    DblColor4 evaluateLighting( const Ray& r, const Hit& h);
+    bool trace_Recursive( const Ray& r, Hit& h );
+    void shade_Recursive( const Ray& r, Hit& h );
+    bool trace_Iterative( const Ray& r, Hit& h );
+
+    // evaluates the ray tree below a primary hit that is already resolved
+    void shadeHit( const Ray& r, Hit& h );
+    void evaluateRayTree( const Ray& r, Hit& h );
+
+    RealColor4 evaluateLighting( const Ray& r, const Hit& h);
+    // adds the light of the given source at the shading point, scaled by
+    // weight, to accuVal
+    void addLight(size_t idx, Real weight, const ShadingPoint& sp, RealColor4& accuVal);
     Ray reflect( const Ray& r, const Hit& h );
     Ray refract( const Ray& r, const Hit& h );
 
@@ -215,19 +494,116 @@ private:
     Scene* _scene;
     Canvas* _canvas;
     bool _threaded;
+    int _threadNumber;
+    int _tileSize;
+    PixelOrder _pixelOrder;
     bool _isMSAAEnabled;
     int _MSAASampleNumber;
     DblVector2D _shiftVector[8];
 
-    DblColor4 _bgColor;
+    SamplingMode _samplingMode;
+    int _initialSampleNumber;
+    int _maxSampleNumber;
+    double _adaptiveThreshold;
+    int _adaptiveSampleOrder[8];
+
+    LightSelection _lightSelection;
+    int _lightSampleNumber;
 
-    double _directLightingFactor;
-    double _reflectionFactor;
-    double _refractionFactor;
+    RealColor4 _bgColor;
+
+    Real _directLightingFactor;
+    Real _reflectionFactor;
+    Real _refractionFactor;
 
     size_t _maxIterations;
+    bool _iterativeTracing;
+    Real _contributionThreshold;
+    bool _packetTracing;
+    bool _occluderCaching;
+
+    // per thread last opaque occluder of every light, -1 for none
+    QThreadStorage<vector<int>*> _occluderCache;
+
+    // work queues and scratch buffers of the tile threads, by worker id
+    TileScheduler _scheduler;
+    vector<TileBuffers*> _tileBuffers;
+
+    // the tile threads, they wait for _workerFrame to change
+    vector<RayTracingThread*> _workers;
+    QMutex _workerMutex;
+    QWaitCondition _frameStarted;
+    QWaitCondition _frameDone;
+    int _workerFrame;
+    int _busyWorkers;
+    bool _stopWorkers;
+
+    string _outputFile;
+
+    // the counters of every thread taking part in the frame are owned by
+    // the tracer, the threads refer to theirs through a slot tagged with
+    // the stamp of the frame, so that pooled threads start over with every
+    // frame; the first _threadStatisticsNumber belong to the frame, the
+    // others are kept from earlier frames to be handed out again
+    struct StatisticsSlot
+    {
+        StatisticsSlot():statistics(0), stamp(0){}
+        RayStatistics* statistics;
+        int stamp;
+    };
+    QThreadStorage<StatisticsSlot*> _statisticsSlot;
+    vector<RayStatistics*> _threadStatistics;
+    size_t _threadStatisticsNumber;
+    QMutex _statisticsMutex;
+    // unique among all tracers, the slot of a thread may outlive the tracer
+    // and be found again by one constructed at the same address
+    int _statisticsStamp;
+    static QAtomicInt _lastStatisticsStamp;
+    int _frame;
+    RayStatistics _frameStatistics;
+
+    bool _timing;
+    bool _costRecording;
+    vector<float> _pixelCosts;
+
+    bool _progressive;
+    int _previewBlockSize;
+    bool _previewPass;
+    // read by other threads while execute runs
+    QAtomicInt _cancelled;
+    QAtomicInt _isRendering;
+
+    // image the tiles are written to, it holds the pixels from _targetX,
+    // _targetY on of a frame of _frameWidth x _frameHeight; the tiles are
+    // given in image coordinates
+    FrameBuffer* _targetImage;
+    size_t _targetX, _targetY;
+    size_t _frameWidth, _frameHeight;
+    QSharedPointer<FrameBuffer> _renderImage;
+    bool _bufferReuse;
+
+    // progress of the threaded rendering
+    QMutex _progressMutex;
+    size_t _finishedTiles;
+    size_t _totalTiles;
+
+    friend class RayTracingThread;
+};
+
+// runs execute of a tracer on its own thread, so that the thread starting
+// the rendering, the GUI thread, never waits for the tile threads
+class RenderThread : public QThread
+{
+public:
+    RenderThread(RayTracer* tracer):
+        _tracer(tracer)
+    {}
 
-    RGBAImage _renderImage;
+protected:
+    void run();
+
+private:
+    RayTracer* _tracer;
 };
 
 #endif // RAYTRACER_H
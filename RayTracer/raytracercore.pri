@@ -0,0 +1,60 @@
+# ray tracing core, shared by the viewer and the command line renderer
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+QMAKE_CXXFLAGS += -fopenmp
+LIBS += -lgomp
+
+# qmake CONFIG+=single_precision builds the ray tracing core in float, the
+# tests in tests/precision compare the images of both precisions
+single_precision {
+    DEFINES += RAYTRACER_SINGLE_PRECISION
+}
+
+SOURCES += $$PWD/geometryutils.cpp \
+    $$PWD/shape.cpp \
+    $$PWD/camerainfo.cpp \
+    $$PWD/rgbaimage.cpp \
+    $$PWD/framebuffer.cpp \
+    $$PWD/raytracer.cpp \
+    $$PWD/scene.cpp \
+    $$PWD/sceneparser.cpp \
+    $$PWD/lightsource.cpp \
+    $$PWD/lighttree.cpp \
+    $$PWD/bvh.cpp \
+    $$PWD/tilescheduler.cpp \
+    $$PWD/raypacket.cpp \
+    $$PWD/shapetable.cpp \
+    $$PWD/polygonmesh.cpp \
+    $$PWD/scenecache.cpp \
+    $$PWD/distributedrenderer.cpp \
+    $$PWD/animation.cpp
+
+HEADERS += $$PWD/utility.hpp \
+    $$PWD/util_common.h \
+    $$PWD/matrixutil.hpp \
+    $$PWD/mathutil.hpp \
+    $$PWD/geometryutils.hpp \
+    $$PWD/shape.h \
+    $$PWD/camerainfo.h \
+    $$PWD/rgbaimage.h \
+    $$PWD/framebuffer.h \
+    $$PWD/abstractimage.hpp \
+    $$PWD/raytracer.h \
+    $$PWD/scene.h \
+    $$PWD/sceneparser.h \
+    $$PWD/lightsource.h \
+    $$PWD/lighttree.h \
+    $$PWD/color.hpp \
+    $$PWD/boundingbox.hpp \
+    $$PWD/bvh.h \
+    $$PWD/tilescheduler.h \
+    $$PWD/raypacket.h \
+    $$PWD/simdutil.hpp \
+    $$PWD/shapetable.h \
+    $$PWD/realtype.hpp \
+    $$PWD/polygonmesh.h \
+    $$PWD/scenecache.h \
+    $$PWD/distributedrenderer.h \
+    $$PWD/animation.h
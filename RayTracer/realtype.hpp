@@ -0,0 +1,27 @@
+#ifndef REALTYPE_HPP
+#define REALTYPE_HPP
+
+#include "geometryutils.hpp"
+using namespace GeometryUtils;
+
+#include "color.hpp"
+
+#include <cfloat>
+
+// scalar type of the ray tracing core, rays, hits, shapes and lighting are
+// evaluated in it, building with CONFIG += single_precision selects float
+#ifdef RAYTRACER_SINGLE_PRECISION
+typedef float Real;
+#define REAL_MAX FLT_MAX
+#else
+typedef double Real;
+#define REAL_MAX DBL_MAX
+#endif
+
+typedef Point2D<Real> RealPoint2D;
+typedef Point3D<Real> RealPoint3D;
+typedef RealPoint2D RealVector2D;
+typedef RealPoint3D RealVector3D;
+typedef Color4<Real> RealColor4;
+
+#endif // REALTYPE_HPP
@@ -1,21 +1,78 @@
 #include "scene.h"
 #include "shape.h"
 #include "sceneparser.h"
+#include "scenecache.h"
+#include "bvh.h"
+#include "shapetable.h"
+#include "raypacket.h"
+#include "animation.h"
+#include "lighttree.h"
+
+#include <algorithm>
+
+namespace
+{
+// a refitted hierarchy whose nodes grew by more than this factor in area
+// since it was built is built again
+const double REBUILD_AREA_RATIO = 2.0;
+}
 
 Scene::Scene():
     _camInfo(0),
+    _shapeNumber(0),
     _shapes(0),
-    _lightSources(0)
+    _lightSourceNumber(0),
+    _lightSources(0),
+    _shapeTable(0),
+    _bvh(0),
+    _lightTree(0),
+    _animation(0),
+    _cache(0)
 {
 }
 
-Scene::Scene(const string &filename)
+Scene::Scene(const string &filename):
+    _camInfo(0),
+    _shapeNumber(0),
+    _shapes(0),
+    _lightSourceNumber(0),
+    _lightSources(0),
+    _shapeTable(0),
+    _bvh(0),
+    _lightTree(0),
+    _animation(0),
+    _cache(0)
+{
+    SceneCache* cache = new SceneCache;
+    if( cache->load(this, SceneCache::cacheFileName(filename)) )
+    {
+        _cache = cache;
+        _lightTree = new LightTree;
+        _lightTree->build(_lightSources, _lightSourceNumber);
+        return;
+    }
+    delete cache;
+
+    if( !parse(filename) )
+        throw "failed to parse scene file!";
+}
+
+bool Scene::parse(const string &filename)
 {
     SceneParser parser;
     parser.bindScene(this);
 
     if( !parser.parse(filename) )
-        throw "failed to parse scene file!";
+        return false;
+
+    if( _animation )
+    {
+        _animation->bind(_shapes, _shapeNumber, _camInfo);
+        _animation->apply(_animation->firstFrame());
+    }
+
+    buildAccelerationStructure();
+    return true;
 }
 
 Scene::~Scene()
@@ -26,10 +83,164 @@ Scene::~Scene()
         delete[] _shapes;
     if(_lightSources)
         delete[] _lightSources;
+    if(_bvh)
+        delete _bvh;
+    if(_lightTree)
+        delete _lightTree;
+    if(_shapeTable)
+        delete _shapeTable;
+    if(_animation)
+        delete _animation;
+    if(_cache)
+        delete _cache;
+}
+
+void Scene::buildAccelerationStructure()
+{
+    if( !_shapeTable )
+        _shapeTable = new ShapeTable;
+    if( !_bvh )
+        _bvh = new BVH;
+    if( !_lightTree )
+        _lightTree = new LightTree;
+
+    _shapeTable->build(_shapes, _shapeNumber);
+    _bvh->build(_shapes, _shapeNumber, _shapeTable);
+    _lightTree->build(_lightSources, _lightSourceNumber);
 }
 
-bool Scene::intersect(const Ray &r, Hit &h)
+int Scene::firstFrame() const
 {
+    return _animation ? _animation->firstFrame() : 0;
+}
+
+int Scene::lastFrame() const
+{
+    return _animation ? _animation->lastFrame() : 0;
+}
+
+void Scene::setFrame(double frame)
+{
+    if( !_animation )
+        return;
+
+    _animation->apply(frame);
+
+    if( _shapeTable )
+    {
+        const vector<size_t>& moved = _animation->animatedShapes();
+        for(size_t i=0;i<moved.size();i++)
+            _shapeTable->updateGeometry(moved[i]);
+    }
+
+    if( _bvh && !_animation->animatedShapes().empty()
+     && _bvh->refit() > REBUILD_AREA_RATIO )
+        _bvh->build(_shapes, _shapeNumber, _shapeTable);
+}
+
+bool Scene::intersect(const Ray &r, Hit &h, RayStatistics* stats)
+{
+    if( _bvh )
+        return _bvh->intersect(r, h, stats);
+    else
+        return intersect_Linear(r, h, stats);
+}
+
+void Scene::intersectPacket(const Ray *rays, size_t n, Hit *hits, bool *flags, RayStatistics* stats)
+{
+    RayPacket p;
+    p.load(rays, n);
+
+    if( _bvh )
+        _bvh->intersectPacket(p, stats);
+    else
+    {
+        for(size_t i = 0; i < _shapeNumber; i++)
+            if( _shapes[i] )
+                _shapes[i]->intersectPacket(p, i);
+
+        if( stats )
+            stats->intersectionTests += _shapeNumber * p.size;
+    }
+
+    // fill in the hit records of the nearest shapes
+    for(size_t i = 0; i < p.size; i++)
+    {
+        if( p.shape[i] >= 0 )
+        {
+            if( _shapeTable )
+            {
+                RealVector3D dir = normalize( rays[i].dir() );
+                Real dirArr[3] = { dir.x(), dir.y(), dir.z() };
+                flags[i] = _shapeTable->intersect(p.shape[i], rays[i], dirArr, hits[i]);
+            }
+            else
+                flags[i] = _shapes[p.shape[i]]->intersect(rays[i], hits[i]);
+        }
+        else
+            flags[i] = false;
+    }
+}
+
+bool Scene::blockTest(const Ray &r, Real t, bool& translucent, RealColor4 &c, int* occluder,
+                      RayStatistics* stats)
+{
+    // an opaque blocker hides the light whatever else is on the way, the
+    // one that blocked the previous ray is likely to block this one too
+    if( occluder && *occluder >= 0 && (size_t)*occluder < _shapeNumber
+     && _shapes[*occluder] && _shapes[*occluder]->refractionRate() <= 0
+     && blockTest_Shape(*occluder, r, t, stats) )
+    {
+        translucent = false;
+        return true;
+    }
+
+    if( !_bvh )
+        return blockTest_Linear(r, t, translucent, c, occluder, stats);
+
+    // the translucent colors are blended in shape order, so the blockers
+    // are collected first and sorted before blending
+    const size_t MAX_BLOCKERS = 64;
+    size_t blockers[MAX_BLOCKERS];
+    int opaqueBlocker;
+    size_t blockerNumber = _bvh->collectBlockers(r, t, blockers, MAX_BLOCKERS, opaqueBlocker, stats);
+
+    if( occluder )
+        *occluder = opaqueBlocker;
+
+    if( opaqueBlocker >= 0 )
+    {
+        translucent = false;
+        return true;
+    }
+
+    if( blockerNumber > MAX_BLOCKERS )
+        return blockTest_Linear(r, t, translucent, c, 0, stats);
+
+    std::sort(blockers, blockers + blockerNumber);
+
+    translucent = true;
+    c = RealColor4(c.r(), c.g(), c.b(), 0);
+    for(size_t i = 0; i < blockerNumber; i++)
+    {
+        size_t idx = blockers[i];
+        translucent &= (_shapeTable->refractionRate(idx) > 0);
+        if( translucent )
+        {
+            c = RealColor4::blend(_shapeTable->color(idx), c);
+        }
+    }
+
+    c.a() = 1.0 - c.a();
+
+    return (blockerNumber > 0);
+}
+
+bool Scene::intersect_Linear(const Ray &r, Hit &h, RayStatistics* stats)
+{
+    if( stats )
+        stats->intersectionTests += _shapeNumber;
+
     bool intersectFlag = false;
     for(size_t i = 0; i < _shapeNumber; i++)
     {
@@ -42,21 +253,35 @@ bool Scene::intersect(const Ray &r, Hit &h)
     return intersectFlag;
 }
 
-bool Scene::blockTest(const Ray &r, double t, bool& translucent, DblColor4 &c)
-{    
+bool Scene::blockTest_Linear(const Ray &r, Real t, bool& translucent, RealColor4 &c, int* occluder,
+                             RayStatistics* stats)
+{
+    if( occluder )
+        *occluder = -1;
+
     bool blockFlag = false;
     translucent = true;
-    c = DblColor4(c.r(), c.g(), c.b(), 0);
+    c = RealColor4(c.r(), c.g(), c.b(), 0);
     for(size_t i = 0; i < _shapeNumber; i++)
     {
         if( _shapes[i] )
         {
+            if( stats )
+                stats->shadowTests++;
+
             if( _shapes[i]->blockTest(r, t) )
             {
                 translucent &= (_shapes[i]->refractionRate() > 0);
                 if( translucent )
                 {
-                    c = DblColor4::blend(_shapes[i]->color(), c);
+                    c = RealColor4::blend(_shapes[i]->color(), c);
+                }
+                else
+                {
+                    // blocked by an opaque shape, no need to go on
+                    if( occluder )
+                        *occluder = i;
+                    return true;
                 }
                 blockFlag = true;
             }
@@ -67,3 +292,18 @@ bool Scene::blockTest(const Ray &r, double t, bool& translucent, DblColor4 &c)
 
     return blockFlag;
 }
+
+bool Scene::blockTest_Shape(size_t idx, const Ray &r, Real t, RayStatistics* stats)
+{
+    if( stats )
+        stats->shadowTests++;
+
+    if( _shapeTable )
+    {
+        RealVector3D dir = normalize( r.dir() );
+        Real dirArr[3] = { dir.x(), dir.y(), dir.z() };
+        return _shapeTable->blockTest(idx, r, dirArr, t);
+    }
+    else
+        return _shapes[idx] && _shapes[idx]->blockTest(r, t);
+}
@@ -12,16 +12,56 @@ class SceneParser;
 class RayTracer;
 
 class Shape;
+class BVH;
+class ShapeTable;
+class SceneCache;
+class Animation;
+class LightTree;
+struct RayStatistics;
 
 class Scene
 {
 public:
     Scene();
+    // loads the cache of the scene file instead when it is up to date
     Scene(const string& filename);
     ~Scene();
 
-    bool intersect(const Ray& r, Hit& h);
-    bool blockTest(const Ray& r, double t, bool& translucent, DblColor4& c);
+    // parses a text scene file and builds the acceleration structures
+    bool parse(const string& filename);
+
+    // the queries add their node visits and shape tests to stats when given
+    bool intersect(const Ray& r, Hit& h, RayStatistics* stats = 0);
+    // tests if the ray is blocked before t, translucent is set when all
+    // blockers are translucent and c is then blended with their colors;
+    // occluder is an optional hint, on input a shape likely to block the
+    // ray opaquely, tested first, on output the opaque blocker or -1
+    bool blockTest(const Ray& r, Real t, bool& translucent, RealColor4& c, int* occluder = 0,
+                   RayStatistics* stats = 0);
+
+    // intersects up to RAY_PACKET_SIZE coherent rays at once, hits[i] and
+    // flags[i] receive the same result as intersect(rays[i], hits[i])
+    void intersectPacket(const Ray* rays, size_t n, Hit* hits, bool* flags, RayStatistics* stats = 0);
+
+    // builds the compact shape table and the bounding volume hierarchy over
+    // it, called once the scene file is parsed; without them the queries
+    // fall back to a linear scan over the shape objects
+    void buildAccelerationStructure();
+    const BVH* accelerationStructure() const { return _bvh; }
+    const ShapeTable* shapeTable() const { return _shapeTable; }
+    // hierarchy over the light sources, built with the structures above
+    const LightTree* lightTree() const { return _lightTree; }
+
+    // scenes with an animation section move their shapes and camera from
+    // frame to frame, they start at the first frame
+    bool isAnimated() const { return _animation != 0; }
+    const Animation* animation() const { return _animation; }
+    int firstFrame() const;
+    int lastFrame() const;
+
+    // poses the scene at the frame, the shape table is updated and the
+    // hierarchy refitted, or rebuilt once refitting has degraded it
+    void setFrame(double frame);
 
     const CameraInfo& cameraInfo() const
     {
@@ -72,7 +112,13 @@ public:
     double max(int idx) { return _max[idx]; }
 
 protected:
+    bool intersect_Linear(const Ray& r, Hit& h, RayStatistics* stats = 0);
+    bool blockTest_Linear(const Ray& r, Real t, bool& translucent, RealColor4& c, int* occluder = 0,
+                          RayStatistics* stats = 0);
+    bool blockTest_Shape(size_t idx, const Ray& r, Real t, RayStatistics* stats = 0);
+
     friend class SceneParser;
+    friend class SceneCache;
     friend class RayTracer;
 
 private:
@@ -88,6 +134,15 @@ private:
 
     size_t _lightSourceNumber;
     LightSource* _lightSources;
+
+    ShapeTable* _shapeTable;
+    BVH* _bvh;
+    LightTree* _lightTree;
+
+    Animation* _animation;
+
+    // mapped cache the scene was loaded from, owns the mesh and hierarchy data
+    SceneCache* _cache;
 };
 
 #endif // SCENE_H
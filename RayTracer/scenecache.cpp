@@ -0,0 +1,634 @@
+#include "scenecache.h"
+#include "scene.h"
+#include "shape.h"
+#include "polygonmesh.h"
+#include "bvh.h"
+#include "shapetable.h"
+
+#include <QFileInfo>
+#include <QDateTime>
+
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+const char SceneCache::magic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0' };
+const quint32 SceneCache::version = 2;
+const string SceneCache::extension = ".scb";
+
+namespace
+{
+// sections start at cache line boundaries
+const quint64 SECTION_ALIGNMENT = 64;
+
+const quint32 BYTE_ORDER_MARK = 0x01020304;
+
+// shape records refer to no mesh
+const qint64 NO_MESH = -1;
+
+struct CacheHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 realSize;
+    quint32 nodeSize;
+    quint32 byteOrder;
+    quint64 fileSize;
+
+    double min[3], max[3];
+    quint32 hasBoundingBox;
+    quint32 hasGround;
+
+    quint64 dependencyNumber, dependencyOffset;
+    quint64 cameraOffset;
+    quint64 lightNumber, lightOffset;
+    quint64 shapeNumber, shapeOffset;
+    quint64 meshNumber, meshOffset;
+
+    // hierarchy of the scene
+    quint64 nodeNumber, nodeOffset;
+    quint64 indexNumber, indexOffset;
+};
+
+struct DependencyRecord
+{
+    quint64 pathOffset, pathLength;
+    qint64 size;
+    qint64 modified;
+};
+
+struct CameraRecord
+{
+    double pos[3], dir[3], up[3];
+    double focalLength;
+    double canvasSize[2];
+};
+
+struct LightRecord
+{
+    quint32 type;
+    Real pos[3];
+    Real color[4];
+    Real radius;
+    Real edges[6];
+};
+
+// sphere: center and radius
+// triangle: three vertices and the normal
+// rectangle: four vertices and the normal
+struct ShapeRecord
+{
+    quint32 type;
+    qint64 mesh;
+    Real color[4];
+    Real refractionRate;
+    Real params[15];
+};
+
+struct MeshRecord
+{
+    quint64 vertexNumber, vertexOffset, normalOffset;
+    quint64 triangleNumber, triangleOffset;
+    quint64 nodeNumber, nodeOffset;
+    quint64 indexNumber, indexOffset;
+};
+
+quint64 alignOffset(quint64 offset)
+{
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+// reserves an aligned section of size bytes, returns its offset
+quint64 reserveSection(quint64& fileSize, quint64 size)
+{
+    quint64 offset = alignOffset(fileSize);
+    fileSize = offset + size;
+    return offset;
+}
+
+// writes data at offset, padding the file with zeros up to it
+void writeSection(ofstream& f, quint64 offset, const void* data, quint64 size)
+{
+    static const char zeros[SECTION_ALIGNMENT] = { 0 };
+    quint64 pos = (quint64)f.tellp();
+    while( pos < offset )
+    {
+        quint64 n = offset - pos;
+        if( n > SECTION_ALIGNMENT )
+            n = SECTION_ALIGNMENT;
+        f.write(zeros, n);
+        pos += n;
+    }
+
+    if( size > 0 )
+        f.write((const char*)data, size);
+}
+
+bool isSectionValid(const CacheHeader& h, quint64 offset, quint64 number, quint64 elementSize)
+{
+    return offset <= h.fileSize && number <= (h.fileSize - offset) / elementSize;
+}
+
+// the children of every interior node follow it within the array, so the
+// walks end, and the tree is no deeper than a built one, so it fits their
+// stacks; the leaves refer to the index array, whose entries refer to one
+// of primitiveNumber primitives
+bool isHierarchyValid(const BVHNode* nodes, quint64 nodeNumber,
+                      const quint32* indices, quint64 indexNumber, quint64 primitiveNumber)
+{
+    vector<size_t> depth(nodeNumber, 0);
+    for(quint64 i=0;i<nodeNumber;i++)
+    {
+        const BVHNode& n = nodes[i];
+        if( depth[i] > BVH::maxDepth )
+            return false;
+
+        if( n.isLeaf() )
+        {
+            if( n._offset > indexNumber || n._count > indexNumber - n._offset )
+                return false;
+        }
+        else
+        {
+            if( i + 1 >= nodeNumber || n._offset <= i || n._offset >= nodeNumber || n._axis > 2 )
+                return false;
+
+            depth[i + 1] = std::max(depth[i + 1], depth[i] + 1);
+            depth[n._offset] = std::max(depth[n._offset], depth[i] + 1);
+        }
+    }
+
+    for(quint64 i=0;i<indexNumber;i++)
+    {
+        if( indices[i] >= primitiveNumber )
+            return false;
+    }
+
+    return true;
+}
+
+void setPoint(RealPoint3D& p, const Real* v)
+{
+    p = RealPoint3D(v[0], v[1], v[2]);
+}
+
+void getPoint(Real* v, const RealPoint3D& p)
+{
+    v[0] = p.x(), v[1] = p.y(), v[2] = p.z();
+}
+}
+
+SceneCache::SceneCache():
+    _file(0),
+    _data(0)
+{
+}
+
+SceneCache::~SceneCache()
+{
+    if( _file )
+    {
+        _file->unmap((uchar*)_data);
+        _file->close();
+        delete _file;
+    }
+}
+
+string SceneCache::cacheFileName(const string &sceneFile)
+{
+    size_t dot = sceneFile.find_last_of('.');
+    size_t slash = sceneFile.find_last_of("/\\");
+    if( dot == string::npos || (slash != string::npos && dot < slash) )
+        return sceneFile + extension;
+    else
+        return sceneFile.substr(0, dot) + extension;
+}
+
+bool SceneCache::load(Scene *scene, const string &filename)
+{
+    if( _file )
+        return false;
+
+    QFile* file = new QFile(QString::fromStdString(filename));
+    if( !file->open(QIODevice::ReadOnly) || (quint64)file->size() < sizeof(CacheHeader) )
+    {
+        delete file;
+        return false;
+    }
+
+    const uchar* data = file->map(0, file->size());
+    if( !data )
+    {
+        delete file;
+        return false;
+    }
+
+    // verify the header and the bounds of every section before the scene is touched
+    const CacheHeader& h = *reinterpret_cast<const CacheHeader*>(data);
+    bool valid = memcmp(h.magic, magic, sizeof(magic)) == 0
+            && h.version == version
+            && h.realSize == sizeof(Real)
+            && h.nodeSize == sizeof(BVHNode)
+            && h.byteOrder == BYTE_ORDER_MARK
+            && h.fileSize == (quint64)file->size()
+            && isSectionValid(h, h.dependencyOffset, h.dependencyNumber, sizeof(DependencyRecord))
+            && isSectionValid(h, h.cameraOffset, 1, sizeof(CameraRecord))
+            && isSectionValid(h, h.lightOffset, h.lightNumber, sizeof(LightRecord))
+            && isSectionValid(h, h.shapeOffset, h.shapeNumber, sizeof(ShapeRecord))
+            && isSectionValid(h, h.meshOffset, h.meshNumber, sizeof(MeshRecord))
+            && isSectionValid(h, h.nodeOffset, h.nodeNumber, sizeof(BVHNode))
+            && isSectionValid(h, h.indexOffset, h.indexNumber, sizeof(quint32));
+
+    const DependencyRecord* dependencies = reinterpret_cast<const DependencyRecord*>(data + h.dependencyOffset);
+    for(quint64 i=0;valid && i<h.dependencyNumber;i++)
+    {
+        const DependencyRecord& d = dependencies[i];
+        if( !isSectionValid(h, d.pathOffset, d.pathLength, 1) )
+        {
+            valid = false;
+            break;
+        }
+
+        string path((const char*)data + d.pathOffset, d.pathLength);
+        QFileInfo info(QString::fromStdString(path));
+        valid = info.exists() && info.size() == d.size
+                && (qint64)info.lastModified().toTime_t() == d.modified;
+    }
+
+    const MeshRecord* meshes = reinterpret_cast<const MeshRecord*>(data + h.meshOffset);
+    for(quint64 i=0;valid && i<h.meshNumber;i++)
+    {
+        const MeshRecord& m = meshes[i];
+
+        // the sizes are checked per vertex and per triangle, the counts are
+        // not multiplied before they are known to fit in the file
+        valid = isSectionValid(h, m.vertexOffset, m.vertexNumber, 3 * sizeof(Real))
+                && isSectionValid(h, m.normalOffset, m.vertexNumber, 3 * sizeof(Real))
+                && isSectionValid(h, m.triangleOffset, m.triangleNumber, 3 * sizeof(quint32))
+                && isSectionValid(h, m.nodeOffset, m.nodeNumber, sizeof(BVHNode))
+                && isSectionValid(h, m.indexOffset, m.indexNumber, sizeof(quint32));
+        if( !valid )
+            break;
+
+        const quint32* triangles = reinterpret_cast<const quint32*>(data + m.triangleOffset);
+        size_t triangleIndexNumber = (size_t)m.triangleNumber * 3;
+        for(size_t j=0;valid && j<triangleIndexNumber;j++)
+            valid = triangles[j] < m.vertexNumber;
+
+        valid = valid && isHierarchyValid(reinterpret_cast<const BVHNode*>(data + m.nodeOffset), m.nodeNumber,
+                                          reinterpret_cast<const quint32*>(data + m.indexOffset), m.indexNumber,
+                                          m.triangleNumber);
+    }
+
+    const ShapeRecord* shapes = reinterpret_cast<const ShapeRecord*>(data + h.shapeOffset);
+    for(quint64 i=0;valid && i<h.shapeNumber;i++)
+    {
+        switch( shapes[i].type )
+        {
+        case Shape::SPHERE:
+        case Shape::TRIANGLE:
+        case Shape::RECTANGLE:
+            break;
+        case Shape::POLYGONMESH:
+            valid = shapes[i].mesh >= 0 && (quint64)shapes[i].mesh < h.meshNumber;
+            break;
+        default:
+            // the scene would hold no shape in its place
+            valid = false;
+            break;
+        }
+    }
+
+    valid = valid && isHierarchyValid(reinterpret_cast<const BVHNode*>(data + h.nodeOffset), h.nodeNumber,
+                                      reinterpret_cast<const quint32*>(data + h.indexOffset), h.indexNumber,
+                                      h.shapeNumber);
+
+    if( !valid )
+    {
+        file->unmap((uchar*)data);
+        delete file;
+        return false;
+    }
+
+    _file = file;
+    _data = data;
+
+    // scene info
+    for(int k=0;k<3;k++)
+    {
+        scene->_min[k] = h.min[k];
+        scene->_max[k] = h.max[k];
+    }
+    scene->_hasBoundingBox = h.hasBoundingBox != 0;
+    scene->_hasGround = h.hasGround != 0;
+
+    // camera
+    const CameraRecord& cam = *reinterpret_cast<const CameraRecord*>(data + h.cameraOffset);
+    scene->_camInfo = new CameraInfo;
+    scene->_camInfo->_pos = DblPoint3D(cam.pos[0], cam.pos[1], cam.pos[2]);
+    scene->_camInfo->_dir = DblVector3D(cam.dir[0], cam.dir[1], cam.dir[2]);
+    scene->_camInfo->_up = DblVector3D(cam.up[0], cam.up[1], cam.up[2]);
+    scene->_camInfo->_focalLength = cam.focalLength;
+    scene->_camInfo->_canvasSize[0] = cam.canvasSize[0];
+    scene->_camInfo->_canvasSize[1] = cam.canvasSize[1];
+    scene->_camInfo->setup();
+
+    // light sources
+    const LightRecord* lights = reinterpret_cast<const LightRecord*>(data + h.lightOffset);
+    scene->_lightSourceNumber = h.lightNumber;
+    scene->_lightSources = new LightSource[h.lightNumber];
+    for(quint64 i=0;i<h.lightNumber;i++)
+    {
+        LightSource& l = scene->_lightSources[i];
+        l._type = (LightSource::LightSourceType)lights[i].type;
+        setPoint(l._pos, lights[i].pos);
+        l._color = RealColor4(lights[i].color[0], lights[i].color[1], lights[i].color[2], lights[i].color[3]);
+        l._radius = lights[i].radius;
+        setPoint(l._edges[0], lights[i].edges);
+        setPoint(l._edges[1], lights[i].edges + 3);
+    }
+
+    // shapes, the meshes use the mapped buffers
+    scene->_shapeNumber = h.shapeNumber;
+    scene->_shapes = new Shape*[h.shapeNumber];
+    for(quint64 i=0;i<h.shapeNumber;i++)
+    {
+        const ShapeRecord& r = shapes[i];
+        Shape* s = 0;
+
+        switch( r.type )
+        {
+        case Shape::SPHERE:
+        {
+            Sphere* sp = new Sphere;
+            setPoint(sp->center(), r.params);
+            sp->radius() = r.params[3];
+            s = sp;
+            break;
+        }
+        case Shape::TRIANGLE:
+        {
+            Triangle* tr = new Triangle;
+            for(int k=0;k<3;k++)
+                setPoint(tr->vertex(k), r.params + k * 3);
+            tr->normal() = RealVector3D(r.params[9], r.params[10], r.params[11]);
+            s = tr;
+            break;
+        }
+        case Shape::RECTANGLE:
+        {
+            Rectangle* rt = new Rectangle;
+            for(int k=0;k<4;k++)
+                setPoint(rt->vertex(k), r.params + k * 3);
+            rt->normal() = RealVector3D(r.params[12], r.params[13], r.params[14]);
+            s = rt;
+            break;
+        }
+        case Shape::POLYGONMESH:
+        {
+            const MeshRecord& m = meshes[r.mesh];
+            PolygonMesh* mesh = new PolygonMesh;
+            mesh->attach(reinterpret_cast<const Real*>(data + m.vertexOffset),
+                         reinterpret_cast<const Real*>(data + m.normalOffset),
+                         m.vertexNumber,
+                         reinterpret_cast<const unsigned int*>(data + m.triangleOffset),
+                         m.triangleNumber,
+                         reinterpret_cast<const BVHNode*>(data + m.nodeOffset),
+                         m.nodeNumber,
+                         reinterpret_cast<const unsigned int*>(data + m.indexOffset),
+                         m.indexNumber);
+            s = mesh;
+            break;
+        }
+        default:
+            break;
+        }
+
+        if( s )
+        {
+            s->color() = RealColor4(r.color[0], r.color[1], r.color[2], r.color[3]);
+            s->refractionRate() = r.refractionRate;
+        }
+        scene->_shapes[i] = s;
+    }
+
+    // the shape table is cheap to rebuild, the hierarchy is used in place
+    scene->_shapeTable = new ShapeTable;
+    scene->_shapeTable->build(scene->_shapes, scene->_shapeNumber);
+
+    scene->_bvh = new BVH;
+    scene->_bvh->attach(reinterpret_cast<const BVHNode*>(data + h.nodeOffset), h.nodeNumber,
+                        reinterpret_cast<const unsigned int*>(data + h.indexOffset), h.indexNumber,
+                        scene->_shapes, scene->_shapeNumber, scene->_shapeTable);
+
+    return true;
+}
+
+bool SceneCache::write(const Scene &scene, const string &sceneFile, const string &filename)
+{
+    if( !scene._camInfo || !scene._bvh || scene._animation )
+        return false;
+
+    CacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.realSize = sizeof(Real);
+    h.nodeSize = sizeof(BVHNode);
+    h.byteOrder = BYTE_ORDER_MARK;
+
+    for(int k=0;k<3;k++)
+    {
+        h.min[k] = scene._min[k];
+        h.max[k] = scene._max[k];
+    }
+    h.hasBoundingBox = scene._hasBoundingBox;
+    h.hasGround = scene._hasGround;
+
+    // dependencies, the scene file and the mesh files
+    vector<string> paths(1, sceneFile);
+    vector<const PolygonMesh*> meshList;
+    for(size_t i=0;i<scene._shapeNumber;i++)
+    {
+        const Shape* s = scene._shapes[i];
+        if( s && s->type() == Shape::POLYGONMESH )
+        {
+            const PolygonMesh* mesh = dynamic_cast<const PolygonMesh*>(s);
+            meshList.push_back(mesh);
+            paths.push_back(mesh->fileName());
+        }
+    }
+
+    // layout
+    quint64 fileSize = sizeof(CacheHeader);
+    h.dependencyNumber = paths.size();
+    h.dependencyOffset = reserveSection(fileSize, paths.size() * sizeof(DependencyRecord));
+
+    vector<DependencyRecord> dependencies(paths.size());
+    for(size_t i=0;i<paths.size();i++)
+    {
+        QFileInfo info(QString::fromStdString(paths[i]));
+        if( !info.exists() )
+            return false;
+
+        dependencies[i].pathLength = paths[i].size();
+        dependencies[i].pathOffset = reserveSection(fileSize, paths[i].size());
+        dependencies[i].size = info.size();
+        dependencies[i].modified = info.lastModified().toTime_t();
+    }
+
+    h.cameraOffset = reserveSection(fileSize, sizeof(CameraRecord));
+    h.lightNumber = scene._lightSourceNumber;
+    h.lightOffset = reserveSection(fileSize, h.lightNumber * sizeof(LightRecord));
+    h.shapeNumber = scene._shapeNumber;
+    h.shapeOffset = reserveSection(fileSize, h.shapeNumber * sizeof(ShapeRecord));
+    h.meshNumber = meshList.size();
+    h.meshOffset = reserveSection(fileSize, h.meshNumber * sizeof(MeshRecord));
+
+    vector<MeshRecord> meshes(meshList.size());
+    for(size_t i=0;i<meshList.size();i++)
+    {
+        const PolygonMesh* mesh = meshList[i];
+        MeshRecord& m = meshes[i];
+        m.vertexNumber = mesh->vertexNumber();
+        m.vertexOffset = reserveSection(fileSize, m.vertexNumber * 3 * sizeof(Real));
+        m.normalOffset = reserveSection(fileSize, m.vertexNumber * 3 * sizeof(Real));
+        m.triangleNumber = mesh->triangleNumber();
+        m.triangleOffset = reserveSection(fileSize, m.triangleNumber * 3 * sizeof(quint32));
+        m.nodeNumber = mesh->hierarchy().nodeNumber();
+        m.nodeOffset = reserveSection(fileSize, m.nodeNumber * sizeof(BVHNode));
+        m.indexNumber = mesh->hierarchy().indexNumber();
+        m.indexOffset = reserveSection(fileSize, m.indexNumber * sizeof(quint32));
+    }
+
+    h.nodeNumber = scene._bvh->nodeNumber();
+    h.nodeOffset = reserveSection(fileSize, h.nodeNumber * sizeof(BVHNode));
+    h.indexNumber = scene._bvh->indexNumber();
+    h.indexOffset = reserveSection(fileSize, h.indexNumber * sizeof(quint32));
+    h.fileSize = fileSize;
+
+    // records
+    CameraRecord cam;
+    const CameraInfo& camInfo = *scene._camInfo;
+    cam.pos[0] = camInfo._pos.x(), cam.pos[1] = camInfo._pos.y(), cam.pos[2] = camInfo._pos.z();
+    cam.dir[0] = camInfo._dir.x(), cam.dir[1] = camInfo._dir.y(), cam.dir[2] = camInfo._dir.z();
+    cam.up[0] = camInfo._up.x(), cam.up[1] = camInfo._up.y(), cam.up[2] = camInfo._up.z();
+    cam.focalLength = camInfo._focalLength;
+    cam.canvasSize[0] = camInfo._canvasSize[0];
+    cam.canvasSize[1] = camInfo._canvasSize[1];
+
+    vector<LightRecord> lights(h.lightNumber);
+    for(size_t i=0;i<h.lightNumber;i++)
+    {
+        const LightSource& l = scene._lightSources[i];
+        lights[i].type = l._type;
+        getPoint(lights[i].pos, l._pos);
+        lights[i].color[0] = l._color.r(), lights[i].color[1] = l._color.g();
+        lights[i].color[2] = l._color.b(), lights[i].color[3] = l._color.a();
+        lights[i].radius = l._radius;
+        getPoint(lights[i].edges, l._edges[0]);
+        getPoint(lights[i].edges + 3, l._edges[1]);
+    }
+
+    vector<ShapeRecord> shapes(h.shapeNumber);
+    size_t meshIdx = 0;
+    for(size_t i=0;i<h.shapeNumber;i++)
+    {
+        ShapeRecord& r = shapes[i];
+        memset(&r, 0, sizeof(r));
+        r.type = Shape::UNKNOWN;
+        r.mesh = NO_MESH;
+
+        const Shape* s = scene._shapes[i];
+        if( !s )
+            continue;
+
+        r.color[0] = s->color().r(), r.color[1] = s->color().g();
+        r.color[2] = s->color().b(), r.color[3] = s->color().a();
+        r.refractionRate = s->refractionRate();
+
+        switch( s->type() )
+        {
+        case Shape::SPHERE:
+        {
+            const Sphere* sp = dynamic_cast<const Sphere*>(s);
+            getPoint(r.params, sp->center());
+            r.params[3] = sp->radius();
+            r.type = Shape::SPHERE;
+            break;
+        }
+        case Shape::TRIANGLE:
+        {
+            const Triangle* tr = dynamic_cast<const Triangle*>(s);
+            for(int k=0;k<3;k++)
+                getPoint(r.params + k * 3, tr->vertex(k));
+            getPoint(r.params + 9, tr->normal());
+            r.type = Shape::TRIANGLE;
+            break;
+        }
+        case Shape::RECTANGLE:
+        {
+            const Rectangle* rt = dynamic_cast<const Rectangle*>(s);
+            for(int k=0;k<4;k++)
+                getPoint(r.params + k * 3, rt->vertex(k));
+            getPoint(r.params + 12, rt->normal());
+            r.type = Shape::RECTANGLE;
+            break;
+        }
+        case Shape::POLYGONMESH:
+        {
+            r.mesh = meshIdx++;
+            r.type = Shape::POLYGONMESH;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    ofstream f(filename.c_str(), ios::out | ios::binary | ios::trunc);
+    if( !f.is_open() )
+        return false;
+
+    writeSection(f, 0, &h, sizeof(h));
+    writeSection(f, h.dependencyOffset, &dependencies[0], dependencies.size() * sizeof(DependencyRecord));
+    for(size_t i=0;i<paths.size();i++)
+        writeSection(f, dependencies[i].pathOffset, paths[i].c_str(), paths[i].size());
+
+    writeSection(f, h.cameraOffset, &cam, sizeof(cam));
+    if( !lights.empty() )
+        writeSection(f, h.lightOffset, &lights[0], lights.size() * sizeof(LightRecord));
+    if( !shapes.empty() )
+        writeSection(f, h.shapeOffset, &shapes[0], shapes.size() * sizeof(ShapeRecord));
+    if( !meshes.empty() )
+        writeSection(f, h.meshOffset, &meshes[0], meshes.size() * sizeof(MeshRecord));
+
+    for(size_t i=0;i<meshList.size();i++)
+    {
+        const PolygonMesh* mesh = meshList[i];
+        const MeshRecord& m = meshes[i];
+        writeSection(f, m.vertexOffset, mesh->vertex(0), m.vertexNumber * 3 * sizeof(Real));
+        writeSection(f, m.normalOffset, mesh->vertexNormal(0), m.vertexNumber * 3 * sizeof(Real));
+        writeSection(f, m.triangleOffset, mesh->triangle(0), m.triangleNumber * 3 * sizeof(quint32));
+        writeSection(f, m.nodeOffset, mesh->hierarchy().nodes(), m.nodeNumber * sizeof(BVHNode));
+        writeSection(f, m.indexOffset, mesh->hierarchy().indices(), m.indexNumber * sizeof(quint32));
+    }
+
+    writeSection(f, h.nodeOffset, scene._bvh->nodes(), h.nodeNumber * sizeof(BVHNode));
+    writeSection(f, h.indexOffset, scene._bvh->indices(), h.indexNumber * sizeof(quint32));
+
+    // pads the file to its full size when the last sections are empty
+    writeSection(f, h.fileSize, 0, 0);
+
+    return f.good();
+}
+
+bool SceneCache::convert(const string &sceneFile, const string &filename)
+{
+    Scene scene;
+    if( !scene.parse(sceneFile) )
+        return false;
+
+    return write(scene, sceneFile, filename);
+}
@@ -0,0 +1,58 @@
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <string>
+using namespace std;
+
+#include <QFile>
+
+class Scene;
+
+/*
+ * Binary scene cache, a parsed scene with its acceleration structures:
+ * header
+ * dependencies, the scene file and the mesh files with their size and
+ * modification time, followed by their paths
+ * camera, light sources
+ * shapes, one fixed size record per shape
+ * meshes, one record per mesh referring to the data sections
+ * data, mesh vertices, normals, triangles and hierarchies, and the
+ * hierarchy of the scene
+ *
+ * Every section is aligned, once the file is mapped the data sections are
+ * used in place. The records are written with the layout of the build
+ * writing them, the scalar size, the node size and the byte order are
+ * stored and a cache of another build is rejected.
+ */
+class SceneCache
+{
+public:
+    SceneCache();
+    ~SceneCache();
+
+    // maps the cache file and fills the scene, the meshes and hierarchies
+    // point into the mapping, which is kept until the cache is destroyed;
+    // returns false and leaves the scene untouched when the file is missing,
+    // written by another build or older than one of its dependencies
+    bool load(Scene* scene, const string& filename);
+
+    // writes a parsed scene, sceneFile is the file it was parsed from;
+    // animated scenes are not cached, their keys are always parsed
+    static bool write(const Scene& scene, const string& sceneFile, const string& filename);
+
+    // parses a scene file and writes its cache
+    static bool convert(const string& sceneFile, const string& filename);
+
+    // cache file used for a scene file, next to it with the cache extension
+    static string cacheFileName(const string& sceneFile);
+
+    static const char magic[8];
+    static const quint32 version;
+    static const string extension;
+
+private:
+    QFile* _file;
+    const uchar* _data;
+};
+
+#endif // SCENECACHE_H
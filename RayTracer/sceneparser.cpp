@@ -3,6 +3,8 @@
 #include "scene.h"
 #include "camerainfo.h"
 #include "lightsource.h"
+#include "polygonmesh.h"
+#include "animation.h"
 #include "utility.hpp"
 
 const char SceneParser::commentTag = '#';
@@ -12,6 +14,7 @@ const string SceneParser::sceneInfoSectionTag = "SCENE_INFO";
 const string SceneParser::cameraInfoSectionTag = "CAMERA_INFO";
 const string SceneParser::lightSourceSectionTag = "LIGHT_SOURCES";
 const string SceneParser::shapeSectionTag = "SHAPES";
+const string SceneParser::animationSectionTag = "ANIMATION";
 
 bool SceneParser::parse(const string filename)
 {
@@ -26,6 +29,9 @@ bool SceneParser::parse(const string filename)
     if( f.bad() )
         return false;
 
+    size_t pos = filename.find_last_of("/\\");
+    _directory = (pos == string::npos) ? "" : filename.substr(0, pos + 1);
+
     // parse the file
     while(!f.eof())
     {
@@ -65,6 +71,12 @@ bool SceneParser::parse(const string filename)
                 if(!parseShapes(f))
                     return false;
             }
+
+            if( sectionName == animationSectionTag )
+            {
+                if(!parseAnimation(f))
+                    return false;
+            }
         }
     }
 
@@ -174,6 +186,8 @@ bool SceneParser::parseCameraInfo(std::ifstream &f)
 
     }while(!f.eof());
 
+    _scene->_camInfo->setup();
+
     return true;
 }
 
@@ -224,7 +238,20 @@ bool SceneParser::parseLightSources(std::ifstream &f)
                     string val;
                     csline >> val;
                     LightSource::LightSourceType type = LightSource::interpretType(val);
-                    _scene->_lightSources[i]._type = type;
+                    LightSource& l = _scene->_lightSources[i];
+                    l._type = type;
+
+                    // the extent follows the type
+                    if( type == LightSource::SPHERE )
+                    {
+                        if( !(csline >> l._radius) || l._radius < 0 )
+                            throw "malformed sphere light.";
+                    }
+                    else if( type == LightSource::AREA )
+                    {
+                        if( !(csline >> l._edges[0] >> l._edges[1]) )
+                            throw "malformed area light.";
+                    }
                 }
 
                 getline(f, cline);
@@ -259,6 +286,47 @@ const string SceneParser::shapeColorTag = "COLOR";
 const string SceneParser::shapeParamTag = "PARAMETERS";
 const string SceneParser::shapeRefractionRateTag = "REFRACTION_RATE";
 
+template <typename ShapeT>
+ShapeT* SceneParser::parseShape(ifstream &f)
+{
+    ShapeT *shape = new ShapeT;
+    shape->refractionRate() = 0;
+
+    string cline, clineTag;
+    stringstream csline;
+
+    getline(f, cline);
+    csline.str(cline);
+    csline >> clineTag;
+
+    if( clineTag == shapeColorTag )
+    {
+        csline >> shape->color();
+    }
+
+    getline(f, cline);
+    csline.clear();
+    csline.str(cline);
+    csline >> clineTag;
+
+    if( clineTag == shapeParamTag )
+    {
+        csline >> (*shape);
+    }
+
+    getline(f, cline);
+    csline.clear();
+    csline.str(cline);
+    csline >> clineTag;
+
+    if( clineTag == shapeRefractionRateTag )
+    {
+        csline >> shape->refractionRate();
+    }
+
+    return shape;
+}
+
 bool SceneParser::parseShapes(std::ifstream &f)
 {
     do
@@ -312,46 +380,38 @@ bool SceneParser::parseShapes(std::ifstream &f)
                     {
                     case Shape::SPHERE:
                     {
-                        Sphere *sp = new Sphere;
-
-                        getline(f, cline);
-                        csline.clear();
-                        csline.str(cline);
-                        csline >> clineTag;
-
-                        if( clineTag == shapeColorTag )
-                        {
-                            csline >> sp->color();
-                        }
-
-                        getline(f, cline);
-                        csline.clear();
-                        csline.str(cline);
-                        csline >> clineTag;
-
-                        if( clineTag == shapeParamTag )
-                        {
-                            csline >> (*sp);
-                        }
-
-                        getline(f, cline);
-                        csline.clear();
-                        csline.str(cline);
-                        csline >> clineTag;
-
-                        if( clineTag == shapeRefractionRateTag )
-                        {
-                            csline >> sp->refractionRate();
-                        }
+                        _scene->_shapes[i] = parseShape<Sphere>(f);
+                        break;
+                    }
+                    case Shape::TRIANGLE:
+                    {
+                        _scene->_shapes[i] = parseShape<Triangle>(f);
+                        break;
+                    }
+                    case Shape::RECTANGLE:
+                    {
+                        _scene->_shapes[i] = parseShape<Rectangle>(f);
+                        break;
+                    }
+                    case Shape::POLYGONMESH:
+                    {
+                        PolygonMesh *mesh = parseShape<PolygonMesh>(f);
 
-                        _scene->_shapes[i] = dynamic_cast<Shape*>(sp);
+                        string meshFile = mesh->fileName();
+                        if( !meshFile.empty() && meshFile[0] != '/' )
+                            meshFile = _directory + meshFile;
+                        mesh->load(meshFile);
 
+                        _scene->_shapes[i] = dynamic_cast<Shape*>(mesh);
                         break;
                     }
                     default:
+                        _scene->_shapes[i] = 0;
                         break;
                     }
                 }
+                else
+                    _scene->_shapes[i] = 0;
             }
 
             if( _scene->hasBoundingBox() )
@@ -360,60 +420,60 @@ bool SceneParser::parseShapes(std::ifstream &f)
 
                 // back
                 Rectangle *back = new Rectangle;
-                back->color() = DblColor4(0.5, 0.5, 0.5, 1);
-                back->normal() = DblVector3D(0, 0, 1);
+                back->color() = RealColor4(0.5, 0.5, 0.5, 1);
+                back->normal() = RealVector3D(0, 0, 1);
                 back->refractionRate() = 0;
-                back->vertex(0) = DblPoint3D( _scene->max(0), _scene->max(1), _scene->min(2));
-                back->vertex(1) = DblPoint3D( _scene->min(0), _scene->max(1), _scene->min(2));
-                back->vertex(2) = DblPoint3D( _scene->min(0), _scene->min(1), _scene->min(2));
-                back->vertex(3) = DblPoint3D( _scene->max(0), _scene->min(1), _scene->min(2));
+                back->vertex(0) = RealPoint3D( _scene->max(0), _scene->max(1), _scene->min(2));
+                back->vertex(1) = RealPoint3D( _scene->min(0), _scene->max(1), _scene->min(2));
+                back->vertex(2) = RealPoint3D( _scene->min(0), _scene->min(1), _scene->min(2));
+                back->vertex(3) = RealPoint3D( _scene->max(0), _scene->min(1), _scene->min(2));
 
                 _scene->_shapes[regularShapeNumber + 0] = dynamic_cast<Shape*>(back);
 
                 // left
                 Rectangle *left = new Rectangle;
-                left->color() = DblColor4(0.95, 0.35, 0.35, 1);
-                left->normal() = DblVector3D(1, 0, 0);
+                left->color() = RealColor4(0.95, 0.35, 0.35, 1);
+                left->normal() = RealVector3D(1, 0, 0);
                 left->refractionRate() = 0;
-                left->vertex(0) = DblPoint3D( _scene->min(0), _scene->max(1), _scene->min(2));
-                left->vertex(1) = DblPoint3D( _scene->min(0), _scene->max(1), _scene->max(2));
-                left->vertex(2) = DblPoint3D( _scene->min(0), _scene->min(1), _scene->max(2));
-                left->vertex(3) = DblPoint3D( _scene->min(0), _scene->min(1), _scene->min(2));
+                left->vertex(0) = RealPoint3D( _scene->min(0), _scene->max(1), _scene->min(2));
+                left->vertex(1) = RealPoint3D( _scene->min(0), _scene->max(1), _scene->max(2));
+                left->vertex(2) = RealPoint3D( _scene->min(0), _scene->min(1), _scene->max(2));
+                left->vertex(3) = RealPoint3D( _scene->min(0), _scene->min(1), _scene->min(2));
                 _scene->_shapes[regularShapeNumber + 1] = dynamic_cast<Shape*>(left);
 
                 // right
                 Rectangle *right = new Rectangle;
-                right->color() = DblColor4(0.35, 0.95, 0.35, 1);
-                right->normal() = DblVector3D(-1, 0, 0);
+                right->color() = RealColor4(0.35, 0.95, 0.35, 1);
+                right->normal() = RealVector3D(-1, 0, 0);
                 right->refractionRate() = 0;
-                right->vertex(0) = DblPoint3D( _scene->max(0), _scene->max(1), _scene->min(2));
-                right->vertex(1) = DblPoint3D( _scene->max(0), _scene->max(1), _scene->max(2));
-                right->vertex(2) = DblPoint3D( _scene->max(0), _scene->min(1), _scene->max(2));
-                right->vertex(3) = DblPoint3D( _scene->max(0), _scene->min(1), _scene->min(2));
+                right->vertex(0) = RealPoint3D( _scene->max(0), _scene->max(1), _scene->min(2));
+                right->vertex(1) = RealPoint3D( _scene->max(0), _scene->max(1), _scene->max(2));
+                right->vertex(2) = RealPoint3D( _scene->max(0), _scene->min(1), _scene->max(2));
+                right->vertex(3) = RealPoint3D( _scene->max(0), _scene->min(1), _scene->min(2));
 
                 _scene->_shapes[regularShapeNumber + 2] = dynamic_cast<Shape*>(right);
 
                 // bottom
                 Rectangle *bottom = new Rectangle;
-                bottom->color() = DblColor4(0.25, 0.45, 0.95, 1);
-                bottom->normal() = DblVector3D(0, 1, 0);
+                bottom->color() = RealColor4(0.25, 0.45, 0.95, 1);
+                bottom->normal() = RealVector3D(0, 1, 0);
                 bottom->refractionRate() = 0;
-                bottom->vertex(0) = DblPoint3D( _scene->min(0), _scene->min(1), _scene->min(2));
-                bottom->vertex(1) = DblPoint3D( _scene->min(0), _scene->min(1), _scene->max(2));
-                bottom->vertex(2) = DblPoint3D( _scene->max(0), _scene->min(1), _scene->max(2));
-                bottom->vertex(3) = DblPoint3D( _scene->max(0), _scene->min(1), _scene->min(2));
+                bottom->vertex(0) = RealPoint3D( _scene->min(0), _scene->min(1), _scene->min(2));
+                bottom->vertex(1) = RealPoint3D( _scene->min(0), _scene->min(1), _scene->max(2));
+                bottom->vertex(2) = RealPoint3D( _scene->max(0), _scene->min(1), _scene->max(2));
+                bottom->vertex(3) = RealPoint3D( _scene->max(0), _scene->min(1), _scene->min(2));
 
                 _scene->_shapes[regularShapeNumber + 3] = dynamic_cast<Shape*>(bottom);
 
                 // top
                 Rectangle *top = new Rectangle;
-                top->color() = DblColor4(0.5, 0.5, 0.5, 1);
-                top->normal() = DblVector3D(0, -1, 0);
+                top->color() = RealColor4(0.5, 0.5, 0.5, 1);
+                top->normal() = RealVector3D(0, -1, 0);
                 top->refractionRate() = 0;
-                top->vertex(0) = DblPoint3D( _scene->min(0), _scene->max(1), _scene->min(2));
-                top->vertex(1) = DblPoint3D( _scene->min(0), _scene->max(1), _scene->max(2));
-                top->vertex(2) = DblPoint3D( _scene->max(0), _scene->max(1), _scene->max(2));
-                top->vertex(3) = DblPoint3D( _scene->max(0), _scene->max(1), _scene->min(2));
+                top->vertex(0) = RealPoint3D( _scene->min(0), _scene->max(1), _scene->min(2));
+                top->vertex(1) = RealPoint3D( _scene->min(0), _scene->max(1), _scene->max(2));
+                top->vertex(2) = RealPoint3D( _scene->max(0), _scene->max(1), _scene->max(2));
+                top->vertex(3) = RealPoint3D( _scene->max(0), _scene->max(1), _scene->min(2));
 
                 _scene->_shapes[regularShapeNumber + 4] = dynamic_cast<Shape*>(top);
             }
@@ -423,14 +483,14 @@ bool SceneParser::parseShapes(std::ifstream &f)
             {
                 // add ground to the scene
                 Rectangle *ground = new Rectangle;
-                ground->color() = DblColor4(0.95, 0.95, 0.95, 1);
-                ground->normal() = DblVector3D(0, 1, 0);
+                ground->color() = RealColor4(0.95, 0.95, 0.95, 1);
+                ground->normal() = RealVector3D(0, 1, 0);
                 ground->refractionRate() = 0;
 
-                ground->vertex(0) = DblPoint3D( _scene->min(0), 0, _scene->min(2));
-                ground->vertex(1) = DblPoint3D( _scene->min(0), 0, _scene->max(2));
-                ground->vertex(2) = DblPoint3D( _scene->max(0), 0, _scene->max(2));
-                ground->vertex(3) = DblPoint3D( _scene->max(0), 0, _scene->min(2));
+                ground->vertex(0) = RealPoint3D( _scene->min(0), 0, _scene->min(2));
+                ground->vertex(1) = RealPoint3D( _scene->min(0), 0, _scene->max(2));
+                ground->vertex(2) = RealPoint3D( _scene->max(0), 0, _scene->max(2));
+                ground->vertex(3) = RealPoint3D( _scene->max(0), 0, _scene->min(2));
                 _scene->_shapes[regularShapeNumber] = dynamic_cast<Shape*>(ground);
             }
         }
@@ -441,3 +501,88 @@ bool SceneParser::parseShapes(std::ifstream &f)
 }
 
 
+
+const string SceneParser::frameRangeTag = "FRAME_RANGE";
+const string SceneParser::shapeKeyTag = "SHAPE_KEY";
+const string SceneParser::cameraKeyTag = "CAMERA_KEY";
+
+bool SceneParser::parseAnimation(std::ifstream &f)
+{
+    if( !_scene->_animation )
+        _scene->_animation = new Animation;
+    Animation* animation = _scene->_animation;
+
+    do
+    {
+        char c = f.peek();
+        if( c == sectionHeaderTag )
+            break;
+
+        // get a line from the input file
+        string line;
+        getline(f, line);
+
+        // get the line tag
+        stringstream sline(line);
+        string lineTag;
+        sline >> lineTag;
+
+        if( lineTag == frameRangeTag )
+        {
+            int first, last;
+            if( !(sline >> first >> last) )
+                throw "malformed animation frame range.";
+            animation->setFrameRange(first, last);
+        }
+
+        if( lineTag == shapeKeyTag )
+        {
+            // a single shape or a range of them
+            string shapes;
+            sline >> shapes;
+
+            size_t first = 0, last = 0;
+            char dash = 0;
+            istringstream sshapes(shapes);
+            sshapes >> first;
+            if( !sshapes )
+                throw "malformed animation key.";
+            if( sshapes >> dash )
+            {
+                if( dash != '-' || !(sshapes >> last) || last < first )
+                    throw "malformed animation key.";
+            }
+            else
+                last = first;
+
+            Keyframe k;
+            sline >> k.frame
+                  >> k.translation[0] >> k.translation[1] >> k.translation[2]
+                  >> k.rotation[0] >> k.rotation[1] >> k.rotation[2];
+            if( !sline )
+                throw "malformed animation key.";
+
+            // the scale is optional
+            double scale;
+            if( sline >> scale )
+                k.scale = scale;
+
+            for(size_t i=first;i<=last;i++)
+                animation->addShapeKey(i, k);
+        }
+
+        if( lineTag == cameraKeyTag )
+        {
+            Keyframe k;
+            sline >> k.frame
+                  >> k.translation[0] >> k.translation[1] >> k.translation[2]
+                  >> k.rotation[0] >> k.rotation[1] >> k.rotation[2];
+            if( !sline )
+                throw "malformed animation key.";
+
+            animation->addCameraKey(k);
+        }
+    }while(!f.eof());
+
+    return true;
+}
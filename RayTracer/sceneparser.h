@@ -24,11 +24,35 @@ using namespace std;
  * LIGHT_TYPE POINT
  * LIGHT_POS -3.0 3.0 3.0
  * ...
+ *
+ * the light type is POINT, SPHERE followed by the radius, or AREA followed
+ * by the two edges of a rectangle, whose center is the light position:
+ * LIGHT_TYPE AREA 2.0 0 0 0 0 1.0
  * # shape info
  * SHAPE shapeName
+ * COLOR r g b a
  * PARAMETERS param0, param1
  * REFRACTION_RATE value
  * ...
+ *
+ * shapeName is one of sphere, triangle, rectangle or polygonmesh, the
+ * parameters of a polygon mesh are an OBJ or PLY file, relative to the
+ * scene file, followed by an optional scale and offset:
+ * SHAPE polygonmesh
+ * PARAMETERS bunny.obj 10.0 0.0 -1.0 0.0
+ *
+ * # animation info, optional
+ * FRAME_RANGE first last
+ * SHAPE_KEY shapes frame tx ty tz rx ry rz scale
+ * CAMERA_KEY frame tx ty tz rx ry rz
+ * ...
+ *
+ * shapes is the index of a shape, in the order of the shape section, or a
+ * range of them such as 0-4; a key rotates the shape about the x, y and z
+ * axes in turn by the angles in degrees, scales it, both about the origin,
+ * and moves it by the translation; the scale is optional. The camera keys
+ * move and turn the camera the same way. The frame range defaults to the
+ * frames of the keys.
  */
 
 class Scene;
@@ -53,6 +77,7 @@ public:
     static const string cameraInfoSectionTag;
     static const string lightSourceSectionTag;
     static const string shapeSectionTag;
+    static const string animationSectionTag;
 
     static const string sceneRangeTag;
     static const string boundingBoxTag;
@@ -75,14 +100,26 @@ public:
     static const string shapeParamTag;
     static const string shapeRefractionRateTag;
 
+    static const string frameRangeTag;
+    static const string shapeKeyTag;
+    static const string cameraKeyTag;
+
 protected:
     bool parseSceneInfo(ifstream &f);
     bool parseCameraInfo(ifstream &f);
     bool parseLightSources(ifstream &f);
     bool parseShapes(ifstream &f);
+    bool parseAnimation(ifstream &f);
+
+    // reads the color, parameters and refraction rate lines of a shape
+    template <typename ShapeT>
+    ShapeT* parseShape(ifstream &f);
 
 private:
     Scene *_scene;
+
+    // directory of the scene file, mesh files are looked up relative to it
+    string _directory;
 };
 
 #endif // SCENEPARSER_H
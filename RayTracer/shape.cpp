@@ -1,4 +1,6 @@
 #include "shape.h"
+#include "polygonmesh.h"
+#include "raypacket.h"
 #include "utility.hpp"
 
 Shape::ShapeType Shape::interpretType(const string &str)
@@ -8,11 +10,11 @@ Shape::ShapeType Shape::interpretType(const string &str)
         return SPHERE;
     else if( lowerStr == "triangle" )
         return TRIANGLE;
-    else if( lowerStr == "triangle" )
+    else if( lowerStr == "rectangle" )
         return RECTANGLE;
-    else if( lowerStr == "triangle" )
+    else if( lowerStr == "cube" )
         return CUBE;
-    else if( lowerStr == "triangle" )
+    else if( lowerStr == "polygonmesh" )
         return POLYGONMESH;
     else
         return UNKNOWN;
@@ -28,6 +30,7 @@ istream& operator>>(istream& s, Triangle& tr)
 {
     for(int i=0;i<3;i++)
         s >> tr._vertices[i];
+    tr._normal = normalize( crossProduct(tr._vertices[1] - tr._vertices[0], tr._vertices[2] - tr._vertices[0]) );
     return s;
 }
 
@@ -35,6 +38,7 @@ istream& operator>>(istream& s, Rectangle& rt)
 {
     for(int i=0;i<4;i++)
         s >> rt._vertices[i];
+    rt._normal = normalize( crossProduct(rt._vertices[1] - rt._vertices[0], rt._vertices[3] - rt._vertices[0]) );
     return s;
 }
 
@@ -45,21 +49,14 @@ istream& operator>>(istream& s, Cube& c)
     return s;
 }
 
-istream& operator>>(istream& s, PolygonMesh& p)
-{
-    // TBA
-    throw "not yet implemented.";
-    return s;
-}
-
 bool Sphere::intersect(const Ray &r, Hit &h)
 {
     // get the distance of the ray to the sphere's centre
-    double dist = -1.0;
+    Real dist = -1.0;
 
-    DblVector3D origToCenter = _center - r.origin();
-    DblVector3D dirVec = normalize ( r.dir() );
-    DblVector3D crossProduct = GeometryUtils::crossProduct(origToCenter, dirVec);
+    RealVector3D origToCenter = _center - r.origin();
+    RealVector3D dirVec = normalize ( r.dir() );
+    RealVector3D crossProduct = GeometryUtils::crossProduct(origToCenter, dirVec);
 
     // any valid ray should have a length greater than 0
     assert( length(r.dir()) > 0 );
@@ -69,19 +66,19 @@ bool Sphere::intersect(const Ray &r, Hit &h)
     if( dist <= _radius )
     {
         // intersects, calculate the hit point
-        double part1 = dotProduct( origToCenter, dirVec );       // problematic
+        Real part1 = dotProduct( origToCenter, dirVec );       // problematic
         if( part1 < 0 )
             return false;
 
-        double part2 = sqrt(_radius * _radius - dist * dist);
-        double t1 = part1 + part2;
-        double t2 = part1 - part2;
+        Real part2 = sqrt(_radius * _radius - dist * dist);
+        Real t1 = part1 + part2;
+        Real t2 = part1 - part2;
 
-        double nearT, farT;
+        Real nearT, farT;
         nearT = t2, farT = t1;
 
-        const double ZERO_THRESHOLD = 1e-3;
-        double origToHitLength;
+        const Real ZERO_THRESHOLD = 1e-3;
+        Real origToHitLength;
         if( nearT <= ZERO_THRESHOLD )
             origToHitLength = farT;
         else
@@ -89,8 +86,8 @@ bool Sphere::intersect(const Ray &r, Hit &h)
 
         if( origToHitLength < h.t())
         {
-            DblVector3D diff = dirVec * origToHitLength;
-            DblVector3D hitPoint = r.origin() + diff;
+            RealVector3D diff = dirVec * origToHitLength;
+            RealVector3D hitPoint = r.origin() + diff;
 
             if( _refractionRate > 0 )
                 h.set( origToHitLength, _color, hitPoint - _center, true, true, this->_refractionRate );
@@ -104,14 +101,14 @@ bool Sphere::intersect(const Ray &r, Hit &h)
         return false;
 }
 
-bool Sphere::blockTest(const Ray &r, double t)
+bool Sphere::blockTest(const Ray &r, Real t)
 {
     // get the distance of the ray to the sphere's centre
-    double dist = -1.0;
+    Real dist = -1.0;
 
-    DblVector3D origToCenter = _center - r.origin();
-    DblVector3D dirVec = normalize ( r.dir() );
-    DblVector3D crossProduct = GeometryUtils::crossProduct(origToCenter, dirVec);
+    RealVector3D origToCenter = _center - r.origin();
+    RealVector3D dirVec = normalize ( r.dir() );
+    RealVector3D crossProduct = GeometryUtils::crossProduct(origToCenter, dirVec);
 
     // any valid ray should have a length greater than 0
     assert( length(r.dir()) > 0 );
@@ -121,19 +118,19 @@ bool Sphere::blockTest(const Ray &r, double t)
     if( dist <= _radius )
     {
         // intersects, calculate the hit point
-        double part1 = dotProduct( origToCenter, dirVec );
+        Real part1 = dotProduct( origToCenter, dirVec );
         if( part1 < 0 )
             return false;
 
-        double part2 = sqrt(_radius * _radius - dist * dist);
-        double t1 = part1 + part2;
-        double t2 = part1 - part2;
+        Real part2 = sqrt(_radius * _radius - dist * dist);
+        Real t1 = part1 + part2;
+        Real t2 = part1 - part2;
 
-        double nearT, farT;
+        Real nearT, farT;
         nearT = t2, farT = t1;
 
-        const double ZERO_THRESHOLD = 1e-3;
-        double origToHitLength;
+        const Real ZERO_THRESHOLD = 1e-3;
+        Real origToHitLength;
         if( nearT <= ZERO_THRESHOLD )
             origToHitLength = farT;
         else
@@ -153,7 +150,7 @@ bool Rectangle::intersect(const Ray &r, Hit &h)
     // rectangle and ray intersection
 
     // plane parameters
-    double A, B, C, D;
+    Real A, B, C, D;
 
     A = _vertices[0].y() * ( _vertices[1].z() - _vertices[2].z())
             + _vertices[1].y() * ( _vertices[2].z() - _vertices[0].z())
@@ -171,29 +168,29 @@ bool Rectangle::intersect(const Ray &r, Hit &h)
             - _vertices[1].x() * ( _vertices[2].y() * _vertices[0].z() - _vertices[0].y() * _vertices[2].z() )
             - _vertices[2].x() * ( _vertices[0].y() * _vertices[1].z() - _vertices[1].y() * _vertices[0].z() );
 
-    DblVector3D dirVec = normalize( r.dir() );
-    DblPoint3D origPoint = r.origin();
+    RealVector3D dirVec = normalize( r.dir() );
+    RealPoint3D origPoint = r.origin();
 
-    double origToHitLength = - ( A * origPoint.x() + B * origPoint.y() + C * origPoint
+    Real origToHitLength = - ( A * origPoint.x() + B * origPoint.y() + C * origPoint
                                  .z() + D)
             / ( A * dirVec.x() + B * dirVec.y() + C * dirVec.z() );
 
-    const double ZERO_THRESHOLD = 1e-2;
+    const Real ZERO_THRESHOLD = 1e-2;
     if( origToHitLength < ZERO_THRESHOLD )
         return false;
     else
     {
         // test if the hit point is within the rectangle
-        DblVector3D diff = dirVec;
+        RealVector3D diff = dirVec;
         diff = diff * origToHitLength;
-        DblPoint3D hitPoint = r.origin();
+        RealPoint3D hitPoint = r.origin();
         hitPoint = hitPoint + diff;
 
-        DblVector3D v1 = _vertices[1] - _vertices[0];
-        DblVector3D v2 = _vertices[3] - _vertices[0];
-        DblVector3D v = hitPoint - _vertices[0];
+        RealVector3D v1 = _vertices[1] - _vertices[0];
+        RealVector3D v2 = _vertices[3] - _vertices[0];
+        RealVector3D v = hitPoint - _vertices[0];
 
-        double alpha1, alpha2;
+        Real alpha1, alpha2;
         alpha1 = dotProduct(v, v1) / length( v1 );
         alpha2 = dotProduct(v, v2) / length( v2 );
 
@@ -215,12 +212,12 @@ bool Rectangle::intersect(const Ray &r, Hit &h)
     }
 }
 
-bool Rectangle::blockTest(const Ray &r, double t)
+bool Rectangle::blockTest(const Ray &r, Real t)
 {
     // rectangle and ray intersection
 
     // plane parameters
-    double A, B, C, D;
+    Real A, B, C, D;
 
     A = _vertices[0].y() * ( _vertices[1].z() - _vertices[2].z())
             + _vertices[1].y() * ( _vertices[2].z() - _vertices[0].z())
@@ -238,29 +235,29 @@ bool Rectangle::blockTest(const Ray &r, double t)
             - _vertices[1].x() * ( _vertices[2].y() * _vertices[0].z() - _vertices[0].y() * _vertices[2].z() )
             - _vertices[2].x() * ( _vertices[0].y() * _vertices[1].z() - _vertices[1].y() * _vertices[0].z() );
 
-    DblVector3D dirVec = normalize( r.dir() );
-    DblPoint3D origPoint = r.origin();
+    RealVector3D dirVec = normalize( r.dir() );
+    RealPoint3D origPoint = r.origin();
 
-    double origToHitLength = - ( A * origPoint.x() + B * origPoint.y() + C * origPoint
+    Real origToHitLength = - ( A * origPoint.x() + B * origPoint.y() + C * origPoint
                                  .z() + D)
             / ( A * dirVec.x() + B * dirVec.y() + C * dirVec.z() );
 
-    const double ZERO_THRESHOLD = 1e-2;
+    const Real ZERO_THRESHOLD = 1e-2;
     if( origToHitLength < ZERO_THRESHOLD )
         return false;
     else
     {
         // test if the hit point is within the rectangle
-        DblVector3D diff = dirVec;
+        RealVector3D diff = dirVec;
         diff = diff * origToHitLength;
-        DblPoint3D hitPoint = r.origin();
+        RealPoint3D hitPoint = r.origin();
         hitPoint = hitPoint + diff;
 
-        DblVector3D v1 = _vertices[1] - _vertices[0];
-        DblVector3D v2 = _vertices[3] - _vertices[0];
-        DblVector3D v = hitPoint - _vertices[0];
+        RealVector3D v1 = _vertices[1] - _vertices[0];
+        RealVector3D v2 = _vertices[3] - _vertices[0];
+        RealVector3D v = hitPoint - _vertices[0];
 
-        double alpha1, alpha2;
+        Real alpha1, alpha2;
         alpha1 = dotProduct(v, v1) / length( v1 );
         alpha2 = dotProduct(v, v2) / length( v2 );
 
@@ -276,3 +273,74 @@ bool Rectangle::blockTest(const Ray &r, double t)
             return false;
     }
 }
+
+bool Triangle::intersect(const Ray &r, Hit &h)
+{
+    Real v[3][3];
+    for(int i=0;i<3;i++)
+        v[i][0] = _vertices[i].x(), v[i][1] = _vertices[i].y(), v[i][2] = _vertices[i].z();
+
+    const Real ZERO_THRESHOLD = 1e-3;
+    Real t, bary[3];
+    if( !intersectTriangle(TriangleRay(r), v[0], v[1], v[2], ZERO_THRESHOLD, REAL_MAX, t, bary) )
+        return false;
+
+    if( t < h.t() )
+    {
+        if( _refractionRate > 0 )
+            h.set( t, _color, _normal, true, true, _refractionRate );
+        else
+            h.set( t, _color, _normal );
+    }
+
+    return true;
+}
+
+bool Triangle::blockTest(const Ray &r, Real t)
+{
+    Real v[3][3];
+    for(int i=0;i<3;i++)
+        v[i][0] = _vertices[i].x(), v[i][1] = _vertices[i].y(), v[i][2] = _vertices[i].z();
+
+    const Real ZERO_THRESHOLD = 1e-3;
+    Real hitT, bary[3];
+    return intersectTriangle(TriangleRay(r), v[0], v[1], v[2], ZERO_THRESHOLD, t, hitT, bary);
+}
+
+BoundingBox Triangle::boundingBox() const
+{
+    BoundingBox box;
+    for(int i=0;i<3;i++)
+        box.expand(_vertices[i]);
+    return box;
+}
+
+BoundingBox Sphere::boundingBox() const
+{
+    return BoundingBox(RealPoint3D(_center.x() - _radius, _center.y() - _radius, _center.z() - _radius),
+                       RealPoint3D(_center.x() + _radius, _center.y() + _radius, _center.z() + _radius));
+}
+
+BoundingBox Rectangle::boundingBox() const
+{
+    BoundingBox box;
+    for(int i=0;i<4;i++)
+        box.expand(_vertices[i]);
+    return box;
+}
+
+void Shape::intersectPacket(RayPacket &p, int shapeIdx)
+{
+    for(size_t i=0;i<p.size;i++)
+    {
+        Ray r(RealVector3D(p.dx[i], p.dy[i], p.dz[i]),
+              RealPoint3D(p.ox[i], p.oy[i], p.oz[i]));
+        Hit h;
+        h.t() = p.t[i];
+        if( intersect(r, h) && h.t() < p.t[i] )
+        {
+            p.t[i] = h.t();
+            p.shape[i] = shapeIdx;
+        }
+    }
+}
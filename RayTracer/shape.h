@@ -9,9 +9,12 @@ using namespace std;
 using namespace GeometryUtils;
 
 #include "color.hpp"
+#include "boundingbox.hpp"
 
 #include "raytracer.h"
 
+struct RayPacket;
+
 class Shape
 {
 public:
@@ -37,22 +40,27 @@ public:
     virtual ~Shape(){}
 
     virtual bool intersect(const Ray &r, Hit &h) = 0;
-    virtual bool blockTest(const Ray &r, double t) = 0;
+    virtual bool blockTest(const Ray &r, Real t) = 0;
+    virtual BoundingBox boundingBox() const = 0;
+
+    // tests a packet of rays, updates the nearest hit of every lane hitting
+    // this shape, the default goes through the scalar test ray by ray
+    virtual void intersectPacket(RayPacket& p, int shapeIdx);
 
     const ShapeType& type() const { return _type; }
     static ShapeType interpretType(const string&);
 
 public:
-    double& refractionRate(){ return _refractionRate; }
-    const double& refractionRate() const{ return _refractionRate; }
+    Real& refractionRate(){ return _refractionRate; }
+    const Real& refractionRate() const{ return _refractionRate; }
 
-    const DblColor4& color() const { return _color; }
-    DblColor4& color() {return _color;}
+    const RealColor4& color() const { return _color; }
+    RealColor4& color() {return _color;}
 
 protected:
-    double _refractionRate;
+    Real _refractionRate;
     ShapeType _type;
-    DblColor4 _color;
+    RealColor4 _color;
 };
 
 class Triangle : public Shape
@@ -68,11 +76,34 @@ public:
     }
     ~Triangle(){}
 
+    virtual bool intersect(const Ray &r, Hit &h);
+    virtual bool blockTest(const Ray &r, Real t);
+    virtual BoundingBox boundingBox() const;
+
+    const RealPoint3D& vertex( size_t idx ) const
+    {
+        if( idx < 3)
+            return _vertices[idx];
+        else
+            throw "index out of range.";
+    }
+
+    RealPoint3D& vertex( size_t idx )
+    {
+        if( idx < 3)
+            return _vertices[idx];
+        else
+            throw "index out of range.";
+    }
+
+    const RealVector3D& normal() const { return _normal; }
+    RealVector3D& normal() { return _normal; }
+
     friend istream& operator>>(istream&, Triangle&);
 
 private:
-    DblPoint3D _vertices[3];
-    DblVector3D _normal;
+    RealPoint3D _vertices[3];
+    RealVector3D _normal;
 };
 
 class Rectangle : public Shape
@@ -89,9 +120,10 @@ public:
     virtual ~Rectangle(){}
 
     virtual bool intersect(const Ray &r, Hit &h);
-    virtual bool blockTest(const Ray &r, double t);
+    virtual bool blockTest(const Ray &r, Real t);
+    virtual BoundingBox boundingBox() const;
 
-    const DblPoint3D& vertex( size_t idx ) const
+    const RealPoint3D& vertex( size_t idx ) const
     {
         if( idx < 4)
             return _vertices[idx];
@@ -99,7 +131,7 @@ public:
             throw "index out of range.";
     }
 
-    DblPoint3D& vertex( size_t idx )
+    RealPoint3D& vertex( size_t idx )
     {
         if( idx < 4)
             return _vertices[idx];
@@ -107,14 +139,14 @@ public:
             throw "index out of range.";
     }
 
-    const DblVector3D& normal() const { return _normal; }
-    DblVector3D& normal() { return _normal; }
+    const RealVector3D& normal() const { return _normal; }
+    RealVector3D& normal() { return _normal; }
 
     friend istream& operator>>(istream&, Rectangle&);
 
 private:
-    DblPoint3D _vertices[4];
-    DblVector3D _normal;
+    RealPoint3D _vertices[4];
+    RealVector3D _normal;
 };
 
 class Sphere : public Shape
@@ -130,19 +162,20 @@ public:
     virtual ~Sphere(){}
 
     virtual bool intersect(const Ray &r, Hit &h);
-    virtual bool blockTest(const Ray &r, double t);
+    virtual bool blockTest(const Ray &r, Real t);
+    virtual BoundingBox boundingBox() const;
 
     friend istream& operator>>(istream&, Sphere&);
 
-    const DblPoint3D& center() const { return _center; }
-    DblPoint3D& center() { return _center; }
+    const RealPoint3D& center() const { return _center; }
+    RealPoint3D& center() { return _center; }
 
-    const double& radius() const { return _radius; }
-    double& radius() { return _radius; }
+    const Real& radius() const { return _radius; }
+    Real& radius() { return _radius; }
 
 private:
-    DblPoint3D _center;
-    double _radius;
+    RealPoint3D _center;
+    Real _radius;
 };
 
 class Cube : public Shape
@@ -160,19 +193,7 @@ public:
     friend istream& operator>>(istream&, Cube&);
 
 private:
-    DblPoint3D _vertices[8];
-};
-
-class PolygonMesh : public Shape
-{
-public:
-    PolygonMesh():Shape(POLYGONMESH){}
-    ~PolygonMesh(){}
-
-    friend istream& operator>>(istream&, PolygonMesh&);
-
-private:
-    // a list of polygons
+    RealPoint3D _vertices[8];
 };
 
 #endif // SHAPE_H
@@ -0,0 +1,409 @@
+#include "shapetable.h"
+#include "shape.h"
+#include "raypacket.h"
+#include "simdutil.hpp"
+
+#include <map>
+
+ShapeTable::ShapeTable():
+    _shapes(0)
+{
+}
+
+void ShapeTable::clear()
+{
+    _types.clear();
+    _slots.clear();
+    _materials.clear();
+
+    for(int k=0;k<3;k++)
+    {
+        _sphereCenter[k].clear();
+        _rectCorner[k].clear();
+        _rectEdge1[k].clear();
+        _rectEdge2[k].clear();
+        _rectNormal[k].clear();
+    }
+    for(int k=0;k<4;k++)
+        _rectPlane[k].clear();
+    _sphereRadius.clear();
+    _rectLength[0].clear();
+    _rectLength[1].clear();
+
+    _materialColors.clear();
+    _materialRefractionRates.clear();
+
+    _shapes = 0;
+}
+
+void ShapeTable::build(Shape **shapes, size_t shapeNumber)
+{
+    clear();
+
+    _shapes = shapes;
+    _types.resize(shapeNumber, Shape::UNKNOWN);
+    _slots.resize(shapeNumber, 0);
+    _materials.resize(shapeNumber, 0);
+
+    // shapes sharing color and refraction rate share a material
+    map<vector<Real>, unsigned int> materialMap;
+
+    for(size_t i=0;i<shapeNumber;i++)
+    {
+        const Shape* s = shapes[i];
+        if( !s )
+            continue;
+
+        vector<Real> key(5);
+        key[0] = s->color().r(), key[1] = s->color().g();
+        key[2] = s->color().b(), key[3] = s->color().a();
+        key[4] = s->refractionRate();
+
+        map<vector<Real>, unsigned int>::iterator it = materialMap.find(key);
+        if( it == materialMap.end() )
+        {
+            unsigned int materialIdx = _materialColors.size();
+            _materialColors.push_back(s->color());
+            _materialRefractionRates.push_back(s->refractionRate());
+            it = materialMap.insert(make_pair(key, materialIdx)).first;
+        }
+        _materials[i] = it->second;
+
+        switch( s->type() )
+        {
+        case Shape::SPHERE:
+            _types[i] = Shape::SPHERE;
+            _slots[i] = _sphereRadius.size();
+            for(int k=0;k<3;k++)
+                _sphereCenter[k].push_back(0);
+            _sphereRadius.push_back(0);
+            break;
+        case Shape::RECTANGLE:
+            _types[i] = Shape::RECTANGLE;
+            _slots[i] = _rectLength[0].size();
+            for(int k=0;k<3;k++)
+            {
+                _rectCorner[k].push_back(0);
+                _rectEdge1[k].push_back(0);
+                _rectEdge2[k].push_back(0);
+                _rectNormal[k].push_back(0);
+            }
+            for(int k=0;k<4;k++)
+                _rectPlane[k].push_back(0);
+            _rectLength[0].push_back(0);
+            _rectLength[1].push_back(0);
+            break;
+        default:
+            _types[i] = Shape::UNKNOWN;
+            break;
+        }
+
+        updateGeometry(i);
+    }
+}
+
+void ShapeTable::updateGeometry(size_t idx)
+{
+    size_t slot = _slots[idx];
+
+    switch( _types[idx] )
+    {
+    case Shape::SPHERE:
+    {
+        const Sphere* sp = dynamic_cast<const Sphere*>(_shapes[idx]);
+        _sphereCenter[0][slot] = sp->center().x();
+        _sphereCenter[1][slot] = sp->center().y();
+        _sphereCenter[2][slot] = sp->center().z();
+        _sphereRadius[slot] = sp->radius();
+        break;
+    }
+    case Shape::RECTANGLE:
+    {
+        const Rectangle* rt = dynamic_cast<const Rectangle*>(_shapes[idx]);
+        const RealPoint3D& p0 = rt->vertex(0);
+        const RealPoint3D& p1 = rt->vertex(1);
+        const RealPoint3D& p2 = rt->vertex(2);
+        const RealPoint3D& p3 = rt->vertex(3);
+
+        // plane parameters, same expressions as Rectangle::intersect
+        Real A, B, C, D;
+
+        A = p0.y() * ( p1.z() - p2.z())
+                + p1.y() * ( p2.z() - p0.z())
+                + p2.y() * ( p0.z() - p1.z());
+
+        B = p0.z() * ( p1.x() - p2.x())
+                + p1.z() * ( p2.x() - p0.x())
+                + p2.z() * ( p0.x() - p1.x());
+
+        C = p0.x() * ( p1.y() - p2.y())
+                + p1.x() * ( p2.y() - p0.y())
+                + p2.x() * ( p0.y() - p1.y());
+
+        D = - p0.x() * ( p1.y() * p2.z() - p2.y() * p1.z() )
+                - p1.x() * ( p2.y() * p0.z() - p0.y() * p2.z() )
+                - p2.x() * ( p0.y() * p1.z() - p1.y() * p0.z() );
+
+        RealVector3D v1 = p1 - p0;
+        RealVector3D v2 = p3 - p0;
+
+        _rectPlane[0][slot] = A;
+        _rectPlane[1][slot] = B;
+        _rectPlane[2][slot] = C;
+        _rectPlane[3][slot] = D;
+        _rectCorner[0][slot] = p0.x();
+        _rectCorner[1][slot] = p0.y();
+        _rectCorner[2][slot] = p0.z();
+        _rectEdge1[0][slot] = v1.x();
+        _rectEdge1[1][slot] = v1.y();
+        _rectEdge1[2][slot] = v1.z();
+        _rectEdge2[0][slot] = v2.x();
+        _rectEdge2[1][slot] = v2.y();
+        _rectEdge2[2][slot] = v2.z();
+        _rectLength[0][slot] = length(v1);
+        _rectLength[1][slot] = length(v2);
+        _rectNormal[0][slot] = rt->normal().x();
+        _rectNormal[1][slot] = rt->normal().y();
+        _rectNormal[2][slot] = rt->normal().z();
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+bool ShapeTable::intersectSphere(size_t slot, const Real orig[3], const Real dir[3], Real &t) const
+{
+    // same evaluation order as Sphere::intersect
+    Real ocx = _sphereCenter[0][slot] - orig[0];
+    Real ocy = _sphereCenter[1][slot] - orig[1];
+    Real ocz = _sphereCenter[2][slot] - orig[2];
+
+    Real cx = ocy * dir[2] - ocz * dir[1];
+    Real cy = ocz * dir[0] - ocx * dir[2];
+    Real cz = ocx * dir[1] - ocy * dir[0];
+    Real dist = sqrt( cx * cx + cy * cy + cz * cz );
+
+    Real radius = _sphereRadius[slot];
+    if( dist <= radius )
+    {
+        Real part1 = ocx * dir[0] + ocy * dir[1] + ocz * dir[2];
+        if( part1 < 0 )
+            return false;
+
+        Real part2 = sqrt(radius * radius - dist * dist);
+        Real farT = part1 + part2;
+        Real nearT = part1 - part2;
+
+        const Real ZERO_THRESHOLD = 1e-3;
+        if( nearT <= ZERO_THRESHOLD )
+            t = farT;
+        else
+            t = nearT;
+
+        return true;
+    }
+    else
+        return false;
+}
+
+bool ShapeTable::intersectRectangle(size_t slot, const Real orig[3], const Real dir[3], Real &t) const
+{
+    // same evaluation order as Rectangle::intersect
+    t = - ( _rectPlane[0][slot] * orig[0] + _rectPlane[1][slot] * orig[1] + _rectPlane[2][slot] * orig[2] + _rectPlane[3][slot])
+            / ( _rectPlane[0][slot] * dir[0] + _rectPlane[1][slot] * dir[1] + _rectPlane[2][slot] * dir[2] );
+
+    const Real ZERO_THRESHOLD = 1e-2;
+    if( t < ZERO_THRESHOLD )
+        return false;
+
+    Real vx = (orig[0] + dir[0] * t) - _rectCorner[0][slot];
+    Real vy = (orig[1] + dir[1] * t) - _rectCorner[1][slot];
+    Real vz = (orig[2] + dir[2] * t) - _rectCorner[2][slot];
+
+    Real l1 = _rectLength[0][slot], l2 = _rectLength[1][slot];
+    Real alpha1 = (vx * _rectEdge1[0][slot] + vy * _rectEdge1[1][slot] + vz * _rectEdge1[2][slot]) / l1;
+    Real alpha2 = (vx * _rectEdge2[0][slot] + vy * _rectEdge2[1][slot] + vz * _rectEdge2[2][slot]) / l2;
+
+    return ( alpha1 >= 0 && alpha1 <= l1
+          && alpha2 >= 0 && alpha2 <= l2 );
+}
+
+bool ShapeTable::intersect(size_t idx, const Ray &r, const Real dir[3], Hit &h) const
+{
+    Real orig[3] = { r.origin().x(), r.origin().y(), r.origin().z() };
+    Real t;
+
+    switch( _types[idx] )
+    {
+    case Shape::SPHERE:
+    {
+        size_t slot = _slots[idx];
+        if( !intersectSphere(slot, orig, dir, t) )
+            return false;
+
+        if( t < h.t() )
+        {
+            RealVector3D dirVec(dir[0], dir[1], dir[2]);
+            RealPoint3D center(_sphereCenter[0][slot], _sphereCenter[1][slot], _sphereCenter[2][slot]);
+            RealVector3D diff = dirVec * t;
+            RealVector3D hitPoint = r.origin() + diff;
+
+            Real rate = refractionRate(idx);
+            if( rate > 0 )
+                h.set( t, color(idx), hitPoint - center, true, true, rate );
+            else
+                h.set( t, color(idx), hitPoint - center );
+        }
+        return true;
+    }
+    case Shape::RECTANGLE:
+    {
+        size_t slot = _slots[idx];
+        if( !intersectRectangle(slot, orig, dir, t) )
+            return false;
+
+        if( t < h.t() )
+        {
+            RealVector3D normal(_rectNormal[0][slot], _rectNormal[1][slot], _rectNormal[2][slot]);
+
+            Real rate = refractionRate(idx);
+            if( rate > 0 )
+                h.set( t, color(idx), normal, true, true, rate );
+            else
+                h.set( t, color(idx), normal );
+        }
+        return true;
+    }
+    default:
+        return _shapes[idx]->intersect(r, h);
+    }
+}
+
+bool ShapeTable::blockTest(size_t idx, const Ray &r, const Real dir[3], Real tmax) const
+{
+    Real orig[3] = { r.origin().x(), r.origin().y(), r.origin().z() };
+    Real t;
+
+    switch( _types[idx] )
+    {
+    case Shape::SPHERE:
+        return intersectSphere(_slots[idx], orig, dir, t) && t < tmax;
+    case Shape::RECTANGLE:
+        return intersectRectangle(_slots[idx], orig, dir, t) && t < tmax;
+    default:
+        return _shapes[idx]->blockTest(r, tmax);
+    }
+}
+
+void ShapeTable::intersectPacket(size_t idx, RayPacket &p) const
+{
+    switch( _types[idx] )
+    {
+    case Shape::SPHERE:
+        intersectSpherePacket(_slots[idx], p, idx);
+        break;
+    case Shape::RECTANGLE:
+        intersectRectanglePacket(_slots[idx], p, idx);
+        break;
+    default:
+        _shapes[idx]->intersectPacket(p, idx);
+        break;
+    }
+}
+
+void ShapeTable::intersectSpherePacket(size_t slot, RayPacket &p, int shapeIdx) const
+{
+    using namespace SIMDUtils;
+
+    const RealPack cx = broadcast<RealPack>(_sphereCenter[0][slot]);
+    const RealPack cy = broadcast<RealPack>(_sphereCenter[1][slot]);
+    const RealPack cz = broadcast<RealPack>(_sphereCenter[2][slot]);
+    const RealPack radius = broadcast<RealPack>(_sphereRadius[slot]);
+    const RealPack radiusSquare = broadcast<RealPack>(_sphereRadius[slot] * _sphereRadius[slot]);
+    const RealPack zero = broadcast<RealPack>(0);
+    const RealPack threshold = broadcast<RealPack>(1e-3);
+
+    for(size_t i=0;i<p.size;i+=RealPack::width)
+    {
+        RealPack dx = load(p.dx + i), dy = load(p.dy + i), dz = load(p.dz + i);
+        RealPack ocx = cx - load(p.ox + i);
+        RealPack ocy = cy - load(p.oy + i);
+        RealPack ocz = cz - load(p.oz + i);
+
+        // same evaluation order as the scalar test
+        RealPack crx = ocy * dz - ocz * dy;
+        RealPack cry = ocz * dx - ocx * dz;
+        RealPack crz = ocx * dy - ocy * dx;
+        RealPack dist = sqrt( crx * crx + cry * cry + crz * crz );
+        RealPack part1 = ocx * dx + ocy * dy + ocz * dz;
+
+        RealPack valid = lessEqual(dist, radius) & greaterEqual(part1, zero);
+
+        RealPack part2 = sqrt( radiusSquare - dist * dist );
+        RealPack farT = part1 + part2;
+        RealPack nearT = part1 - part2;
+        RealPack t = select( lessEqual(nearT, threshold), nearT, farT );
+
+        RealPack curT = load(p.t + i);
+        RealPack closer = valid & lessThan(t, curT);
+
+        int mask = moveMask(closer) & p.activeLanes(i, RealPack::width);
+        if( mask )
+        {
+            store(p.t + i, select(closer, curT, t));
+            for(int k=0;k<RealPack::width;k++)
+                if( mask & (1 << k) )
+                    p.shape[i + k] = shapeIdx;
+        }
+    }
+}
+
+void ShapeTable::intersectRectanglePacket(size_t slot, RayPacket &p, int shapeIdx) const
+{
+    using namespace SIMDUtils;
+
+    const RealPack pa = broadcast<RealPack>(_rectPlane[0][slot]), pb = broadcast<RealPack>(_rectPlane[1][slot]);
+    const RealPack pc = broadcast<RealPack>(_rectPlane[2][slot]), pd = broadcast<RealPack>(_rectPlane[3][slot]);
+    const RealPack v0x = broadcast<RealPack>(_rectCorner[0][slot]);
+    const RealPack v0y = broadcast<RealPack>(_rectCorner[1][slot]);
+    const RealPack v0z = broadcast<RealPack>(_rectCorner[2][slot]);
+    const RealPack v1x = broadcast<RealPack>(_rectEdge1[0][slot]), v1y = broadcast<RealPack>(_rectEdge1[1][slot]), v1z = broadcast<RealPack>(_rectEdge1[2][slot]);
+    const RealPack v2x = broadcast<RealPack>(_rectEdge2[0][slot]), v2y = broadcast<RealPack>(_rectEdge2[1][slot]), v2z = broadcast<RealPack>(_rectEdge2[2][slot]);
+    const RealPack len1 = broadcast<RealPack>(_rectLength[0][slot]), len2 = broadcast<RealPack>(_rectLength[1][slot]);
+    const RealPack zero = broadcast<RealPack>(0);
+    const RealPack threshold = broadcast<RealPack>(1e-2);
+
+    for(size_t i=0;i<p.size;i+=RealPack::width)
+    {
+        RealPack ox = load(p.ox + i), oy = load(p.oy + i), oz = load(p.oz + i);
+        RealPack dx = load(p.dx + i), dy = load(p.dy + i), dz = load(p.dz + i);
+
+        RealPack t = (zero - ( pa * ox + pb * oy + pc * oz + pd ))
+                / ( pa * dx + pb * dy + pc * dz );
+
+        // test if the hit point is within the rectangle
+        RealPack vx = (ox + dx * t) - v0x;
+        RealPack vy = (oy + dy * t) - v0y;
+        RealPack vz = (oz + dz * t) - v0z;
+
+        RealPack alpha1 = (vx * v1x + vy * v1y + vz * v1z) / len1;
+        RealPack alpha2 = (vx * v2x + vy * v2y + vz * v2z) / len2;
+
+        RealPack valid = greaterEqual(t, threshold)
+                & greaterEqual(alpha1, zero) & lessEqual(alpha1, len1)
+                & greaterEqual(alpha2, zero) & lessEqual(alpha2, len2);
+
+        RealPack curT = load(p.t + i);
+        RealPack closer = valid & lessThan(t, curT);
+
+        int mask = moveMask(closer) & p.activeLanes(i, RealPack::width);
+        if( mask )
+        {
+            store(p.t + i, select(closer, curT, t));
+            for(int k=0;k<RealPack::width;k++)
+                if( mask & (1 << k) )
+                    p.shape[i + k] = shapeIdx;
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef SHAPETABLE_H
+#define SHAPETABLE_H
+
+#include <vector>
+using namespace std;
+
+#include "geometryutils.hpp"
+using namespace GeometryUtils;
+
+#include "color.hpp"
+#include "raytracer.h"
+
+class Shape;
+struct RayPacket;
+
+// compact structure of arrays copy of the scene shapes
+// every shape type keeps its parameters in separate contiguous arrays, the
+// shapes refer to them through a type tag and a slot, and to a shared
+// material table, so the intersection loops dispatch on the tag instead of
+// going through the vtable of a separately allocated object
+class ShapeTable
+{
+public:
+    ShapeTable();
+
+    void build(Shape** shapes, size_t shapeNumber);
+    void clear();
+
+    // copies the geometry of shape idx again once it moved, its type and
+    // material stay as built
+    void updateGeometry(size_t idx);
+
+    size_t shapeNumber() const { return _types.size(); }
+    size_t sphereNumber() const { return _sphereRadius.size(); }
+    size_t rectangleNumber() const { return _rectLength[0].size(); }
+    size_t materialNumber() const { return _materialColors.size(); }
+
+    const RealColor4& color(size_t idx) const { return _materialColors[_materials[idx]]; }
+    Real refractionRate(size_t idx) const { return _materialRefractionRates[_materials[idx]]; }
+
+    // the direction must be normalized, results match Shape::intersect and
+    // Shape::blockTest of the shape the table was built from
+    bool intersect(size_t idx, const Ray& r, const Real dir[3], Hit& h) const;
+    bool blockTest(size_t idx, const Ray& r, const Real dir[3], Real t) const;
+    void intersectPacket(size_t idx, RayPacket& p) const;
+
+protected:
+    bool intersectSphere(size_t slot, const Real orig[3], const Real dir[3], Real& t) const;
+    bool intersectRectangle(size_t slot, const Real orig[3], const Real dir[3], Real& t) const;
+
+    void intersectSpherePacket(size_t slot, RayPacket& p, int shapeIdx) const;
+    void intersectRectanglePacket(size_t slot, RayPacket& p, int shapeIdx) const;
+
+private:
+    // per shape data
+    vector<unsigned char> _types;
+    vector<unsigned int> _slots;
+    vector<unsigned int> _materials;
+
+    // spheres
+    vector<Real> _sphereCenter[3];
+    vector<Real> _sphereRadius;
+
+    // rectangles, plane parameters, first corner, the two edges leaving it
+    // with their lengths, and the normal
+    vector<Real> _rectPlane[4];
+    vector<Real> _rectCorner[3];
+    vector<Real> _rectEdge1[3];
+    vector<Real> _rectEdge2[3];
+    vector<Real> _rectLength[2];
+    vector<Real> _rectNormal[3];
+
+    // materials shared by the shapes
+    vector<RealColor4> _materialColors;
+    vector<Real> _materialRefractionRates;
+
+    // shapes without a table layout are tested through the original objects
+    Shape** _shapes;
+};
+
+#endif // SHAPETABLE_H
@@ -0,0 +1,210 @@
+#ifndef SIMDUTIL_HPP
+#define SIMDUTIL_HPP
+
+// thin wrapper over the vector units, a pack holds several doubles or floats
+// and is mapped to AVX (4 double or 8 float lanes) or SSE2 (2 or 4 lanes) when
+// the compiler enables them, otherwise to a plain scalar
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <cmath>
+
+namespace SIMDUtils
+{
+
+#if defined(__AVX__)
+
+struct DblPack
+{
+    __m256d v;
+    static const int width = 4;
+};
+
+struct FltPack
+{
+    __m256 v;
+    static const int width = 8;
+};
+
+inline DblPack makePack(__m256d v) { DblPack p; p.v = v; return p; }
+inline DblPack load(const double* ptr) { return makePack(_mm256_loadu_pd(ptr)); }
+inline void store(double* ptr, const DblPack& p) { _mm256_storeu_pd(ptr, p.v); }
+inline DblPack broadcastDbl(double val) { return makePack(_mm256_set1_pd(val)); }
+
+inline DblPack operator+(const DblPack& a, const DblPack& b) { return makePack(_mm256_add_pd(a.v, b.v)); }
+inline DblPack operator-(const DblPack& a, const DblPack& b) { return makePack(_mm256_sub_pd(a.v, b.v)); }
+inline DblPack operator*(const DblPack& a, const DblPack& b) { return makePack(_mm256_mul_pd(a.v, b.v)); }
+inline DblPack operator/(const DblPack& a, const DblPack& b) { return makePack(_mm256_div_pd(a.v, b.v)); }
+inline DblPack sqrt(const DblPack& a) { return makePack(_mm256_sqrt_pd(a.v)); }
+inline DblPack min(const DblPack& a, const DblPack& b) { return makePack(_mm256_min_pd(a.v, b.v)); }
+inline DblPack max(const DblPack& a, const DblPack& b) { return makePack(_mm256_max_pd(a.v, b.v)); }
+
+// comparisons return all-ones lanes where true, false for NaN operands
+inline DblPack lessThan(const DblPack& a, const DblPack& b) { return makePack(_mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ)); }
+inline DblPack lessEqual(const DblPack& a, const DblPack& b) { return makePack(_mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ)); }
+inline DblPack greaterEqual(const DblPack& a, const DblPack& b) { return makePack(_mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ)); }
+inline DblPack operator&(const DblPack& a, const DblPack& b) { return makePack(_mm256_and_pd(a.v, b.v)); }
+
+// picks b where the mask is set, a elsewhere
+inline DblPack select(const DblPack& mask, const DblPack& a, const DblPack& b) { return makePack(_mm256_blendv_pd(a.v, b.v, mask.v)); }
+inline int moveMask(const DblPack& mask) { return _mm256_movemask_pd(mask.v); }
+
+inline FltPack makePack(__m256 v) { FltPack p; p.v = v; return p; }
+inline FltPack load(const float* ptr) { return makePack(_mm256_loadu_ps(ptr)); }
+inline void store(float* ptr, const FltPack& p) { _mm256_storeu_ps(ptr, p.v); }
+inline FltPack broadcastFlt(float val) { return makePack(_mm256_set1_ps(val)); }
+
+inline FltPack operator+(const FltPack& a, const FltPack& b) { return makePack(_mm256_add_ps(a.v, b.v)); }
+inline FltPack operator-(const FltPack& a, const FltPack& b) { return makePack(_mm256_sub_ps(a.v, b.v)); }
+inline FltPack operator*(const FltPack& a, const FltPack& b) { return makePack(_mm256_mul_ps(a.v, b.v)); }
+inline FltPack operator/(const FltPack& a, const FltPack& b) { return makePack(_mm256_div_ps(a.v, b.v)); }
+inline FltPack sqrt(const FltPack& a) { return makePack(_mm256_sqrt_ps(a.v)); }
+inline FltPack min(const FltPack& a, const FltPack& b) { return makePack(_mm256_min_ps(a.v, b.v)); }
+inline FltPack max(const FltPack& a, const FltPack& b) { return makePack(_mm256_max_ps(a.v, b.v)); }
+
+inline FltPack lessThan(const FltPack& a, const FltPack& b) { return makePack(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+inline FltPack lessEqual(const FltPack& a, const FltPack& b) { return makePack(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+inline FltPack greaterEqual(const FltPack& a, const FltPack& b) { return makePack(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)); }
+inline FltPack operator&(const FltPack& a, const FltPack& b) { return makePack(_mm256_and_ps(a.v, b.v)); }
+
+inline FltPack select(const FltPack& mask, const FltPack& a, const FltPack& b) { return makePack(_mm256_blendv_ps(a.v, b.v, mask.v)); }
+inline int moveMask(const FltPack& mask) { return _mm256_movemask_ps(mask.v); }
+
+#elif defined(__SSE2__)
+
+struct DblPack
+{
+    __m128d v;
+    static const int width = 2;
+};
+
+struct FltPack
+{
+    __m128 v;
+    static const int width = 4;
+};
+
+inline DblPack makePack(__m128d v) { DblPack p; p.v = v; return p; }
+inline DblPack load(const double* ptr) { return makePack(_mm_loadu_pd(ptr)); }
+inline void store(double* ptr, const DblPack& p) { _mm_storeu_pd(ptr, p.v); }
+inline DblPack broadcastDbl(double val) { return makePack(_mm_set1_pd(val)); }
+
+inline DblPack operator+(const DblPack& a, const DblPack& b) { return makePack(_mm_add_pd(a.v, b.v)); }
+inline DblPack operator-(const DblPack& a, const DblPack& b) { return makePack(_mm_sub_pd(a.v, b.v)); }
+inline DblPack operator*(const DblPack& a, const DblPack& b) { return makePack(_mm_mul_pd(a.v, b.v)); }
+inline DblPack operator/(const DblPack& a, const DblPack& b) { return makePack(_mm_div_pd(a.v, b.v)); }
+inline DblPack sqrt(const DblPack& a) { return makePack(_mm_sqrt_pd(a.v)); }
+inline DblPack min(const DblPack& a, const DblPack& b) { return makePack(_mm_min_pd(a.v, b.v)); }
+inline DblPack max(const DblPack& a, const DblPack& b) { return makePack(_mm_max_pd(a.v, b.v)); }
+
+inline DblPack lessThan(const DblPack& a, const DblPack& b) { return makePack(_mm_cmplt_pd(a.v, b.v)); }
+inline DblPack lessEqual(const DblPack& a, const DblPack& b) { return makePack(_mm_cmple_pd(a.v, b.v)); }
+inline DblPack greaterEqual(const DblPack& a, const DblPack& b) { return makePack(_mm_cmpge_pd(a.v, b.v)); }
+inline DblPack operator&(const DblPack& a, const DblPack& b) { return makePack(_mm_and_pd(a.v, b.v)); }
+
+inline DblPack select(const DblPack& mask, const DblPack& a, const DblPack& b)
+{
+    return makePack(_mm_or_pd(_mm_and_pd(mask.v, b.v), _mm_andnot_pd(mask.v, a.v)));
+}
+inline int moveMask(const DblPack& mask) { return _mm_movemask_pd(mask.v); }
+
+inline FltPack makePack(__m128 v) { FltPack p; p.v = v; return p; }
+inline FltPack load(const float* ptr) { return makePack(_mm_loadu_ps(ptr)); }
+inline void store(float* ptr, const FltPack& p) { _mm_storeu_ps(ptr, p.v); }
+inline FltPack broadcastFlt(float val) { return makePack(_mm_set1_ps(val)); }
+
+inline FltPack operator+(const FltPack& a, const FltPack& b) { return makePack(_mm_add_ps(a.v, b.v)); }
+inline FltPack operator-(const FltPack& a, const FltPack& b) { return makePack(_mm_sub_ps(a.v, b.v)); }
+inline FltPack operator*(const FltPack& a, const FltPack& b) { return makePack(_mm_mul_ps(a.v, b.v)); }
+inline FltPack operator/(const FltPack& a, const FltPack& b) { return makePack(_mm_div_ps(a.v, b.v)); }
+inline FltPack sqrt(const FltPack& a) { return makePack(_mm_sqrt_ps(a.v)); }
+inline FltPack min(const FltPack& a, const FltPack& b) { return makePack(_mm_min_ps(a.v, b.v)); }
+inline FltPack max(const FltPack& a, const FltPack& b) { return makePack(_mm_max_ps(a.v, b.v)); }
+
+inline FltPack lessThan(const FltPack& a, const FltPack& b) { return makePack(_mm_cmplt_ps(a.v, b.v)); }
+inline FltPack lessEqual(const FltPack& a, const FltPack& b) { return makePack(_mm_cmple_ps(a.v, b.v)); }
+inline FltPack greaterEqual(const FltPack& a, const FltPack& b) { return makePack(_mm_cmpge_ps(a.v, b.v)); }
+inline FltPack operator&(const FltPack& a, const FltPack& b) { return makePack(_mm_and_ps(a.v, b.v)); }
+
+inline FltPack select(const FltPack& mask, const FltPack& a, const FltPack& b)
+{
+    return makePack(_mm_or_ps(_mm_and_ps(mask.v, b.v), _mm_andnot_ps(mask.v, a.v)));
+}
+inline int moveMask(const FltPack& mask) { return _mm_movemask_ps(mask.v); }
+
+#else
+
+struct DblPack
+{
+    double v;
+    bool m;
+    static const int width = 1;
+};
+
+struct FltPack
+{
+    float v;
+    bool m;
+    static const int width = 1;
+};
+
+inline DblPack makePack(double v, bool m = false) { DblPack p; p.v = v; p.m = m; return p; }
+inline DblPack load(const double* ptr) { return makePack(*ptr); }
+inline void store(double* ptr, const DblPack& p) { *ptr = p.v; }
+inline DblPack broadcastDbl(double val) { return makePack(val); }
+
+inline DblPack operator+(const DblPack& a, const DblPack& b) { return makePack(a.v + b.v); }
+inline DblPack operator-(const DblPack& a, const DblPack& b) { return makePack(a.v - b.v); }
+inline DblPack operator*(const DblPack& a, const DblPack& b) { return makePack(a.v * b.v); }
+inline DblPack operator/(const DblPack& a, const DblPack& b) { return makePack(a.v / b.v); }
+inline DblPack sqrt(const DblPack& a) { return makePack(std::sqrt(a.v)); }
+inline DblPack min(const DblPack& a, const DblPack& b) { return makePack(a.v < b.v ? a.v : b.v); }
+inline DblPack max(const DblPack& a, const DblPack& b) { return makePack(a.v > b.v ? a.v : b.v); }
+
+inline DblPack lessThan(const DblPack& a, const DblPack& b) { return makePack(0, a.v < b.v); }
+inline DblPack lessEqual(const DblPack& a, const DblPack& b) { return makePack(0, a.v <= b.v); }
+inline DblPack greaterEqual(const DblPack& a, const DblPack& b) { return makePack(0, a.v >= b.v); }
+inline DblPack operator&(const DblPack& a, const DblPack& b) { return makePack(0, a.m && b.m); }
+
+inline DblPack select(const DblPack& mask, const DblPack& a, const DblPack& b) { return mask.m ? b : a; }
+inline int moveMask(const DblPack& mask) { return mask.m ? 1 : 0; }
+
+inline FltPack makeFltPack(float v, bool m = false) { FltPack p; p.v = v; p.m = m; return p; }
+inline FltPack load(const float* ptr) { return makeFltPack(*ptr); }
+inline void store(float* ptr, const FltPack& p) { *ptr = p.v; }
+inline FltPack broadcastFlt(float val) { return makeFltPack(val); }
+
+inline FltPack operator+(const FltPack& a, const FltPack& b) { return makeFltPack(a.v + b.v); }
+inline FltPack operator-(const FltPack& a, const FltPack& b) { return makeFltPack(a.v - b.v); }
+inline FltPack operator*(const FltPack& a, const FltPack& b) { return makeFltPack(a.v * b.v); }
+inline FltPack operator/(const FltPack& a, const FltPack& b) { return makeFltPack(a.v / b.v); }
+inline FltPack sqrt(const FltPack& a) { return makeFltPack(std::sqrt(a.v)); }
+inline FltPack min(const FltPack& a, const FltPack& b) { return makeFltPack(a.v < b.v ? a.v : b.v); }
+inline FltPack max(const FltPack& a, const FltPack& b) { return makeFltPack(a.v > b.v ? a.v : b.v); }
+
+inline FltPack lessThan(const FltPack& a, const FltPack& b) { return makeFltPack(0, a.v < b.v); }
+inline FltPack lessEqual(const FltPack& a, const FltPack& b) { return makeFltPack(0, a.v <= b.v); }
+inline FltPack greaterEqual(const FltPack& a, const FltPack& b) { return makeFltPack(0, a.v >= b.v); }
+inline FltPack operator&(const FltPack& a, const FltPack& b) { return makeFltPack(0, a.m && b.m); }
+
+inline FltPack select(const FltPack& mask, const FltPack& a, const FltPack& b) { return mask.m ? b : a; }
+inline int moveMask(const FltPack& mask) { return mask.m ? 1 : 0; }
+
+#endif
+
+// pack of a given scalar type, broadcast<P> fills all lanes of a P
+template <typename T> struct PackOf;
+template <> struct PackOf<double> { typedef DblPack Type; };
+template <> struct PackOf<float> { typedef FltPack Type; };
+
+template <typename P> inline P broadcast(double val);
+template <> inline DblPack broadcast<DblPack>(double val) { return broadcastDbl(val); }
+template <> inline FltPack broadcast<FltPack>(double val) { return broadcastFlt((float)val); }
+
+}
+
+#endif // SIMDUTIL_HPP
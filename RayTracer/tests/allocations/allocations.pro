@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# fails when the second frame of a tracer allocates on the heap
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = allocations-test
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../../raytracercore.pri)
+
+DEFINES += SCENE_DIR=\\\"$$PWD/../../scenes\\\"
+
+SOURCES += main.cpp
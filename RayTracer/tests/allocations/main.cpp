@@ -0,0 +1,157 @@
+#include <QAtomicInt>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <new>
+using namespace std;
+
+#include "scene.h"
+#include "raytracer.h"
+
+/*
+ * allocations-test [scene.scn]
+ *
+ * renders the scene twice with the same tracer and fails when the second
+ * frame makes a heap allocation: the pooled tile threads, their scratch
+ * buffers and caches, the statistics and the reused frame buffer all carry
+ * over from the first frame; every sampling mode is checked with one and
+ * with several tile threads
+ */
+
+namespace
+{
+QAtomicInt allocationCount;
+volatile bool allocationCounting = false;
+}
+
+// the replacement deallocation functions are noexcept like the ones they
+// replace, the sized ones exist since C++14
+#if __cplusplus >= 201103L
+#define DEALLOCATION_NOEXCEPT noexcept
+#else
+#define DEALLOCATION_NOEXCEPT throw()
+#endif
+
+// counts the allocations of the whole program while allocationCounting is set
+void* operator new(size_t size)
+{
+    if( allocationCounting )
+        allocationCount.fetchAndAddOrdered(1);
+
+    void* p = malloc(size ? size : 1);
+    if( !p )
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) DEALLOCATION_NOEXCEPT
+{
+    free(p);
+}
+
+void operator delete[](void* p) DEALLOCATION_NOEXCEPT
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) DEALLOCATION_NOEXCEPT
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) DEALLOCATION_NOEXCEPT
+{
+    free(p);
+}
+
+namespace
+{
+enum Mode
+{
+    FixedSamples,
+    AdaptiveSamples,
+    SampledLights,
+    ModeNumber
+};
+
+const char* modeName(Mode m)
+{
+    switch( m )
+    {
+    case AdaptiveSamples:
+        return "adaptive sampling";
+    case SampledLights:
+        return "sampled lights";
+    default:
+        return "fixed sampling";
+    }
+}
+
+int secondFrameAllocations(Scene& scene, int threadNumber, Mode mode)
+{
+    RayTracer tracer;
+    tracer.bindScene(&scene);
+    tracer.setSize(160, 120);
+    tracer.setThreadNumber(threadNumber);
+    tracer.setOutputFile("");
+    tracer.setBufferReuse(true);
+
+    if( mode == AdaptiveSamples )
+        tracer.setSamplingMode(RayTracer::AdaptiveSampling);
+    if( mode == SampledLights )
+    {
+        tracer.setLightSelection(RayTracer::SampledLights);
+        tracer.setLightSampleNumber(2);
+    }
+
+    tracer.execute();
+
+    allocationCount = 0;
+    allocationCounting = true;
+    tracer.execute();
+    allocationCounting = false;
+
+    return allocationCount;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    string sceneFile = argc > 1 ? argv[1] : SCENE_DIR "/10balls.scn";
+
+    const int threadNumbers[] = { 1, 4 };
+    bool failed = false;
+
+    try{
+        Scene scene(sceneFile);
+
+        for(int i=0;i<2;i++)
+        {
+            for(int m=0;m<ModeNumber;m++)
+            {
+                int allocations = secondFrameAllocations(scene, threadNumbers[i], (Mode)m);
+                cout << threadNumbers[i] << " threads, " << modeName((Mode)m) << ": "
+                     << allocations << " allocations" << endl;
+
+                if( allocations > 0 )
+                    failed = true;
+            }
+        }
+    }
+    catch(const char* errstr)
+    {
+        cerr << sceneFile << ": " << errstr << endl;
+        return 1;
+    }
+
+    if( failed )
+        cerr << "the second frame allocated." << endl;
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,9 @@
+#-------------------------------------------------
+#
+# the reference scene rendered in double precision
+#
+#-------------------------------------------------
+
+TARGET = precision-test-double
+
+include(../precision.pri)
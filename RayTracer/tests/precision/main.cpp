@@ -0,0 +1,118 @@
+#include <QImage>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "scene.h"
+#include "raytracer.h"
+
+/*
+ * precision-test-double [--update] [scene.scn reference.ppm]
+ * precision-test-single [scene.scn reference.ppm]
+ *
+ * renders the reference scene at the precision the core is built with,
+ * Real is double by default and float with CONFIG += single_precision, and
+ * compares every channel of every pixel to the reference image rendered in
+ * double precision; the test fails when more than a few values, where a ray
+ * grazing a silhouette may hit in one precision and miss in the other,
+ * differ by more than the tolerance
+ *
+ * --update renders the reference image again, in double precision only
+ */
+
+namespace
+{
+const int WIDTH = 160;
+const int HEIGHT = 120;
+
+// levels of an 8 bit channel, and the share of the channel values that may
+// differ by more
+const int TOLERANCE = 2;
+const double OUTLIER_RATIO = 0.001;
+
+const char* precisionName()
+{
+    return sizeof(Real) == sizeof(float) ? "single" : "double";
+}
+}
+
+int main(int argc, char *argv[])
+{
+    bool update = argc > 1 && strcmp(argv[1], "--update") == 0;
+    int arg = update ? 2 : 1;
+
+    string sceneFile = argc > arg + 1 ? argv[arg] : SCENE_DIR "/10balls.scn";
+    string referenceFile = argc > arg + 1 ? argv[arg + 1] : REFERENCE_DIR "/10balls.ppm";
+
+    if( update && sizeof(Real) != sizeof(double) )
+    {
+        cerr << "the reference is rendered in double precision." << endl;
+        return 2;
+    }
+
+    QImage image;
+    try{
+        Scene scene(sceneFile);
+
+        RayTracer tracer;
+        tracer.bindScene(&scene);
+        tracer.setSize(WIDTH, HEIGHT);
+        tracer.setOutputFile("");
+        tracer.execute();
+
+        if( update )
+        {
+            if( !tracer.result().saveImage(referenceFile) )
+                throw "failed to write the reference image.";
+            cout << sceneFile << " -> " << referenceFile << endl;
+            return 0;
+        }
+
+        image = tracer.result().toQImage();
+    }
+    catch(const char* errstr)
+    {
+        cerr << sceneFile << ": " << errstr << endl;
+        return 1;
+    }
+
+    QImage reference(QString::fromStdString(referenceFile));
+    if( reference.width() != image.width() || reference.height() != image.height() )
+    {
+        cerr << referenceFile << ": missing, or not of " << WIDTH << "x" << HEIGHT << " pixels." << endl;
+        return 1;
+    }
+
+    int maxDifference = 0;
+    int outliers = 0;
+    double differenceSum = 0;
+    for(int y=0;y<image.height();y++)
+    {
+        for(int x=0;x<image.width();x++)
+        {
+            QRgb a = image.pixel(x, y), b = reference.pixel(x, y);
+            int d[3] = { abs(qRed(a) - qRed(b)), abs(qGreen(a) - qGreen(b)), abs(qBlue(a) - qBlue(b)) };
+            for(int k=0;k<3;k++)
+            {
+                if( d[k] > maxDifference )
+                    maxDifference = d[k];
+                if( d[k] > TOLERANCE )
+                    outliers++;
+                differenceSum += d[k];
+            }
+        }
+    }
+
+    int valueNumber = image.width() * image.height() * 3;
+    int maxOutliers = valueNumber * OUTLIER_RATIO;
+
+    cout << precisionName() << " precision against " << referenceFile << ": max difference "
+         << maxDifference << ", mean " << differenceSum / valueNumber << ", "
+         << outliers << " values beyond " << TOLERANCE << " levels, at most "
+         << maxOutliers << " allowed" << endl;
+
+    return outliers > maxOutliers ? 1 : 0;
+}
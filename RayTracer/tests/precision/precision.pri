@@ -0,0 +1,16 @@
+# renders the reference scene at the precision of the build and compares it
+# to the image rendered in double precision, shared by the builds of both
+# precisions; CONFIG += single_precision has to be set before the include
+
+QT       += core gui
+
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../../raytracercore.pri)
+
+DEFINES += SCENE_DIR=\\\"$$PWD/../../scenes\\\" \
+    REFERENCE_DIR=\\\"$$PWD\\\"
+
+SOURCES += $$PWD/main.cpp
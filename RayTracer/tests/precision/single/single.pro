@@ -0,0 +1,10 @@
+#-------------------------------------------------
+#
+# the reference scene rendered in single precision
+#
+#-------------------------------------------------
+
+TARGET = precision-test-single
+CONFIG += single_precision
+
+include(../precision.pri)
@@ -0,0 +1,12 @@
+#-------------------------------------------------
+#
+# checks of the ray tracing core, every test is a console program that
+# exits with a non-zero status when it fails
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+SUBDIRS = allocations \
+    threadcount \
+    precision/double \
+    precision/single
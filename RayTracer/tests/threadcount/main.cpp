@@ -0,0 +1,79 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "scene.h"
+#include "raytracer.h"
+
+/*
+ * threadcount-test [scene.scn] [frames]
+ *
+ * renders the scene over and over with the same tracer, cycling the
+ * number of tile threads from 1 to 4 so that the pool is restarted before
+ * every frame; every frame has to match the one rendered first by a
+ * single thread, a restarted thread that rendered a frame it was not
+ * counted in would leave tiles missing or half written; the race needs
+ * the new threads to run before the frame starts, on several cores it
+ * shows up once in a thousand frames or so, hence the default of 4000
+ */
+
+namespace
+{
+const int WIDTH = 64;
+const int HEIGHT = 48;
+const int TILE_SIZE = 8;
+const int MAX_THREADS = 4;
+
+void setupTracer(RayTracer& tracer, Scene& scene)
+{
+    tracer.bindScene(&scene);
+    tracer.setSize(WIDTH, HEIGHT);
+    tracer.setTileSize(TILE_SIZE);
+    tracer.setSampleNumber(1);
+    tracer.setOutputFile("");
+}
+
+bool sameFrame(const FrameBuffer& a, const FrameBuffer& b)
+{
+    return a.width() == b.width() && a.height() == b.height()
+            && memcmp(a.rawData(), b.rawData(), a.width() * a.height() * 4 * sizeof(float)) == 0;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    string sceneFile = argc > 1 ? argv[1] : SCENE_DIR "/10balls.scn";
+    int frameNumber = argc > 2 ? atoi(argv[2]) : 4000;
+
+    int corruptFrames = 0;
+    try{
+        Scene scene(sceneFile);
+
+        RayTracer reference;
+        setupTracer(reference, scene);
+        reference.setThreadNumber(1);
+        reference.execute();
+
+        RayTracer tracer;
+        setupTracer(tracer, scene);
+        for(int i=0;i<frameNumber;i++)
+        {
+            tracer.setThreadNumber(i % MAX_THREADS + 1);
+            tracer.execute();
+
+            if( !sameFrame(tracer.result(), reference.result()) )
+                corruptFrames++;
+        }
+    }
+    catch(const char* errstr)
+    {
+        cerr << sceneFile << ": " << errstr << endl;
+        return 1;
+    }
+
+    cout << corruptFrames << " of " << frameNumber << " frames differ" << endl;
+
+    return corruptFrames > 0 ? 1 : 0;
+}
@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# fails when a frame rendered after the thread number changed differs from
+# the same frame rendered by one thread
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = threadcount-test
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../../raytracercore.pri)
+
+DEFINES += SCENE_DIR=\\\"$$PWD/../../scenes\\\"
+
+SOURCES += main.cpp
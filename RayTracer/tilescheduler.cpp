@@ -0,0 +1,205 @@
+#include "tilescheduler.h"
+
+#include <algorithm>
+
+namespace
+{
+// interleaves the bits of x and y, x in the even ones
+size_t mortonCode(size_t x, size_t y)
+{
+    size_t code = 0;
+    for(size_t b=0;b<sizeof(size_t)*4;b++)
+    {
+        code |= ((x >> b) & 1) << (2 * b);
+        code |= ((y >> b) & 1) << (2 * b + 1);
+    }
+    return code;
+}
+
+// position of (x, y) along the hilbert curve filling an n x n square, n a
+// power of two
+size_t hilbertIndex(size_t n, size_t x, size_t y)
+{
+    size_t d = 0;
+    for(size_t s=n/2;s>0;s/=2)
+    {
+        size_t rx = (x & s) ? 1 : 0;
+        size_t ry = (y & s) ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        // rotate the quadrant so that the curve enters it at its corner
+        if( ry == 0 )
+        {
+            if( rx == 1 )
+            {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+// compares pixels by their position along the curve
+struct CurveOrder
+{
+    CurveOrder(PixelOrder order, size_t width, size_t n):
+        order(order), width(width), n(n)
+    {}
+
+    size_t key(size_t p) const
+    {
+        size_t x = p % width, y = p / width;
+        return (order == MortonOrder) ? mortonCode(x, y) : hilbertIndex(n, x, y);
+    }
+
+    bool operator()(size_t a, size_t b) const
+    {
+        return key(a) < key(b);
+    }
+
+    PixelOrder order;
+    size_t width, n;
+};
+}
+
+void pixelOrder(PixelOrder order, size_t width, size_t height, vector<size_t> &indices)
+{
+    size_t pixelNumber = width * height;
+    indices.resize(pixelNumber);
+
+    for(size_t p=0;p<pixelNumber;p++)
+        indices[p] = p;
+
+    if( order == RowOrder )
+        return;
+
+    // the curve fills the power of two square around the tile, the pixels
+    // outside are skipped by sorting on the position along it; the keys are
+    // computed in the comparisons so that no buffer is needed
+    size_t n = 1;
+    while( n < width || n < height )
+        n *= 2;
+
+    std::sort(indices.begin(), indices.end(), CurveOrder(order, width, n));
+}
+
+TileScheduler::TileScheduler():
+    _tileNumber(0)
+{
+}
+
+TileScheduler::~TileScheduler()
+{
+    clear();
+}
+
+void TileScheduler::clear()
+{
+    for(size_t i=0;i<_queues.size();i++)
+        delete _queues[i];
+    _queues.clear();
+    _tileNumber = 0;
+}
+
+void TileScheduler::setup(size_t imageWidth, size_t imageHeight, size_t tileSize, size_t workerNumber)
+{
+    if( workerNumber == 0 )
+        workerNumber = 1;
+    if( tileSize == 0 )
+        tileSize = 32;
+
+    if( _queues.size() != workerNumber )
+    {
+        clear();
+        for(size_t i=0;i<workerNumber;i++)
+            _queues.push_back(new WorkQueue);
+    }
+
+    size_t tilesX = (imageWidth + tileSize - 1) / tileSize;
+    size_t tilesY = (imageHeight + tileSize - 1) / tileSize;
+    _tileNumber = countTiles(imageWidth, imageHeight, tileSize);
+
+    for(size_t i=0;i<workerNumber;i++)
+    {
+        _queues[i]->tiles.clear();
+        _queues[i]->tiles.reserve(_tileNumber / workerNumber + 1);
+    }
+
+    // give each worker a contiguous band of tiles, neighboring tiles
+    // see similar parts of the scene
+    size_t tileIdx = 0;
+    for(size_t ty=0;ty<tilesY;ty++)
+    {
+        for(size_t tx=0;tx<tilesX;tx++)
+        {
+            Tile t;
+            t.x = tx * tileSize;
+            t.y = ty * tileSize;
+            t.width = (t.x + tileSize > imageWidth) ? (imageWidth - t.x) : tileSize;
+            t.height = (t.y + tileSize > imageHeight) ? (imageHeight - t.y) : tileSize;
+
+            size_t owner = tileIdx * workerNumber / _tileNumber;
+            _queues[owner]->tiles.push_back(t);
+            tileIdx++;
+        }
+    }
+
+    for(size_t i=0;i<workerNumber;i++)
+    {
+        _queues[i]->head = 0;
+        _queues[i]->tail = _queues[i]->tiles.size();
+    }
+}
+
+size_t TileScheduler::countTiles(size_t imageWidth, size_t imageHeight, size_t tileSize)
+{
+    if( tileSize == 0 )
+        tileSize = 32;
+
+    return ((imageWidth + tileSize - 1) / tileSize) * ((imageHeight + tileSize - 1) / tileSize);
+}
+
+bool TileScheduler::nextTile(size_t workerId, Tile &t)
+{
+    if( workerId >= _queues.size() )
+        return false;
+
+    if( popFront(workerId, t) )
+        return true;
+
+    // own queue is drained, steal from the others
+    for(size_t i=1;i<_queues.size();i++)
+    {
+        size_t victim = (workerId + i) % _queues.size();
+        if( popBack(victim, t) )
+            return true;
+    }
+
+    return false;
+}
+
+bool TileScheduler::popFront(size_t workerId, Tile &t)
+{
+    WorkQueue* q = _queues[workerId];
+    QMutexLocker locker(&q->mutex);
+
+    if( q->head == q->tail )
+        return false;
+
+    t = q->tiles[q->head++];
+    return true;
+}
+
+bool TileScheduler::popBack(size_t workerId, Tile &t)
+{
+    WorkQueue* q = _queues[workerId];
+    QMutexLocker locker(&q->mutex);
+
+    if( q->head == q->tail )
+        return false;
+
+    t = q->tiles[--q->tail];
+    return true;
+}
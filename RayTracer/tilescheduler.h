@@ -0,0 +1,71 @@
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <cstdlib>
+#include <vector>
+using namespace std;
+
+#include <QMutex>
+
+// a rectangular block of pixels, rendered as one unit of work
+struct Tile
+{
+    size_t x, y;
+    size_t width, height;
+};
+
+// order in which the pixels of a tile are traced; along a space filling
+// curve consecutive rays stay close on the image in both directions, so a
+// packet covers a compact block and the next rays go through the same
+// nodes and shapes, still in the caches
+enum PixelOrder
+{
+    RowOrder,
+    MortonOrder,
+    HilbertOrder
+};
+
+// the indices y * width + x of the pixels of a width x height tile, in the
+// given order
+void pixelOrder(PixelOrder order, size_t width, size_t height, vector<size_t>& indices);
+
+// distributes the tiles of a frame among the worker threads
+// each worker owns a queue and takes tiles from its front, an idle worker
+// steals from the back of the other queues; a scheduler set up again for
+// the next frame reuses its queues
+class TileScheduler
+{
+public:
+    TileScheduler();
+    ~TileScheduler();
+
+    void setup(size_t imageWidth, size_t imageHeight, size_t tileSize, size_t workerNumber);
+    void clear();
+
+    bool nextTile(size_t workerId, Tile& t);
+
+    size_t tileNumber() const { return _tileNumber; }
+    size_t workerNumber() const { return _queues.size(); }
+
+    static size_t countTiles(size_t imageWidth, size_t imageHeight, size_t tileSize);
+
+private:
+    // the tiles from head to tail are left
+    struct WorkQueue
+    {
+        WorkQueue(): head(0), tail(0) {}
+
+        QMutex mutex;
+        vector<Tile> tiles;
+        size_t head, tail;
+    };
+
+    bool popFront(size_t workerId, Tile& t);
+    bool popBack(size_t workerId, Tile& t);
+
+private:
+    vector<WorkQueue*> _queues;
+    size_t _tileNumber;
+};
+
+#endif // TILESCHEDULER_H
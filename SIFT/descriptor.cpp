@@ -0,0 +1,125 @@
+#include "descriptor.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace DescriptorUtils
+{
+
+namespace
+{
+template <typename T>
+void quantizeValues(const T* signature, unsigned char* descriptor, int length)
+{
+    for(int i=0;i<length;i++)
+    {
+        int v = (int)(signature[i] * 512.0 + 0.5);
+        if(v < 0) v = 0;
+        if(v > 255) v = 255;
+        descriptor[i] = (unsigned char)v;
+    }
+}
+}
+
+void quantize(const double* signature, unsigned char* descriptor, int length)
+{
+    quantizeValues(signature, descriptor, length);
+}
+
+void quantize(const float* signature, unsigned char* descriptor, int length)
+{
+    quantizeValues(signature, descriptor, length);
+}
+
+#if defined(__AVX2__)
+
+int squaredDistance(const unsigned char* a, const unsigned char* b)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum = zero;
+    for(int i=0;i<DESCRIPTOR_LENGTH;i+=32)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+
+        // |a - b| in bytes, widened to 16 bits and squared pairwise into 32
+        __m256i d = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+        __m256i lo = _mm256_unpacklo_epi8(d, zero);
+        __m256i hi = _mm256_unpackhi_epi8(d, zero);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(lo, lo));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(hi, hi));
+    }
+
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+#elif defined(__SSE2__)
+
+int squaredDistance(const unsigned char* a, const unsigned char* b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for(int i=0;i<DESCRIPTOR_LENGTH;i+=16)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+
+        // |a - b| in bytes, widened to 16 bits and squared pairwise into 32
+        __m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        __m128i lo = _mm_unpacklo_epi8(d, zero);
+        __m128i hi = _mm_unpackhi_epi8(d, zero);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(lo, lo));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(hi, hi));
+    }
+
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+#else
+
+int squaredDistance(const unsigned char* a, const unsigned char* b)
+{
+    int sum = 0;
+    for(int i=0;i<DESCRIPTOR_LENGTH;i++)
+    {
+        int d = (int)a[i] - (int)b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+#endif
+
+void squaredDistances(const unsigned char* a, size_t na,
+                      const unsigned char* b, size_t nb, int* dist)
+{
+    // 64 descriptors of each side take 16 KB, every pair of blocks is
+    // compared while both are in the first level cache
+    const size_t BLOCK_SIZE = 64;
+
+    for(size_t i0=0;i0<na;i0+=BLOCK_SIZE)
+    {
+        size_t i1 = (i0 + BLOCK_SIZE < na) ? i0 + BLOCK_SIZE : na;
+        for(size_t j0=0;j0<nb;j0+=BLOCK_SIZE)
+        {
+            size_t j1 = (j0 + BLOCK_SIZE < nb) ? j0 + BLOCK_SIZE : nb;
+            for(size_t i=i0;i<i1;i++)
+            {
+                const unsigned char* da = a + i * DESCRIPTOR_LENGTH;
+                int* row = dist + i * nb;
+                for(size_t j=j0;j<j1;j++)
+                    row[j] = squaredDistance(da, b + j * DESCRIPTOR_LENGTH);
+            }
+        }
+    }
+}
+
+}
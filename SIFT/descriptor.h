@@ -0,0 +1,30 @@
+#ifndef DESCRIPTOR_H
+#define DESCRIPTOR_H
+
+#include <cstdlib>
+
+//! SIFT descriptors quantized to bytes as in Lowe's key files, the unit
+//! length signature times 512 and clamped to 255, a descriptor takes 128
+//! bytes instead of 1 KB of doubles. The distance kernels use AVX2 or SSE2
+//! when the compiler enables them.
+namespace DescriptorUtils
+{
+
+static const int DESCRIPTOR_LENGTH = 128;
+
+void quantize(const double* signature, unsigned char* descriptor, int length = DESCRIPTOR_LENGTH);
+void quantize(const float* signature, unsigned char* descriptor, int length = DESCRIPTOR_LENGTH);
+
+//! squared euclidean distance of two quantized descriptors, the ratio test
+//! compares squared distances and no square root is needed
+int squaredDistance(const unsigned char* a, const unsigned char* b);
+
+//! squared distances of the na descriptors of a to the nb descriptors of b,
+//! into the row major na x nb table dist; the table is filled in blocks of
+//! descriptors that stay in the caches while they are compared
+void squaredDistances(const unsigned char* a, size_t na,
+                      const unsigned char* b, size_t nb, int* dist);
+
+}
+
+#endif // DESCRIPTOR_H
@@ -0,0 +1,218 @@
+#include "gaussianblur.h"
+#include "util_common.h"
+#include "utility.hpp"
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+//! columns of a strip of the vertical pass, 1 KB of floats per row
+const int STRIP_WIDTH = 256;
+
+//! weighted sum of the taps starting at in, in the order of the kernel
+inline float convolve(const float* in, const float* kernel, int kernelSize)
+{
+    float sum = 0;
+    for(int i=0;i<kernelSize;i++)
+        sum += kernel[i] * in[i];
+    return sum;
+}
+
+//! weighted sum of the same column of the tap rows
+inline float convolveColumn(const float* const* rows, int x, const float* kernel, int kernelSize)
+{
+    float sum = 0;
+    for(int i=0;i<kernelSize;i++)
+        sum += kernel[i] * rows[i][x];
+    return sum;
+}
+}
+
+GaussianBlur::GaussianBlur():
+    _sigma(-1),
+    _left(0),
+    _right(0)
+{
+}
+
+void GaussianBlur::apply(const GrayScaleImage &src, GrayScaleImage &dst, double sigma)
+{
+    int width = src.width(), height = src.height();
+    dst.resize(width, height);
+    apply(src.rawData(), dst.rawData(), width, height, sigma);
+}
+
+void GaussianBlur::apply(const GrayScaleImage &src, GrayScaleImage &dst, double sigma, GrayScaleImage &difference)
+{
+    int width = src.width(), height = src.height();
+    dst.resize(width, height);
+    difference.resize(width, height);
+    apply(src.rawData(), dst.rawData(), width, height, sigma, difference.rawData());
+}
+
+void GaussianBlur::apply(const GrayScalePixel *src, GrayScalePixel *dst, int width, int height, double sigma,
+                         GrayScalePixel *difference)
+{
+    if(width <= 0 || height <= 0)
+        return;
+
+    buildKernel(sigma);
+    padRows(src, width, height);
+    horizontalPass(width, height);
+    verticalPass(src, dst, width, height, difference);
+}
+
+void GaussianBlur::buildKernel(double sigma)
+{
+    if(sigma == _sigma)
+        return;
+    _sigma = sigma;
+
+    // the taps of gaussianFilter_bidirectional_CPU, 4 sigma wide
+    int kernelSize = ceil(4.0 * sigma);
+    if(kernelSize < 1) kernelSize = 1;
+
+    vector<double> kernel(kernelSize);
+    double inverseSigma = 1.0 / sigma;
+    double inverseTwoSigmaSquare = 0.5 * inverseSigma * inverseSigma;
+    _left = (kernelSize - 1) / 2;
+    _right = kernelSize - 1 - _left;
+    for (int i=0;i<kernelSize;i++)
+    {
+        int x = i - _left;
+        kernel[i] = 1.0 / sqrt(2.0 * Utils::PI) * inverseSigma * exp( - x * x * inverseTwoSigmaSquare);
+    }
+
+    Utils::normalizeVector<double>(&kernel[0], kernelSize);
+
+    _kernel.assign(kernel.begin(), kernel.end());
+}
+
+void GaussianBlur::padRows(const GrayScalePixel *src, int width, int height)
+{
+    int paddedWidth = width + _left + _right;
+    _padded.resize((size_t)paddedWidth * height);
+
+#pragma omp parallel for
+    for (int y=0;y<height;y++)
+    {
+        const GrayScalePixel* in = src + (size_t)y * width;
+        float* out = &_padded[(size_t)y * paddedWidth];
+
+        float first = in[0], last = in[width - 1];
+        for (int x=0;x<_left;x++)
+            out[x] = first;
+        out += _left;
+        for (int x=0;x<width;x++)
+            out[x] = in[x];
+        for (int x=0;x<_right;x++)
+            out[width + x] = last;
+    }
+}
+
+void GaussianBlur::horizontalPass(int width, int height)
+{
+    int paddedWidth = width + _left + _right;
+    int kernelSize = _kernel.size();
+    const float* kernel = &_kernel[0];
+    _rows.resize((size_t)width * height);
+
+#pragma omp parallel for
+    for (int y=0;y<height;y++)
+    {
+        // the taps of pixel x start at in[x]
+        const float* in = &_padded[(size_t)y * paddedWidth];
+        float* out = &_rows[(size_t)y * width];
+
+        int x = 0;
+#if defined(__AVX__)
+        for (;x+8<=width;x+=8)
+        {
+            __m256 sum = _mm256_setzero_ps();
+            for (int i=0;i<kernelSize;i++)
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(kernel[i]),
+                                                       _mm256_loadu_ps(in + x + i)));
+            _mm256_storeu_ps(out + x, sum);
+        }
+#elif defined(__SSE2__)
+        for (;x+4<=width;x+=4)
+        {
+            __m128 sum = _mm_setzero_ps();
+            for (int i=0;i<kernelSize;i++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel[i]),
+                                                 _mm_loadu_ps(in + x + i)));
+            _mm_storeu_ps(out + x, sum);
+        }
+#endif
+        for (;x<width;x++)
+            out[x] = convolve(in + x, kernel, kernelSize);
+    }
+}
+
+void GaussianBlur::verticalPass(const GrayScalePixel *src, GrayScalePixel *dst, int width, int height,
+                                GrayScalePixel *difference)
+{
+    int kernelSize = _kernel.size();
+    const float* kernel = &_kernel[0];
+
+    // the taps of row y are the rows _tapRows[y .. y + kernelSize), the
+    // border repeats the first and the last row
+    _tapRows.resize(height + kernelSize - 1);
+    for (int i=0;i<(int)_tapRows.size();i++)
+    {
+        int r = i - _left;
+        if(r < 0) r = 0;
+        if(r >= height) r = height - 1;
+        _tapRows[i] = &_rows[(size_t)r * width];
+    }
+
+    for (int x0=0;x0<width;x0+=STRIP_WIDTH)
+    {
+        int x1 = x0 + STRIP_WIDTH < width ? x0 + STRIP_WIDTH : width;
+
+#pragma omp parallel for
+        for (int y=0;y<height;y++)
+        {
+            const float* const* taps = &_tapRows[y];
+            GrayScalePixel* out = dst + (size_t)y * width;
+            int x = x0;
+#if defined(__AVX__)
+            for (;x+8<=x1;x+=8)
+            {
+                __m256 sum = _mm256_setzero_ps();
+                for (int i=0;i<kernelSize;i++)
+                    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(kernel[i]),
+                                                           _mm256_loadu_ps(taps[i] + x)));
+                _mm256_storeu_pd(out + x, _mm256_cvtps_pd(_mm256_castps256_ps128(sum)));
+                _mm256_storeu_pd(out + x + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(sum, 1)));
+            }
+#elif defined(__SSE2__)
+            for (;x+4<=x1;x+=4)
+            {
+                __m128 sum = _mm_setzero_ps();
+                for (int i=0;i<kernelSize;i++)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel[i]),
+                                                     _mm_loadu_ps(taps[i] + x)));
+                _mm_storeu_pd(out + x, _mm_cvtps_pd(sum));
+                _mm_storeu_pd(out + x + 2, _mm_cvtps_pd(_mm_movehl_ps(sum, sum)));
+            }
+#endif
+            for (;x<x1;x++)
+                out[x] = convolveColumn(taps, x, kernel, kernelSize);
+
+            if(difference)
+            {
+                const GrayScalePixel* in = src + (size_t)y * width;
+                GrayScalePixel* diff = difference + (size_t)y * width;
+                for (x=x0;x<x1;x++)
+                    diff[x] = out[x] - in[x];
+            }
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef GAUSSIANBLUR_H
+#define GAUSSIANBLUR_H
+
+#include "grayscaleimage.h"
+
+#include <vector>
+using namespace std;
+
+//! Separable gaussian filter for the pyramids, computed on float rows.
+//! The image is copied once into rows padded with the border pixels, the
+//! horizontal pass then reads its taps without bounds checks, vectorized
+//! with AVX or SSE when the compiler enables them. The vertical pass runs
+//! along the rows in strips of columns, the rows of the taps of a strip
+//! stay in the first level cache.
+//! The kernel and the scratch buffers are kept and reused by the next
+//! image, a blur object serves one thread at a time.
+class GaussianBlur
+{
+public:
+    GaussianBlur();
+
+    //! blurs src into dst, dst is reallocated only when its size differs;
+    //! src and dst may be the same image
+    void apply(const GrayScaleImage& src, GrayScaleImage& dst, double sigma);
+
+    //! also writes dst - src to difference while the rows of dst are in
+    //! the cache, the difference of gaussians of two pyramid levels; src
+    //! and dst are different images then
+    void apply(const GrayScaleImage& src, GrayScaleImage& dst, double sigma, GrayScaleImage& difference);
+
+    void apply(const GrayScalePixel* src, GrayScalePixel* dst, int width, int height, double sigma,
+               GrayScalePixel* difference = 0);
+
+private:
+    void buildKernel(double sigma);
+    void padRows(const GrayScalePixel* src, int width, int height);
+    void horizontalPass(int width, int height);
+    void verticalPass(const GrayScalePixel* src, GrayScalePixel* dst, int width, int height,
+                      GrayScalePixel* difference);
+
+private:
+    //! taps at offsets -_left .. _right around the pixel
+    double _sigma;
+    vector<float> _kernel;
+    int _left, _right;
+
+    //! the image with _left and _right border pixels on every row, and
+    //! the result of the horizontal pass
+    vector<float> _padded;
+    vector<float> _rows;
+    vector<const float*> _tapRows;
+};
+
+#endif // GAUSSIANBLUR_H
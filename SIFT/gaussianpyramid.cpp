@@ -0,0 +1,70 @@
+#include "gaussianpyramid.h"
+#include "imageoperator.h"
+
+GaussianPyramid::GaussianPyramid():
+    _width(0),
+    _height(0),
+    _octaves(0),
+    _gaussianNumber(0),
+    _downsampleFactor(0)
+{
+}
+
+void GaussianPyramid::allocate(size_t width, size_t height, int octaves, int gaussianNumber, double downsampleFactor)
+{
+    if(width == _width && height == _height && octaves == _octaves
+            && gaussianNumber == _gaussianNumber && downsampleFactor == _downsampleFactor)
+        return;
+
+    _width = width;
+    _height = height;
+    _octaves = octaves;
+    _gaussianNumber = gaussianNumber;
+    _downsampleFactor = downsampleFactor;
+
+    // octave sizes as bilinearSampling_CPU computes them
+    int dogNumber = gaussianNumber - 1;
+    vector<size_t> widths(octaves), heights(octaves);
+    size_t arenaSize = 0;
+    for(int i=0;i<octaves;i++)
+    {
+        widths[i] = width;
+        heights[i] = height;
+        arenaSize += width * height * (gaussianNumber + dogNumber);
+        width = (int)(width * downsampleFactor);
+        height = (int)(height * downsampleFactor);
+    }
+
+    // the levels are attached again, none refers to the old arena
+    _gaussianImages.clear();
+    _dogImages.clear();
+    _arena.resize(arenaSize);
+    _gaussianImages.resize(octaves * gaussianNumber);
+    _dogImages.resize(octaves * dogNumber);
+    _gaussians.resize(octaves);
+    _dogs.resize(octaves);
+
+    GrayScalePixel* level = _arena.empty() ? 0 : &_arena[0];
+    for(int i=0;i<octaves;i++)
+    {
+        size_t size = widths[i] * heights[i];
+        _gaussians[i] = &_gaussianImages[i * gaussianNumber];
+        _dogs[i] = &_dogImages[i * dogNumber];
+        for(int j=0;j<gaussianNumber;j++, level+=size)
+            _gaussians[i][j].attach(level, widths[i], heights[i]);
+        for(int j=0;j<dogNumber;j++, level+=size)
+            _dogs[i][j].attach(level, widths[i], heights[i]);
+    }
+}
+
+void GaussianPyramid::build(const double *sigma, int downsampleLevel, GaussianBlur &blur)
+{
+    for(int i=0;i<_octaves;i++)
+    {
+        if(i > 0)
+            ImageOperator::bilinearSampling_CPU(_gaussians[i - 1][downsampleLevel], _downsampleFactor, _gaussians[i][0]);
+
+        for(int j=1;j<_gaussianNumber;j++)
+            blur.apply(_gaussians[i][j - 1], _gaussians[i][j], sigma[j], _dogs[i][j - 1]);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef GAUSSIANPYRAMID_H
+#define GAUSSIANPYRAMID_H
+
+#include "grayscaleimage.h"
+#include "gaussianblur.h"
+
+#include <vector>
+using namespace std;
+
+//! Gaussian and difference of gaussian pyramids in one arena. The levels
+//! are images attached to the arena, octave after octave; a difference is
+//! written by the blur of the level above it. The arena and the levels are
+//! kept when the next image has the same layout, the frames of a sequence
+//! are processed without allocating the pyramids again.
+class GaussianPyramid
+{
+public:
+    GaussianPyramid();
+
+    //! lays out octaves of gaussianNumber levels and gaussianNumber - 1
+    //! differences, the first octave of width x height and every next one
+    //! downsampled by downsampleFactor
+    void allocate(size_t width, size_t height, int octaves, int gaussianNumber, double downsampleFactor);
+
+    //! builds the pyramids from the first level of the first octave, level
+    //! j is level j - 1 blurred by sigma[j]; the first level of the next
+    //! octave is downsampled from level downsampleLevel
+    void build(const double* sigma, int downsampleLevel, GaussianBlur& blur);
+
+    //! levels and differences by octave, valid until the next allocate
+    GrayScaleImage** gaussians() {return _gaussians.empty() ? 0 : &_gaussians[0];}
+    GrayScaleImage** dogs() {return _dogs.empty() ? 0 : &_dogs[0];}
+
+    size_t arenaSize() const {return _arena.size() * sizeof(GrayScalePixel);}
+
+private:
+    size_t _width, _height;
+    int _octaves, _gaussianNumber;
+    double _downsampleFactor;
+
+    vector<GrayScalePixel> _arena;
+    vector<GrayScaleImage> _gaussianImages, _dogImages;
+    vector<GrayScaleImage*> _gaussians, _dogs;
+};
+
+#endif // GAUSSIANPYRAMID_H
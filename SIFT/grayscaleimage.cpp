@@ -15,21 +15,24 @@ const GrayScalePixel GrayScaleImage::MIN_VALUE = 0.0;
 GrayScaleImage::GrayScaleImage():
         _width(0),
         _height(0),
-        _data(0)
+        _data(0),
+        _owner(true)
 {
 }
 
 GrayScaleImage::GrayScaleImage(size_t w, size_t h):
         _width(w),
         _height(h),
-        _data(new GrayScalePixel[w * h])
+        _data(new GrayScalePixel[w * h]),
+        _owner(true)
 {
 }
 
 GrayScaleImage::GrayScaleImage(size_t w, size_t h, GrayScalePixel value):
         _width(w),
         _height(h),
-        _data(new GrayScalePixel[w * h])
+        _data(new GrayScalePixel[w * h]),
+        _owner(true)
 {
     for (size_t i=0;i<_width*_height;i++)
     {
@@ -41,7 +44,8 @@ GrayScaleImage::GrayScaleImage(size_t w, size_t h, GrayScalePixel value):
 GrayScaleImage::GrayScaleImage(GrayScalePixel* rawData, size_t w, size_t h, bool isRGBA):
         _width(w),
         _height(h),
-        _data(new GrayScalePixel[w * h])
+        _data(new GrayScalePixel[w * h]),
+        _owner(true)
 {
     if (isRGBA)
     {
@@ -61,7 +65,8 @@ GrayScaleImage::GrayScaleImage(GrayScalePixel* rawData, size_t w, size_t h, bool
 GrayScaleImage::GrayScaleImage(const GrayScaleImage& a):
         _width(a._width),
         _height(a._height),
-        _data(new GrayScalePixel[_width * _height])
+        _data(new GrayScalePixel[_width * _height]),
+        _owner(true)
 {
     memcpy(_data, a._data, sizeof(GrayScalePixel)*_width*_height);
 }
@@ -74,27 +79,54 @@ GrayScaleImage& GrayScaleImage::operator=(const GrayScaleImage& img)
     }
     else
     {
-        if (_data != 0)
-            delete[] _data;
-
-        _width = img.width();
-        _height = img.height();
-        _data = new GrayScalePixel[_width * _height];
+        resize(img.width(), img.height());
         memcpy(_data, img.rawData(), sizeof(GrayScalePixel)*_width*_height);
         return *this;
     }
 }
 
+void GrayScaleImage::resize(size_t w, size_t h)
+{
+    if (w == _width && h == _height && _data != 0)
+        return;
+
+    release();
+
+    _width = w;
+    _height = h;
+    _data = new GrayScalePixel[_width * _height];
+}
+
+void GrayScaleImage::attach(GrayScalePixel* data, size_t w, size_t h)
+{
+    release();
+
+    _width = w;
+    _height = h;
+    _data = data;
+    _owner = false;
+}
+
 GrayScaleImage::GrayScaleImage(const std::string& filename):
         _width(0),
         _height(0),
-        _data(0)
+        _data(0),
+        _owner(true)
 {
     loadImage(filename);
 }
 
 GrayScaleImage::~GrayScaleImage()
 {
+    release();
+}
+
+void GrayScaleImage::release()
+{
+    if (_owner && _data != 0)
+        delete[] _data;
+    _data = 0;
+    _owner = true;
 }
 
 bool GrayScaleImage::loadImage(const string& filename)
@@ -103,6 +135,7 @@ bool GrayScaleImage::loadImage(const string& filename)
 	return false;
     
     QImage img(filename.c_str());
+    release();
     _width = img.width();
     _height = img.height();
     _data = new GrayScalePixel[_width * _height];
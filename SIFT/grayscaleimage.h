@@ -27,6 +27,16 @@ public:
     const size_t& width() const {return _width;}
     const size_t& height() const {return _height;}
     const GrayScalePixel* rawData() const {return _data;}
+    GrayScalePixel* rawData() {return _data;}
+
+    //! reallocates the pixels when the size changes, their values are
+    //! undefined then
+    void resize(size_t w, size_t h);
+
+    //! refers to pixels owned elsewhere, e.g. the arena of a pyramid; they
+    //! are not released with the image, an assignment of the same size
+    //! copies into them
+    void attach(GrayScalePixel* data, size_t w, size_t h);
 
     GrayScalePixel getPixel(size_t x, size_t y);
     void getNeighbor(size_t, size_t, size_t, GrayScalePixel*);
@@ -37,8 +47,11 @@ public:
     static const GrayScalePixel MIN_VALUE;
 
     private:
+    void release();
+
     size_t _width, _height;
     GrayScalePixel* _data;
+    bool _owner;
 };
 
 #endif // ALPHAMASK_H
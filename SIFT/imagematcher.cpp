@@ -1,8 +1,31 @@
 #include "imagematcher.h"
 #include "ui_imagematcher.h"
+#include "kdtree.h"
+#include "descriptor.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+//! byte descriptors of the keys, quantized into buffer unless the file
+//! holds bytes already
+const unsigned char* byteDescriptors(const KeyFile& keys, vector<unsigned char>& buffer)
+{
+    if(keys.descriptorType() == KeyFile::ByteDescriptors)
+        return keys.byteDescriptors();
+
+    const int length = keys.dimension();
+    buffer.resize(keys.size() * length);
+    for(size_t i=0;i<keys.size();i++)
+        DescriptorUtils::quantize(keys.floatDescriptors() + i * length, &buffer[i * length], length);
+    return buffer.empty() ? 0 : &buffer[0];
+}
+}
 
 ImageMatcher::ImageMatcher(QWidget* parent):
     QDialog(parent),
+    matchChecks(128),
     ui(new Ui::ImageMatcher)
 {
     ui->setupUi(this);
@@ -91,30 +114,9 @@ void ImageMatcher::printArray(const double* a, int s)
     printf("\n");
 }
 
-bool ImageMatcher::testMatch(const Feature& f1, const Feature& f2)
-{
-    const double FEAT_VEC_DIFF_THRESHOLD = 0.2;
-    bool flag = true;
-    double vec_diff_sum = 0;
-    for(int i=0;i<128;i++)
-        vec_diff_sum += abs(f1.signature[i] - f2.signature[i]);
-    flag &= (vec_diff_sum <= FEAT_VEC_DIFF_THRESHOLD);
-    if(flag) cout << "diff = " << vec_diff_sum << endl;
-    return flag;
-}
-
-double ImageMatcher::calEuclideanDistance(const Feature& f1, const Feature& f2)
-{
-    double vec_diff_sum = 0;
-    for(int i=0;i<128;i++)
-        vec_diff_sum += pow((f1.signature[i] - f2.signature[i]), 2);
-
-    return sqrt(vec_diff_sum);
-}
-
 QImage ImageMatcher::combineImages(const string& imgfile1, const string& imgfile2,
                      const list<pair<int, int> > matchPairs,
-                     Feature* f1, Feature* f2)
+                     const KeyFile::Keypoint* f1, const KeyFile::Keypoint* f2)
 {
     QImage img1(imgfile1.c_str()), img2(imgfile2.c_str());
     int width = img1.width() + img2.width();
@@ -150,7 +152,7 @@ QImage ImageMatcher::combineImages(const string& imgfile1, const string& imgfile
 
         QColor c = QColor::fromHsvF(colorRatio, 0.75, 1.0, 0.75);
         int idx1 = (*it).first, idx2 = (*it).second;
-        Feature &f_img1 = f1[idx1], &f_img2 = f2[idx2];
+        const KeyFile::Keypoint &f_img1 = f1[idx1], &f_img2 = f2[idx2];
         p.setPen(c);
         p.drawLine(f_img1.x, f_img1.y, f_img2.x + xShift, f_img2.y);
         p.setPen(Qt::red);
@@ -171,7 +173,7 @@ QImage ImageMatcher::combineImages(const string& imgfile1, const string& imgfile
         QString s(tag.c_str());
 
         int idx1 = (*it).first, idx2 = (*it).second;
-        Feature &f_img1 = f1[idx1], &f_img2 = f2[idx2];
+        const KeyFile::Keypoint &f_img1 = f1[idx1], &f_img2 = f2[idx2];
 
         p.setFont(QFont("serif", 10));
         p.setPen(Qt::white);
@@ -188,84 +190,98 @@ QImage ImageMatcher::combineImages(const string& imgfile1, const string& imgfile
 
 void ImageMatcher::matchImage(const string &imgfile1, const string &imgfile2, const string &keyfile1, const string &keyfile2, const string &outfilename)
 {
-    ifstream infile1, infile2;
-    infile1.open(keyfile1.c_str(), ios::in);
-    infile2.open(keyfile2.c_str(), ios::in);
-
-    int size1, size2;
-    int vecSize;
-    Feature *f1, *f2;
-    infile1 >> size1 >> vecSize;
-    infile2 >> size2 >> vecSize;
-    cout << size1 << " features in file " << keyfile1 << endl;
-    cout << size2 << " features in file " << keyfile2 << endl;
-    f1 = new Feature[size1];
-    f2 = new Feature[size2];
-
-    int idx = 0;
-    while(!infile1.eof() && (idx < size1))
+    KeyFile keys1, keys2;
+    if(!keys1.load(keyfile1) || !keys2.load(keyfile2))
     {
-        infile1 >> f1[idx].x
-                >> f1[idx].y
-                >> f1[idx].scale
-                >> f1[idx].orientation;
-
-        for(int i=0;i<vecSize;i++)
-            infile1 >> f1[idx].signature[i];
-        idx++;
+        cout << "cannot read key files " << keyfile1 << ", " << keyfile2 << endl;
+        return;
     }
 
-    idx = 0;
-    while(!infile2.eof() && (idx < size2))
+    const int SIGNATURE_SIZE = DescriptorUtils::DESCRIPTOR_LENGTH;
+    if(keys1.dimension() != SIGNATURE_SIZE || keys2.dimension() != SIGNATURE_SIZE)
     {
-        infile2 >> f2[idx].x
-                >> f2[idx].y
-                >> f2[idx].scale
-                >> f2[idx].orientation;
-
-        for(int i=0;i<vecSize;i++)
-            infile2 >> f2[idx].signature[i];
-        idx++;
+        cout << "descriptors of " << SIGNATURE_SIZE << " values expected" << endl;
+        return;
     }
 
+    int size1 = keys1.size(), size2 = keys2.size();
+    cout << size1 << " features in file " << keyfile1 << endl;
+    cout << size2 << " features in file " << keyfile2 << endl;
+
     cout << "matching keys ... " << endl;
 
-    // brute force match
-    int matchCount = 0;
-    list<pair<int, int> > matchPairs;
-    for(int i=0;i<size1;i++)
+    // the descriptors are compared as bytes with the SIMD kernels of
+    // DescriptorUtils, the bytes of a binary key file are used in place
+    vector<unsigned char> buffer1, buffer2;
+    const unsigned char* descriptors1 = byteDescriptors(keys1, buffer1);
+    const unsigned char* descriptors2 = byteDescriptors(keys2, buffer2);
+
+    // nearest and second nearest key of every key, a match when the nearest
+    // is clearly closer (Lowe's ratio test), on squared distances
+    vector<int> nearest1(size1 * 2, -1);
+    vector<double> dist1(size1 * 2, DBL_MAX);
+    if(size1 > 0 && size2 > 0)
     {
-        pair<int, double> matchCase[2];
-        matchCase[0].second = matchCase[1].second = DBL_MAX;
-
-        for(int j=0;j<size2;j++)
+        if(matchChecks > 0)
         {
-            double dist = calEuclideanDistance(f1[i], f2[j]);
-            if( dist < matchCase[0].second )
-            {
-                matchCase[0].first = j;
-                matchCase[0].second = dist;
-            }
-
-            if(matchCase[0].second < matchCase[1].second)
+            // index the keys of the second image
+            KDTree<unsigned char> tree;
+            tree.build(descriptors2, size2, SIGNATURE_SIZE);
+            for(int i=0;i<size1;i++)
+                tree.nearest2(descriptors1 + i * SIGNATURE_SIZE, matchChecks,
+                              &nearest1[i * 2], &dist1[i * 2]);
+        }
+        else
+        {
+            // exact matching, the distances of a block of keys to all keys
+            // of the second image are computed together
+            const int BLOCK_SIZE = 64;
+            vector<int> distances(BLOCK_SIZE * size2);
+            for(int i0=0;i0<size1;i0+=BLOCK_SIZE)
             {
-                // swap it
-                int tmpIdx = matchCase[1].first;
-                double tmpDist = matchCase[1].second;
-                matchCase[1] = matchCase[0];
-                matchCase[0].first = tmpIdx;
-                matchCase[0].second = tmpDist;
+                int n = min(BLOCK_SIZE, size1 - i0);
+                DescriptorUtils::squaredDistances(descriptors1 + i0 * SIGNATURE_SIZE, n,
+                                                  descriptors2, size2, &distances[0]);
+                for(int i=0;i<n;i++)
+                {
+                    int* nearest = &nearest1[(i0 + i) * 2];
+                    double* dist = &dist1[(i0 + i) * 2];
+                    const int* row = &distances[i * size2];
+                    for(int j=0;j<size2;j++)
+                    {
+                        if(row[j] < dist[0])
+                        {
+                            nearest[1] = nearest[0];
+                            dist[1] = dist[0];
+                            nearest[0] = j;
+                            dist[0] = row[j];
+                        }
+                        else if(row[j] < dist[1])
+                        {
+                            nearest[1] = j;
+                            dist[1] = row[j];
+                        }
+                    }
+                }
             }
         }
+    }
+
+    int matchCount = 0;
+    list<pair<int, int> > matchPairs;
+    for(int i=0;i<size1;i++)
+    {
+        const int* nearest = &nearest1[i * 2];
+        const double* dist = &dist1[i * 2];
 
         const double DIST_RATIO = 0.6;
-        if( matchCase[0].first != -1
-                && matchCase[1].first != -1 )
+        if( nearest[0] != -1
+                && nearest[1] != -1 )
         {
-            if( matchCase[1].second < DIST_RATIO * matchCase[0].second )
+            if( dist[0] < DIST_RATIO * DIST_RATIO * dist[1] )
             {
-                cout << "match @ " << i << ", " << matchCase[1].first << endl;
-                matchPairs.push_back(pair<int,int>(i, matchCase[1].first));
+                cout << "match @ " << i << ", " << nearest[0] << endl;
+                matchPairs.push_back(pair<int,int>(i, nearest[0]));
                 matchCount ++ ;
             }
         }
@@ -273,11 +289,8 @@ void ImageMatcher::matchImage(const string &imgfile1, const string &imgfile2, co
 
     cout << matchCount << " matches found!" << endl;
 
-    QImage combined = combineImages(imgfile1, imgfile2, matchPairs, f1, f2);
+    QImage combined = combineImages(imgfile1, imgfile2, matchPairs, keys1.keypoints(), keys2.keypoints());
     combined.save(outfilename.c_str());
 
     emit sig_imageMatched(combined);
-
-    delete[] f1;
-    delete[] f2;
 }
@@ -19,6 +19,8 @@
 #include <QString>
 #include <QApplication>
 
+#include "keyfile.h"
+
 using namespace std;
 
 namespace Ui {
@@ -31,6 +33,11 @@ class ImageMatcher : public QDialog
 public:
     ImageMatcher(QWidget* parent = 0);
 
+    //! number of keys of the second image compared to every key of the
+    //! first one by the approximate nearest neighbor search, more checks
+    //! find more of the true neighbors; 0 compares all keys exactly
+    void setMatchChecks(int checks) { matchChecks = checks; }
+
 public slots:
     void matchImage(const string &imgfile1, const string &imgfile2, const string &keyfile1, const string &keyfile2, const string &outfilename);
 
@@ -56,19 +63,13 @@ private slots:
 
 private:
     string imgfile[2], keyfile[2];
-
-    struct Feature
-    {
-        double x, y, scale, orientation;
-        double signature[128];
-    };
+    int matchChecks;
 
     Ui::ImageMatcher *ui;
 
     void printArray(const double*, int);
-    bool testMatch(const Feature &f1, const Feature &f2);
-    double calEuclideanDistance(const Feature &f1, const Feature &f2);
-    QImage combineImages(const string &imgfile1, const string &imgfile2, const list<pair<int, int> > matchPairs, Feature *f1, Feature *f2);
+    QImage combineImages(const string &imgfile1, const string &imgfile2, const list<pair<int, int> > matchPairs,
+                         const KeyFile::Keypoint *f1, const KeyFile::Keypoint *f2);
 };
 
 #endif // IMAGEMATCHER_H
@@ -1,4 +1,5 @@
 #include "imageoperator.h"
+#include "gaussianblur.h"
 
 namespace ImageOperator
 {
@@ -231,61 +232,9 @@ RGBAImage extrema_CPU(GrayScaleImage& img)
 
 GrayScaleImage gaussianFilter_bidirectional_CPU(GrayScaleImage& src, const double& sigma)
 {
-    int kernelSize = ceil(4.0 * sigma);
-    double* kernel = new double[kernelSize];
-    double inverseSigma = 1.0 / sigma;
-    double inverseTwoSigmaSquare = 0.5 * inverseSigma * inverseSigma;
-    for (int i=0;i<kernelSize;i++)
-    {
-        int x = i - (kernelSize - 1) / 2;
-        kernel[i] = 1.0 / sqrt(2.0 * PI) * inverseSigma * exp( - x * x * inverseTwoSigmaSquare);
-    }
-
-    Utils::normalizeVector<double>(kernel, kernelSize);
-
-    int width = src.width(), height = src.height();
-    int size = width * height;
-    GrayScalePixel* pixelArray = new GrayScalePixel[size];
-    memset(pixelArray, 0, sizeof(GrayScalePixel)*size);
-
-    // first pass, horizotal
-#pragma omp parallel for
-    for (int y=0;y<height;y++)
-    {
-        for (int x=0;x<width;x++)
-        {
-            int offset = y * width + x;
-            for (int i=0;i<kernelSize;i++)
-            {
-                int refOffset = i - (kernelSize - 1) / 2;
-                pixelArray[offset] += src.getPixel(x + refOffset, y) * kernel[i];
-            }
-        }
-    }
-
-    GrayScaleImage tmpImg(pixelArray, width, height);
-    memset(pixelArray, 0, sizeof(GrayScalePixel)*size);
-
-    // second pass, vertical
-#pragma omp parallel for
-    for (int y=0;y<height;y++)
-    {
-        for (int x=0;x<width;x++)
-        {
-            int offset = y * width + x;
-            for (int i=0;i<kernelSize;i++)
-            {
-                int refOffset = i - (kernelSize - 1) / 2;
-                pixelArray[offset] += tmpImg.getPixel(x, y + refOffset) * kernel[i];
-            }
-        }
-    }
-
-    GrayScaleImage result(pixelArray, width, height);
-
-    delete[] pixelArray;
-    delete[] kernel;
-
+    GaussianBlur blur;
+    GrayScaleImage result;
+    blur.apply(src, result, sigma);
     return result;
 }
 
@@ -313,10 +262,18 @@ GrayScaleImage difference_CPU(GrayScaleImage& img1, GrayScaleImage& img2)
 }
 
 GrayScaleImage bilinearSampling_CPU(GrayScaleImage& src, double scale)
+{
+    GrayScaleImage dst;
+    bilinearSampling_CPU(src, scale, dst);
+    return dst;
+}
+
+bool bilinearSampling_CPU(GrayScaleImage& src, double scale, GrayScaleImage& dst)
 {
     int width = src.width() * scale;
     int height = src.height() * scale;
-    GrayScalePixel* pixelArray = new GrayScalePixel[width * height];
+    dst.resize(width, height);
+    GrayScalePixel* pixelArray = dst.rawData();
 #pragma omp parallel for
     for (int y = 0; y < height; y++)
     {
@@ -343,10 +300,7 @@ GrayScaleImage bilinearSampling_CPU(GrayScaleImage& src, double scale)
         }
     }
 
-    GrayScaleImage dst = GrayScaleImage(pixelArray, width, height);
-
-    delete[] pixelArray;
-    return dst;
+    return true;
 }
 
 GrayScaleImage grayscale_CPU(RGBAImage& src)
@@ -29,6 +29,7 @@ RGBAImage extrema_CPU(GrayScaleImage&);
 GrayScaleImage difference_CPU(GrayScaleImage&, GrayScaleImage&);
 GrayScaleImage bilinearSampling_CPU(GrayScaleImage&, double);
 
+bool bilinearSampling_CPU(GrayScaleImage&, double, GrayScaleImage&);
 bool gradientMagnitude_CPU(GrayScaleImage&, GrayScaleImage&);
 bool gradientMagnitudeAndOrientation_CPU(GrayScaleImage&, GrayScaleImage&, GrayScaleImage&);
 bool gradientMagnitudeAndOrientation_CPU(GrayScaleImage&, GrayScaleImage&, GrayScaleImage&, GrayScaleImage&, GrayScaleImage&);
@@ -0,0 +1,322 @@
+#include "kdtree.h"
+#include "descriptor.h"
+
+#include <algorithm>
+#include <queue>
+#include <cfloat>
+using namespace std;
+
+namespace
+{
+//! orders vector indices along one dimension
+template <typename T>
+class DimensionComp
+{
+public:
+    DimensionComp(const T* data, size_t dim, int splitDim):
+        data(data), dim(dim), splitDim(splitDim)
+    {}
+
+    bool operator()(int i, int j) const
+    {
+        return data[(size_t)i * dim + splitDim] < data[(size_t)j * dim + splitDim];
+    }
+
+private:
+    const T* data;
+    size_t dim;
+    int splitDim;
+};
+
+//! tests a dimension of the vectors against a value
+template <typename T>
+class LessThan
+{
+public:
+    LessThan(const T* data, size_t dim, int splitDim, double value):
+        data(data), dim(dim), splitDim(splitDim), value(value)
+    {}
+
+    bool operator()(int i) const
+    {
+        return data[(size_t)i * dim + splitDim] < value;
+    }
+
+private:
+    const T* data;
+    size_t dim;
+    int splitDim;
+    double value;
+};
+
+template <typename T>
+class NotGreaterThan
+{
+public:
+    NotGreaterThan(const T* data, size_t dim, int splitDim, double value):
+        data(data), dim(dim), splitDim(splitDim), value(value)
+    {}
+
+    bool operator()(int i) const
+    {
+        return data[(size_t)i * dim + splitDim] <= value;
+    }
+
+private:
+    const T* data;
+    size_t dim;
+    int splitDim;
+    double value;
+};
+
+//! a subtree still to search, with a lower bound of the squared distance
+//! from the query to any of its vectors
+struct Branch
+{
+    Branch(double bound, int node):
+        bound(bound), node(node)
+    {}
+
+    //! the queue puts the closest branch on top
+    bool operator<(const Branch& other) const
+    {
+        return bound > other.bound;
+    }
+
+    double bound;
+    int node;
+};
+}
+
+template <typename T>
+KDTree<T>::KDTree():
+    _data(0),
+    _size(0),
+    _dim(0)
+{
+}
+
+template <typename T>
+void KDTree<T>::clear()
+{
+    _data = 0;
+    _size = _dim = 0;
+    _index.clear();
+    _nodes.clear();
+}
+
+template <typename T>
+void KDTree<T>::build(const T* data, size_t n, size_t dim)
+{
+    clear();
+
+    _data = data;
+    _size = n;
+    _dim = dim;
+
+    if(n == 0)
+        return;
+
+    _index.resize(n);
+    for(size_t i=0;i<n;i++)
+        _index[i] = i;
+
+    _nodes.reserve(2 * n / LEAF_SIZE + 1);
+    buildNode(0, n);
+}
+
+template <typename T>
+int KDTree<T>::buildNode(int begin, int end)
+{
+    int nodeIdx = _nodes.size();
+    _nodes.push_back(Node());
+
+    Node node;
+    node.begin = begin;
+    node.end = end;
+    node.left = node.right = -1;
+    node.dim = -1;
+    node.value = 0;
+
+    if(end - begin > LEAF_SIZE)
+    {
+        // split at the median of the dimension with the largest spread
+        node.dim = selectSplitDimension(begin, end);
+        int mid = begin + (end - begin) / 2;
+        nth_element(_index.begin() + begin, _index.begin() + mid, _index.begin() + end,
+                    DimensionComp<T>(_data, _dim, node.dim));
+        node.value = vectorAt(_index[mid])[node.dim];
+
+        // the vectors equal to the median, many in sparse descriptors, all
+        // go to one side, where the query equal to them looks first
+        int lower = partition(_index.begin() + begin, _index.begin() + end,
+                              LessThan<T>(_data, _dim, node.dim, node.value)) - _index.begin();
+        if(lower > begin)
+            mid = lower;
+        else
+        {
+            // the median is the minimum, split above it
+            double upperMin = DBL_MAX;
+            int upper = partition(_index.begin() + begin, _index.begin() + end,
+                                  NotGreaterThan<T>(_data, _dim, node.dim, node.value)) - _index.begin();
+            for(int i=upper;i<end;i++)
+                upperMin = min(upperMin, (double)vectorAt(_index[i])[node.dim]);
+            if(upper < end)
+            {
+                mid = upper;
+                node.value = (node.value + upperMin) / 2;
+            }
+        }
+
+        node.left = buildNode(begin, mid);
+        node.right = buildNode(mid, end);
+    }
+
+    _nodes[nodeIdx] = node;
+    return nodeIdx;
+}
+
+template <typename T>
+int KDTree<T>::selectSplitDimension(int begin, int end) const
+{
+    // the variance is estimated from a sample of the vectors
+    const int SAMPLE_SIZE = 100;
+    int step = (end - begin) / SAMPLE_SIZE;
+    if(step < 1) step = 1;
+
+    int bestDim = 0;
+    double bestVariance = -1;
+    for(size_t d=0;d<_dim;d++)
+    {
+        double sum = 0, squareSum = 0;
+        int count = 0;
+        for(int i=begin;i<end;i+=step)
+        {
+            double v = vectorAt(_index[i])[d];
+            sum += v;
+            squareSum += v * v;
+            count++;
+        }
+
+        double mean = sum / count;
+        double variance = squareSum / count - mean * mean;
+        if(variance > bestVariance)
+        {
+            bestVariance = variance;
+            bestDim = d;
+        }
+    }
+
+    return bestDim;
+}
+
+template <typename T>
+double KDTree<T>::squaredDistance(const T* a, const T* b, size_t dim)
+{
+    double sum = 0;
+    for(size_t i=0;i<dim;i++)
+    {
+        double diff = (double)a[i] - (double)b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+//! descriptors go through the vectorized kernel
+template <>
+double KDTree<unsigned char>::squaredDistance(const unsigned char* a, const unsigned char* b, size_t dim)
+{
+    if(dim == (size_t)DescriptorUtils::DESCRIPTOR_LENGTH)
+        return DescriptorUtils::squaredDistance(a, b);
+
+    int sum = 0;
+    for(size_t i=0;i<dim;i++)
+    {
+        int diff = (int)a[i] - (int)b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+template <typename T>
+void KDTree<T>::nearest2(const T* query, int maxChecks, int idx[2], double dist[2]) const
+{
+    idx[0] = idx[1] = -1;
+    dist[0] = dist[1] = DBL_MAX;
+
+    if(_nodes.empty())
+        return;
+
+    // in 128 dimensions an exact search visits most bins anyway, the
+    // vectors are compared in turn
+    if(maxChecks <= 0)
+    {
+        for(size_t v=0;v<_size;v++)
+            insertNeighbor(v, squaredDistance(query, vectorAt(v), _dim), idx, dist);
+        return;
+    }
+
+    priority_queue<Branch> branches;
+    branches.push(Branch(0, 0));
+
+    int checks = 0;
+    while(!branches.empty())
+    {
+        Branch b = branches.top();
+        branches.pop();
+
+        // the bounds add up the distances to the splits on the way, an
+        // estimate rather than a strict bound when a dimension is split
+        // twice; the branches beyond the second neighbor are left out
+        if(b.bound >= dist[1] || checks >= maxChecks)
+            break;
+
+        // descend to the bin of the query, remembering the other sides
+        int nodeIdx = b.node;
+        while(_nodes[nodeIdx].dim >= 0)
+        {
+            const Node& node = _nodes[nodeIdx];
+            double diff = query[node.dim] - node.value;
+            double bound = b.bound + diff * diff;
+
+            if(diff < 0)
+            {
+                branches.push(Branch(bound, node.right));
+                nodeIdx = node.left;
+            }
+            else
+            {
+                branches.push(Branch(bound, node.left));
+                nodeIdx = node.right;
+            }
+        }
+
+        const Node& leaf = _nodes[nodeIdx];
+        for(int i=leaf.begin;i<leaf.end;i++)
+        {
+            int v = _index[i];
+            insertNeighbor(v, squaredDistance(query, vectorAt(v), _dim), idx, dist);
+            checks++;
+        }
+    }
+}
+
+template <typename T>
+void KDTree<T>::insertNeighbor(int v, double d, int idx[2], double dist[2])
+{
+    if(d < dist[0])
+    {
+        idx[1] = idx[0];
+        dist[1] = dist[0];
+        idx[0] = v;
+        dist[0] = d;
+    }
+    else if(d < dist[1])
+    {
+        idx[1] = v;
+        dist[1] = d;
+    }
+}
+
+template class KDTree<double>;
+template class KDTree<unsigned char>;
@@ -0,0 +1,62 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+#include <cstdlib>
+#include <vector>
+using namespace std;
+
+//! k-d tree over feature vectors for the nearest neighbor queries of the
+//! matcher. A query descends to the bin of the query point first, then
+//! visits the other bins in the order of their distance to it (best bin
+//! first, Beis & Lowe 1997) until a given number of vectors are checked.
+//! The exact search compares all vectors, for validation.
+//! Trees are instantiated for double and for quantized byte vectors.
+template <typename T>
+class KDTree
+{
+public:
+    KDTree();
+
+    //! builds the tree over n vectors of the given dimension, stored one
+    //! after the other; the data is not copied and must outlive the tree
+    void build(const T* data, size_t n, size_t dim);
+    void clear();
+
+    //! the two nearest vectors of the query and their squared distances,
+    //! the nearest first; an index is -1 when there are fewer vectors.
+    //! maxChecks bounds the number of vectors compared, 0 for an exact search
+    void nearest2(const T* query, int maxChecks, int idx[2], double dist[2]) const;
+
+    size_t size() const {return _size;}
+    size_t dimension() const {return _dim;}
+
+    static double squaredDistance(const T* a, const T* b, size_t dim);
+
+private:
+    //! a leaf holds the vectors _index[begin, end), an inner node splits
+    //! them at value along dimension dim, the lower half goes left
+    struct Node
+    {
+        int dim;
+        double value;
+        int left, right;
+        int begin, end;
+    };
+
+    int buildNode(int begin, int end);
+    int selectSplitDimension(int begin, int end) const;
+    static void insertNeighbor(int v, double d, int idx[2], double dist[2]);
+
+    const T* vectorAt(int i) const {return _data + (size_t)i * _dim;}
+
+private:
+    const T* _data;
+    size_t _size, _dim;
+
+    vector<int> _index;
+    vector<Node> _nodes;
+
+    static const int LEAF_SIZE = 8;
+};
+
+#endif // KDTREE_H
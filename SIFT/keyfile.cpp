@@ -0,0 +1,414 @@
+#include "keyfile.h"
+#include "descriptor.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+const char KeyFile::magic[8] = { 'S', 'I', 'F', 'T', 'K', 'E', 'Y', '\0' };
+const quint32 KeyFile::version = 1;
+
+namespace
+{
+//! sections start at cache line boundaries
+const quint64 SECTION_ALIGNMENT = 64;
+
+const quint32 BYTE_ORDER_MARK = 0x01020304;
+
+struct KeyFileHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    quint64 fileSize;
+
+    quint64 keyNumber;
+    quint32 dimension;
+    quint32 descriptorType;
+
+    quint64 keypointOffset;
+    quint64 descriptorOffset;
+};
+
+quint64 alignOffset(quint64 offset)
+{
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+quint64 descriptorSize(KeyFile::DescriptorType type, int dim)
+{
+    return type == KeyFile::ByteDescriptors ? dim : dim * sizeof(float);
+}
+
+bool isSectionValid(const KeyFileHeader& h, quint64 offset, quint64 number, quint64 elementSize)
+{
+    return offset <= h.fileSize && number <= (h.fileSize - offset) / elementSize;
+}
+
+//! reads the next number of a text key file
+bool parseValue(const char*& p, double& v)
+{
+    char* end;
+    v = strtod(p, &end);
+    if( end == p )
+        return false;
+    p = end;
+    return true;
+}
+}
+
+KeyFile::KeyFile():
+    _size(0),
+    _dim(0),
+    _format(TextFormat),
+    _type(FloatDescriptors),
+    _keypoints(0),
+    _floatDescriptors(0),
+    _byteDescriptors(0),
+    _file(0),
+    _data(0)
+{
+}
+
+KeyFile::~KeyFile()
+{
+    clear();
+}
+
+void KeyFile::clear()
+{
+    if( _file )
+    {
+        _file->unmap((uchar*)_data);
+        _file->close();
+        delete _file;
+        _file = 0;
+        _data = 0;
+    }
+
+    _keypointBuffer.clear();
+    _descriptorBuffer.clear();
+
+    _size = 0;
+    _dim = 0;
+    _keypoints = 0;
+    _floatDescriptors = 0;
+    _byteDescriptors = 0;
+}
+
+bool KeyFile::load(const string &filename)
+{
+    clear();
+
+    QFile* file = new QFile(QString::fromStdString(filename));
+    if( !file->open(QIODevice::ReadOnly) )
+    {
+        delete file;
+        return false;
+    }
+
+    char fileMagic[sizeof(magic)];
+    if( file->peek(fileMagic, sizeof(magic)) == sizeof(magic)
+            && memcmp(fileMagic, magic, sizeof(magic)) == 0 )
+        return loadBinary(file);
+
+    delete file;
+    return loadText(filename);
+}
+
+bool KeyFile::loadBinary(QFile *file)
+{
+    const uchar* data = 0;
+    if( (quint64)file->size() >= sizeof(KeyFileHeader) )
+        data = file->map(0, file->size());
+    if( !data )
+    {
+        delete file;
+        return false;
+    }
+
+    // verify the header and the bounds of the sections before the keys are used
+    const KeyFileHeader& h = *reinterpret_cast<const KeyFileHeader*>(data);
+    bool valid = h.version == version
+            && h.byteOrder == BYTE_ORDER_MARK
+            && h.fileSize == (quint64)file->size()
+            && h.dimension > 0
+            && (h.descriptorType == FloatDescriptors || h.descriptorType == ByteDescriptors)
+            && h.keypointOffset % sizeof(float) == 0
+            && h.descriptorOffset % sizeof(float) == 0
+            && isSectionValid(h, h.keypointOffset, h.keyNumber, sizeof(Keypoint))
+            && isSectionValid(h, h.descriptorOffset, h.keyNumber,
+                              descriptorSize((DescriptorType)h.descriptorType, h.dimension));
+    if( !valid )
+    {
+        file->unmap((uchar*)data);
+        delete file;
+        return false;
+    }
+
+    _file = file;
+    _data = data;
+
+    _format = BinaryFormat;
+    _type = (DescriptorType)h.descriptorType;
+    _size = h.keyNumber;
+    _dim = h.dimension;
+    _keypoints = reinterpret_cast<const Keypoint*>(data + h.keypointOffset);
+    if( _type == FloatDescriptors )
+        _floatDescriptors = reinterpret_cast<const float*>(data + h.descriptorOffset);
+    else
+        _byteDescriptors = data + h.descriptorOffset;
+
+    return true;
+}
+
+bool KeyFile::loadText(const string &filename)
+{
+    // the whole file is read at once and parsed in memory, much faster
+    // than extracting the values from the stream one at a time
+    ifstream in(filename.c_str(), ios::in | ios::binary);
+    if( !in )
+        return false;
+
+    in.seekg(0, ios::end);
+    size_t length = in.tellg();
+    in.seekg(0, ios::beg);
+
+    vector<char> text(length + 1);
+    in.read(&text[0], length);
+    text[in.gcount()] = '\0';
+
+    const char* p = &text[0];
+    double size, dim;
+    if( !parseValue(p, size) || !parseValue(p, dim) || size < 0 || dim < 1 )
+        return false;
+
+    // a value takes at least two characters, the counts of the header are
+    // not trusted beyond what the file can hold
+    size_t maxValues = length / 2 + 1;
+    if( dim > maxValues )
+        return false;
+
+    _format = TextFormat;
+    _type = FloatDescriptors;
+    _dim = (int)dim;
+
+    size_t expected = (size_t)min(size, (double)(maxValues / (_dim + 4)));
+    _keypointBuffer.reserve(expected);
+    _descriptorBuffer.reserve(expected * _dim);
+
+    // the buffers grow with the keys parsed, a truncated file keeps the
+    // complete keys
+    size_t count = 0;
+    vector<float> descriptor(_dim);
+    for(;count<size;count++)
+    {
+        double v[4];
+        bool complete = parseValue(p, v[0]) && parseValue(p, v[1])
+                && parseValue(p, v[2]) && parseValue(p, v[3]);
+
+        for(int i=0;complete && i<_dim;i++)
+        {
+            double d;
+            complete = parseValue(p, d);
+            descriptor[i] = d;
+        }
+
+        if( !complete )
+            break;
+
+        Keypoint k;
+        k.x = v[0];
+        k.y = v[1];
+        k.scale = v[2];
+        k.orientation = v[3];
+        _keypointBuffer.push_back(k);
+        _descriptorBuffer.insert(_descriptorBuffer.end(), descriptor.begin(), descriptor.end());
+    }
+
+    if( count < size )
+        cout << "key file " << filename << " holds " << count << " of " << size << " keys" << endl;
+
+    _size = count;
+    _keypoints = _size > 0 ? &_keypointBuffer[0] : 0;
+    _floatDescriptors = _size > 0 ? &_descriptorBuffer[0] : 0;
+    return true;
+}
+
+bool KeyFile::save(const string &filename, Format format, DescriptorType type) const
+{
+    KeyFileWriter writer;
+    if( !writer.open(filename, _size, _dim, format, type) )
+        return false;
+
+    // bytes are converted back to unit length values, quantizing them again
+    // gives the same bytes
+    vector<double> descriptor(_dim);
+    for(size_t i=0;i<_size;i++)
+    {
+        for(int j=0;j<_dim;j++)
+        {
+            if( _type == FloatDescriptors )
+                descriptor[j] = _floatDescriptors[i * _dim + j];
+            else
+                descriptor[j] = _byteDescriptors[i * _dim + j] / 512.0;
+        }
+        writer.add(_keypoints[i], &descriptor[0]);
+    }
+
+    return writer.close();
+}
+
+KeyFileWriter::KeyFileWriter():
+    _format(KeyFile::TextFormat),
+    _type(KeyFile::FloatDescriptors),
+    _size(0),
+    _count(0),
+    _dim(0),
+    _keypointOffset(0),
+    _descriptorOffset(0)
+{
+}
+
+KeyFileWriter::~KeyFileWriter()
+{
+    if( _out.is_open() )
+        close();
+}
+
+bool KeyFileWriter::open(const string &filename, size_t size, int dimension,
+                         KeyFile::Format format, KeyFile::DescriptorType type)
+{
+    if( _out.is_open() || dimension < 1 )
+        return false;
+    if( format == KeyFile::TextFormat && type != KeyFile::FloatDescriptors )
+        return false;
+
+    _format = format;
+    _type = type;
+    _size = size;
+    _count = 0;
+    _dim = dimension;
+
+    if( _format == KeyFile::TextFormat )
+    {
+        _out.open(filename.c_str(), ios::out);
+        if( !_out )
+            return false;
+
+        _out << _size << ' ' << _dim << '\n';
+        return true;
+    }
+
+    _out.open(filename.c_str(), ios::out | ios::binary);
+    if( !_out )
+        return false;
+
+    _keypointOffset = alignOffset(sizeof(KeyFileHeader));
+    _descriptorOffset = alignOffset(_keypointOffset + _size * sizeof(KeyFile::Keypoint));
+    _keypoints.reserve(_size);
+    if( _type == KeyFile::FloatDescriptors )
+        _floatRow.resize(_dim);
+    else
+        _byteRow.resize(_dim);
+
+    pad(_descriptorOffset);
+    return true;
+}
+
+void KeyFileWriter::add(double x, double y, double scale, double orientation, const double *descriptor)
+{
+    KeyFile::Keypoint k;
+    k.x = x;
+    k.y = y;
+    k.scale = scale;
+    k.orientation = orientation;
+    add(k, descriptor);
+}
+
+void KeyFileWriter::add(const KeyFile::Keypoint &k, const double *descriptor)
+{
+    if( !_out.is_open() || _count >= _size )
+        return;
+
+    _count++;
+
+    if( _format == KeyFile::TextFormat )
+    {
+        const char SEPERATOR = ' ';
+        const char ENDLINE = '\n';
+        _out << k.x << SEPERATOR
+             << k.y << SEPERATOR
+             << k.scale << SEPERATOR
+             << k.orientation << SEPERATOR
+             << ENDLINE;
+        for(int i=0;i<_dim;i++)
+            _out << descriptor[i] << SEPERATOR;
+        _out << ENDLINE;
+        return;
+    }
+
+    _keypoints.push_back(k);
+    if( _type == KeyFile::FloatDescriptors )
+    {
+        for(int i=0;i<_dim;i++)
+            _floatRow[i] = descriptor[i];
+        _out.write((const char*)&_floatRow[0], _dim * sizeof(float));
+    }
+    else
+    {
+        DescriptorUtils::quantize(descriptor, &_byteRow[0], _dim);
+        _out.write((const char*)&_byteRow[0], _dim);
+    }
+}
+
+bool KeyFileWriter::close()
+{
+    if( !_out.is_open() )
+        return false;
+
+    if( _format == KeyFile::BinaryFormat )
+    {
+        // keys that were not added are left out of the header
+        KeyFileHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, KeyFile::magic, sizeof(KeyFile::magic));
+        h.version = KeyFile::version;
+        h.byteOrder = BYTE_ORDER_MARK;
+        h.fileSize = _descriptorOffset + _count * descriptorSize(_type, _dim);
+        h.keyNumber = _count;
+        h.dimension = _dim;
+        h.descriptorType = _type;
+        h.keypointOffset = _keypointOffset;
+        h.descriptorOffset = _descriptorOffset;
+
+        if( !_keypoints.empty() )
+        {
+            _out.seekp(_keypointOffset);
+            _out.write((const char*)&_keypoints[0], _keypoints.size() * sizeof(KeyFile::Keypoint));
+        }
+        _out.seekp(0);
+        _out.write((const char*)&h, sizeof(h));
+
+        _keypoints.clear();
+    }
+
+    bool ok = !_out.fail();
+    _out.close();
+    return ok;
+}
+
+void KeyFileWriter::pad(quint64 offset)
+{
+    static const char zeros[SECTION_ALIGNMENT] = { 0 };
+    quint64 pos = (quint64)_out.tellp();
+    while( pos < offset )
+    {
+        quint64 n = offset - pos;
+        if( n > SECTION_ALIGNMENT )
+            n = SECTION_ALIGNMENT;
+        _out.write(zeros, n);
+        pos += n;
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef KEYFILE_H
+#define KEYFILE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+using namespace std;
+
+#include <QFile>
+
+//! Key files, the keypoints of an image with their descriptors.
+//!
+//! text format, as written by the first versions:
+//! number of keys, descriptor length
+//! per key: x y scale orientation, then the descriptor values
+//!
+//! binary format:
+//! header, magic, version, byte order, number of keys, descriptor length
+//! and type, offsets of the sections
+//! keypoint table, x y scale orientation as floats per key
+//! descriptor block, the descriptors one after the other, as floats or as
+//! bytes quantized like the matcher's descriptors
+//!
+//! The sections are aligned to 64 bytes, once a binary file is mapped the
+//! keypoints and descriptors are used in place. A file of another byte
+//! order is rejected.
+class KeyFile
+{
+public:
+    enum Format
+    {
+        TextFormat,
+        BinaryFormat
+    };
+
+    enum DescriptorType
+    {
+        FloatDescriptors,
+        ByteDescriptors
+    };
+
+    //! location of a key in the original image
+    struct Keypoint
+    {
+        float x, y, scale, orientation;
+    };
+
+    KeyFile();
+    ~KeyFile();
+
+    //! reads a key file of either format, told apart by the magic; a binary
+    //! file is mapped until the keys are cleared, a text file is parsed into
+    //! float descriptors; returns false when the file is missing or invalid
+    bool load(const string& filename);
+    void clear();
+
+    //! writes the keys in the given format, to convert between formats;
+    //! text files always hold the values of the descriptors
+    bool save(const string& filename, Format format, DescriptorType type = FloatDescriptors) const;
+
+    size_t size() const {return _size;}
+    int dimension() const {return _dim;}
+    Format format() const {return _format;}
+    DescriptorType descriptorType() const {return _type;}
+
+    const Keypoint* keypoints() const {return _keypoints;}
+
+    //! the descriptor block, floatDescriptors for FloatDescriptors and
+    //! byteDescriptors for ByteDescriptors, 0 for the other type
+    const float* floatDescriptors() const {return _floatDescriptors;}
+    const unsigned char* byteDescriptors() const {return _byteDescriptors;}
+
+    static const char magic[8];
+    static const quint32 version;
+
+private:
+    bool loadBinary(QFile* file);
+    bool loadText(const string& filename);
+
+private:
+    size_t _size;
+    int _dim;
+    Format _format;
+    DescriptorType _type;
+
+    const Keypoint* _keypoints;
+    const float* _floatDescriptors;
+    const unsigned char* _byteDescriptors;
+
+    //! mapping of a binary file
+    QFile* _file;
+    const uchar* _data;
+
+    //! keys parsed from a text file
+    vector<Keypoint> _keypointBuffer;
+    vector<float> _descriptorBuffer;
+};
+
+//! Writes a key file one key at a time. The number of keys is given when the
+//! file is opened; the descriptors of a binary file are written as they are
+//! added, the keypoint table and the header when it is closed.
+class KeyFileWriter
+{
+public:
+    KeyFileWriter();
+    ~KeyFileWriter();
+
+    //! byte descriptors are quantized from unit length descriptors and
+    //! only written to binary files
+    bool open(const string& filename, size_t size, int dimension,
+              KeyFile::Format format, KeyFile::DescriptorType type = KeyFile::FloatDescriptors);
+
+    void add(double x, double y, double scale, double orientation, const double* descriptor);
+    void add(const KeyFile::Keypoint& k, const double* descriptor);
+
+    //! completes the file, false when it could not be written
+    bool close();
+
+private:
+    void pad(quint64 offset);
+
+private:
+    ofstream _out;
+    KeyFile::Format _format;
+    KeyFile::DescriptorType _type;
+    size_t _size, _count;
+    int _dim;
+
+    quint64 _keypointOffset, _descriptorOffset;
+    vector<KeyFile::Keypoint> _keypoints;
+    vector<float> _floatRow;
+    vector<unsigned char> _byteRow;
+};
+
+#endif // KEYFILE_H
@@ -10,11 +10,12 @@
 
 void printHelp(const string& program)
 {
-    cout << "Usage: " << program << " [-vgdeh] " << " filename1 ... filenamX" << endl;
+    cout << "Usage: " << program << " [-vgdebh] " << " filename1 ... filenamX" << endl;
     cout << " -v : verbose mode, output everything." << endl;
     cout << " -g : output gaussian pyramid." << endl;
     cout << " -d : output difference of gaussian pyramid." << endl;
     cout << " -e : output extrema images." << endl;
+    cout << " -b : write binary key files instead of text ones." << endl;
     cout << " -h : print help information." << endl;
 }
 
@@ -44,6 +45,7 @@ int main(int argc, char** argv)
                 case 'g':
                 case 'd':
                 case 'e':
+                case 'b':
                 {
                     op.setMode(option);
                     break;
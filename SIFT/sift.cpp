@@ -88,22 +88,18 @@ QImage SiftOperator::process(const string& filename)
 #endif
 
     // upsampling the image by a factor of 2
-    GrayScaleImage enlargedImage =
-            ImageOperator::bilinearSampling_CPU(grayImage, 2.0);
+    ImageOperator::bilinearSampling_CPU(grayImage, 2.0, enlargedImage);
 
-    // initial smooth
-    GrayScaleImage initialImage =
-            ImageOperator::gaussianFilter_bidirectional_CPU(enlargedImage, sqrt(sigma0 * sigma0 - initialSigma * initialSigma * 4));
+    allocateResources(enlargedImage.width(), enlargedImage.height());
 
-    allocateResources();
+    // initial smooth, into the first level of the pyramid
+    blur.apply(enlargedImage, gaussians[0][0], sqrt(sigma0 * sigma0 - initialSigma * initialSigma * 4));
 
-    buildGaussianPyramid(initialImage);
+    buildGaussianPyramid();
 
     if(outputGSPYMD)
         outputGaussianPyramid();
 
-    buildDifferenceOfGaussianPyrmaid();
-
     if(outputDOGPYMD)
         outputDifferenceOfGaussianPyramid();
 
@@ -251,29 +247,26 @@ void SiftOperator::outputFeatureVectors()
 {
     cout << "writing feature vectors ... " << endl;
     list<Feature>::iterator kit = keypoints.begin();
-    fstream keyfile;
     stringstream keyss;
     keyss << infilename.substr(0, infilename.find(".")) << ".key";
     string keyfilename;
     keyss >> keyfilename;
-    keyfile.open(keyfilename.c_str(), ios::out);
-    const char SEPERATOR = ' ';
-    const char ENDLINE = '\n';
-    keyfile << keypoints.size() << SEPERATOR << feature_vector_length << ENDLINE;
+
+    KeyFileWriter keyfile;
+    if(!keyfile.open(keyfilename, keypoints.size(), feature_vector_length,
+                     keyFormat, keyDescriptorType))
+    {
+        cout << "cannot write " << keyfilename << endl;
+        return;
+    }
     while (kit !=  keypoints.end())
     {
-        Feature f = (*kit);
-        keyfile << f._imgX / 2.0 << SEPERATOR
-                << f._imgY / 2.0 << SEPERATOR
-                << f._scale << SEPERATOR
-                << f._orientation << SEPERATOR
-                << ENDLINE;
-        for (int i=0;i<feature_vector_length;i++)
-            keyfile << f._signature[i] << SEPERATOR;
-        keyfile << ENDLINE;
+        const Feature& f = (*kit);
+        keyfile.add(f._imgX / 2.0, f._imgY / 2.0, f._scale, f._orientation, f._signature);
         kit ++;
     }
-    keyfile.close();
+    if(!keyfile.close())
+        cout << "cannot write " << keyfilename << endl;
 }
 
 void SiftOperator::calculateFeatureVectors()
@@ -1008,19 +1001,6 @@ void SiftOperator::outputDifferenceOfGaussianPyramid()
     }
 }
 
-void SiftOperator::buildDifferenceOfGaussianPyrmaid()
-{
-    cout << "building difference of gaussians pyramid ... " << endl;
-
-    for (int i=0;i<octaves;i++)
-    {
-        for (int j=0;j<dogNumberPerOctave;j++)
-        {
-            dogs[i][j] = ImageOperator::difference_CPU(gaussians[i][j + 1], gaussians[i][j]);
-        }
-    }
-}
-
 void SiftOperator::outputGaussianPyramid()
 {
     for (int i=0;i<octaves;i++)
@@ -1032,7 +1012,7 @@ void SiftOperator::outputGaussianPyramid()
     }
 }
 
-void SiftOperator::buildGaussianPyramid(const GrayScaleImage& initImg)
+void SiftOperator::buildGaussianPyramid()
 {
     double* sigma = new double[gaussianNumberPerOctave];
     sigma[0] = sigma0;
@@ -1047,45 +1027,24 @@ void SiftOperator::buildGaussianPyramid(const GrayScaleImage& initImg)
 
     //     Utils::printArray<double>(sigma, gaussianNumberPerOctave);
 
-    GrayScaleImage curImg = initImg;
-    cout << "building gaussian pyramid ... " << endl;
-    for (int i = 0; i < octaves; i++) {
-        // initial smooth
-        gaussians[i][0] = curImg;
-        for (int j = 1; j < gaussianNumberPerOctave; j++) {
-            gaussians[i][j] =
-                    ImageOperator::
-                    gaussianFilter_bidirectional_CPU(gaussians[i][j - 1],
-                                                     sigma[j]);
-        }
-        curImg =
-                ImageOperator::
-                bilinearSampling_CPU(gaussians[i][gaussianNumberPerOctave - 3], downsampleFactor);
-    }
+    // the differences are computed with the levels
+    cout << "building gaussian and difference of gaussians pyramids ... " << endl;
+    pyramid.build(sigma, gaussianNumberPerOctave - 3, blur);
 
     delete[] sigma;
 }
 
-void SiftOperator::allocateResources()
+void SiftOperator::allocateResources(size_t width, size_t height)
 {
-    gaussians = new GrayScaleImage*[octaves];
-    dogs = new GrayScaleImage*[octaves];
-
-    for (int i=0;i<octaves;i++)
-    {
-        gaussians[i] = new GrayScaleImage[gaussianNumberPerOctave];
-        dogs[i] = new GrayScaleImage[dogNumberPerOctave];
-    }
+    // the pyramids of the previous image are reused when the sizes match
+    pyramid.allocate(width, height, octaves, gaussianNumberPerOctave, downsampleFactor);
+    gaussians = pyramid.gaussians();
+    dogs = pyramid.dogs();
 }
 
 void SiftOperator::releaseResources()
 {
-    for (int i=0;i<octaves;i++)
-    {
-        delete[] gaussians[i];
-        delete[] dogs[i];
-    }
-
-    delete[] gaussians;
-    delete[] dogs;
+    // the arena is kept for the next image
+    gaussians = 0;
+    dogs = 0;
 }
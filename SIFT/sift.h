@@ -6,6 +6,9 @@
 #include "grayscaleimage.h"
 #include "rgbaimage.h"
 #include "mathutil.hpp"
+#include "keyfile.h"
+#include "gaussianblur.h"
+#include "gaussianpyramid.h"
 using namespace MathUtils;
 
 #include <cstdlib>
@@ -21,7 +24,9 @@ public:
     SiftOperator(bool verbose = false):
         outputGSPYMD(verbose),
         outputDOGPYMD(verbose),
-        outputExtrema(verbose)
+        outputExtrema(verbose),
+        keyFormat(KeyFile::TextFormat),
+        keyDescriptorType(KeyFile::FloatDescriptors)
     {
         scales = 3;
         maxEdgeCurvature = 10.0;
@@ -113,9 +118,28 @@ public:
             outputDOGPYMD = false;
             break;
         }
+        case 'b':
+        {
+            keyFormat = KeyFile::BinaryFormat;
+            break;
+        }
+        case 'B':
+        {
+            keyFormat = KeyFile::TextFormat;
+            keyDescriptorType = KeyFile::FloatDescriptors;
+            break;
+        }
         }
     }
 
+    //! format of the key files, the text format of Lowe's keys by default;
+    //! byte descriptors are only written to binary files
+    void setKeyFormat(KeyFile::Format format, KeyFile::DescriptorType type = KeyFile::FloatDescriptors)
+    {
+        keyFormat = format;
+        keyDescriptorType = format == KeyFile::TextFormat ? KeyFile::FloatDescriptors : type;
+    }
+
     //! sift operation for input image file
     QImage process(const string& filename);
 
@@ -125,8 +149,7 @@ private:
 protected:
     //! main components
     inline double* calculateSigmas(double, double);
-    inline void buildGaussianPyramid(const GrayScaleImage&);
-    inline void buildDifferenceOfGaussianPyrmaid();
+    inline void buildGaussianPyramid();
     inline void detectScaleSpaceExtrema();
     inline void refineExtremaLocation();
     inline void filterKeypoints();
@@ -163,11 +186,13 @@ protected:
 
     //! memory management
     inline void releaseResources();
-    inline void allocateResources();
+    inline void allocateResources(size_t width, size_t height);
 
 private:
     //! io options
     bool outputGSPYMD, outputDOGPYMD, outputExtrema;
+    KeyFile::Format keyFormat;
+    KeyFile::DescriptorType keyDescriptorType;
     
     //! parameters
 private:
@@ -260,6 +285,12 @@ private:
     GrayScaleImage** gaussians;
     GrayScaleImage** dogs;
     list<Feature> keypoints;
+
+    //! scratch buffers of the blurs, reused across the pyramid and images
+    GaussianBlur blur;
+    //! the pyramids of gaussians and dogs, kept for images of the same size
+    GaussianPyramid pyramid;
+    GrayScaleImage enlargedImage;
 };
 
 #endif	//SIFT_H
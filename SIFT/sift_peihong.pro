@@ -9,6 +9,12 @@ INCLUDEPATH += .
 LIBS += -lgomp
 QMAKE_CXXFLAGS += -fopenmp
 
+# qmake CONFIG+=avx2 compiles the descriptor distances and the blurs with
+# AVX2 and AVX, SSE2 is used otherwise on x86-64
+avx2 {
+    QMAKE_CXXFLAGS += -mavx2
+}
+
 # Input
 HEADERS += grayscaleimage.h \
            imageoperator.h \
@@ -19,11 +25,21 @@ HEADERS += grayscaleimage.h \
            utility.hpp \
     siftgui.h \
     imageviewer.h \
-    imagematcher.h
+    imagematcher.h \
+    kdtree.h \
+    descriptor.h \
+    keyfile.h \
+    gaussianblur.h \
+    gaussianpyramid.h
 SOURCES += grayscaleimage.cpp imageoperator.cpp main.cpp rgbaimage.cpp sift.cpp \
     siftgui.cpp \
     imageviewer.cpp \
-    imagematcher.cpp
+    imagematcher.cpp \
+    kdtree.cpp \
+    descriptor.cpp \
+    keyfile.cpp \
+    gaussianblur.cpp \
+    gaussianpyramid.cpp
 
 RESOURCES += \
     sift_res.qrc